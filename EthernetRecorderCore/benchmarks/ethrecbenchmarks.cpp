@@ -0,0 +1,301 @@
+// Throughput benchmarks of the parsing and storage hot paths.
+// Results are printed as JSON unless another --benchmark_format is given. Writers write to the null device,
+// or to $ETH_REC_BENCHMARK_FILE to include the disk.
+
+#include "capturering.h"
+#include "capturescanner.h"
+#include "packetparser.h"
+#include "pcapngwriter.h"
+#include "rawstreamwriter.h"
+#include "spscring.h"
+#include "streamgenerator.h"
+#include "syncscan.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <tuple>
+
+
+namespace {
+
+constexpr size_t STREAM_BYTES = 64 * 1024 * 1024;
+
+enum PacketMix
+{
+    MIX_SMALL = 0,
+    MIX_IMIX,
+    MIX_LARGE,
+};
+
+const char* mixName(int64_t mix)
+{
+    switch (mix)
+    {
+    case MIX_SMALL: return "64";
+    case MIX_LARGE: return "1514";
+    default:        return "imix";
+    }
+}
+
+/// Generated once per packet mix, corruption rate (per 10000 frames), protocol version and batch size
+const std::vector<uint8_t>& stream(int64_t mix, int64_t corruptionPer10k = 0, int64_t protocolVersion = 2, int64_t batchBytes = 0)
+{
+    static std::map<std::tuple<int64_t, int64_t, int64_t, int64_t>, std::vector<uint8_t>> streams;
+    auto& data = streams[{mix, corruptionPer10k, protocolVersion, batchBytes}];
+    if (data.empty())
+    {
+        std::vector<StreamGenerator::PacketSize> sizes = StreamGenerator::imix();
+        if (mix == MIX_SMALL)
+        {
+            sizes = {{64, 1}};
+        }
+        else if (mix == MIX_LARGE)
+        {
+            sizes = {{1514, 1}};
+        }
+
+        StreamGenerator generator(sizes);
+        generator.setCorruptionRate(corruptionPer10k / 10000.0);
+        generator.setProtocolVersion(static_cast<uint8_t>(protocolVersion));
+        generator.setBatchBytes(static_cast<size_t>(batchBytes));
+        data.reserve(STREAM_BYTES + ETH_REC_HEADER_V2_BYTES + ETH_REC_MAX_PACKET_BYTES);
+        generator.generate(data, STREAM_BYTES);
+    }
+    return data;
+}
+
+/// Frames of a stream by reference, as the parser would deliver them
+const FrameList& frames(int64_t mix)
+{
+    static std::map<int64_t, FrameList> frameLists;
+    auto it = frameLists.find(mix);
+    if (it == frameLists.end())
+    {
+        it = frameLists.emplace(mix, FrameList()).first;
+
+        const auto& data = stream(mix);
+        PacketParser parser;
+        parser.setSink(&it->second);
+        parser.setEndOfStream(true);
+        parser.parseRawStream(data.data(), data.size());
+    }
+    return it->second;
+}
+
+std::string outputFileName()
+{
+    const char* fileName = std::getenv("ETH_REC_BENCHMARK_FILE");
+    if (fileName != nullptr)
+    {
+        return fileName;
+    }
+#ifdef _WIN32
+    return "NUL";
+#else
+    return "/dev/null";
+#endif
+}
+
+class CountingSink : public PacketSink
+{
+public:
+    void processPacket(const EthRecHeader& /*header*/, const uint8_t* /*data*/) override {++numPackets_;}
+
+    size_t numPackets() const {return numPackets_;}
+
+private:
+    size_t numPackets_{0};
+};
+
+void parse(benchmark::State& state, const std::vector<uint8_t>& data, size_t chunkBytes)
+{
+    PacketParser parser;
+    CountingSink sink;
+    parser.setSink(&sink);
+
+    size_t errorBytes = 0;
+    for (auto _ : state)
+    {
+        parser.reset();
+        for (size_t offset = 0; offset < data.size(); offset += chunkBytes)
+        {
+            parser.parseRawStream(data.data() + offset, std::min(chunkBytes, data.size() - offset));
+        }
+        parser.finish();
+        errorBytes = parser.errorBytes();
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations() * parser.receivedPackets()), benchmark::Counter::kIsRate);
+    state.counters["errorBytes"] = static_cast<double>(errorBytes);
+}
+
+/// Args: packet mix, read chunk size, protocol version
+void BM_ParseRawStream(benchmark::State& state)
+{
+    state.SetLabel(mixName(state.range(0)));
+    parse(state, stream(state.range(0), 0, state.range(2)), static_cast<size_t>(state.range(1)));
+}
+BENCHMARK(BM_ParseRawStream)->ArgsProduct({{MIX_SMALL, MIX_IMIX, MIX_LARGE}, {512, 16 * 1024, 1024 * 1024}, {1, 2}})->Unit(benchmark::kMillisecond);
+
+/// Batch records against one record per frame. Args: packet mix, batch size (0: not batched)
+void BM_ParseBatchedStream(benchmark::State& state)
+{
+    state.SetLabel(mixName(state.range(0)));
+    parse(state, stream(state.range(0), 0, 2, state.range(1)), 16 * 1024);
+}
+BENCHMARK(BM_ParseBatchedStream)->ArgsProduct({{MIX_SMALL, MIX_IMIX}, {0, 4096, 16 * 1024}})->Unit(benchmark::kMillisecond);
+
+/// Resync cost. Args: corrupted frames per 10000, read chunk size
+void BM_ParseCorruptedStream(benchmark::State& state)
+{
+    state.SetLabel(mixName(MIX_IMIX));
+    parse(state, stream(MIX_IMIX, state.range(0)), static_cast<size_t>(state.range(1)));
+}
+BENCHMARK(BM_ParseCorruptedStream)->ArgsProduct({{0, 10, 100, 1000}, {16 * 1024}})->Unit(benchmark::kMillisecond);
+
+/// Pure sync word search, e.g. while the parser skips a long run of garbage
+void BM_FindSyncWord(benchmark::State& state)
+{
+    std::vector<uint8_t> data(static_cast<size_t>(state.range(0)));
+    for (size_t k = 0; k < data.size(); ++k)
+    {
+        data[k] = static_cast<uint8_t>(k * 7);
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(findSyncWord(data.data(), data.size()));
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_FindSyncWord)->Arg(16 * 1024)->Arg(1024 * 1024);
+
+void BM_PcapngWriter(benchmark::State& state)
+{
+    state.SetLabel(mixName(state.range(0)));
+    const auto& frameList = frames(state.range(0));
+    const auto& data = stream(state.range(0));
+
+    PcapngWriter writer;
+    if (!writer.open(outputFileName()))
+    {
+        state.SkipWithError("Cannot open the output file");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        frameList.replay(writer);
+    }
+
+    writer.close();
+    if (writer.hasError())
+    {
+        state.SkipWithError("Write error");
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations() * frameList.size()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_PcapngWriter)->Arg(MIX_SMALL)->Arg(MIX_IMIX)->Arg(MIX_LARGE)->Unit(benchmark::kMillisecond);
+
+/// Arg: size of the chunks handed over by the capture engine
+void BM_RawStreamWriter(benchmark::State& state)
+{
+    const auto& data = stream(MIX_IMIX);
+    const auto chunkBytes = static_cast<size_t>(state.range(0));
+
+    RawStreamWriter writer;
+    if (!writer.open(outputFileName()))
+    {
+        state.SkipWithError("Cannot open the output file");
+        return;
+    }
+
+    for (auto _ : state)
+    {
+        for (size_t offset = 0; offset < data.size(); offset += chunkBytes)
+        {
+            writer.processStream(data.data() + offset, std::min(chunkBytes, data.size() - offset));
+        }
+    }
+
+    writer.close();
+    if (writer.hasError())
+    {
+        state.SkipWithError("Write error");
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+}
+BENCHMARK(BM_RawStreamWriter)->Arg(512)->Arg(16 * 1024)->Arg(1024 * 1024)->Unit(benchmark::kMillisecond);
+
+/// Rolling capture in steady state (ring full, evicting)
+void BM_CaptureRing(benchmark::State& state)
+{
+    state.SetLabel(mixName(state.range(0)));
+    const auto& frameList = frames(state.range(0));
+    const auto& data = stream(state.range(0));
+
+    CaptureRing ring(16 * 1024 * 1024);
+    for (auto _ : state)
+    {
+        frameList.replay(ring);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * data.size()));
+    state.counters["frames"] = benchmark::Counter(static_cast<double>(state.iterations() * frameList.size()), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CaptureRing)->Arg(MIX_SMALL)->Arg(MIX_IMIX)->Arg(MIX_LARGE)->Unit(benchmark::kMillisecond);
+
+/// Producer and consumer on one thread, i.e. the cost of the ring bookkeeping. Arg: chunk size
+void BM_SpscByteRing(benchmark::State& state)
+{
+    const auto chunkBytes = static_cast<size_t>(state.range(0));
+    const std::vector<uint8_t> chunk(chunkBytes, 0x5A);
+    SpscByteRing ring(16 * 1024 * 1024);
+
+    for (auto _ : state)
+    {
+        size_t numBytes;
+        uint8_t* writePointer = ring.writePointer(numBytes);
+        numBytes = std::min(numBytes, chunkBytes);
+        memcpy(writePointer, chunk.data(), numBytes);
+        ring.commitWrite(numBytes);
+
+        const uint8_t* readPointer = ring.readPointer(numBytes);
+        benchmark::DoNotOptimize(readPointer);
+        ring.commitRead(numBytes);
+    }
+
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * chunkBytes));
+}
+BENCHMARK(BM_SpscByteRing)->Arg(512)->Arg(16 * 1024);
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    // JSON by default, so that runs can be compared by scripts. A --benchmark_format on the command line wins.
+    std::vector<char*> args(argv, argv + argc);
+    char jsonFormat[] = "--benchmark_format=json";
+    args.insert(args.begin() + 1, jsonFormat);
+    int numArgs = static_cast<int>(args.size());
+
+    benchmark::Initialize(&numArgs, args.data());
+    if (benchmark::ReportUnrecognizedArguments(numArgs, args.data()))
+    {
+        return 1;
+    }
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
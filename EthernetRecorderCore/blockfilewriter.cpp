@@ -0,0 +1,140 @@
+#include "blockfilewriter.h"
+#include "latencytracker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+
+
+namespace {
+
+int64_t steadyTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}   // anonymous namespace
+
+
+void BlockFileWriter::AlignedDeleter::operator()(uint8_t* ptr) const
+{
+    ::operator delete(ptr, std::align_val_t(BLOCK_ALIGNMENT));
+}
+
+BlockFileWriter::BlockFileWriter(size_t blockBytes)
+    : blockBytes_(blockBytes)
+{
+    if ((blockBytes == 0) || (blockBytes % BLOCK_ALIGNMENT != 0))
+    {
+        throw std::invalid_argument("BlockFileWriter::BlockFileWriter(): Invalid block size");
+    }
+
+    buffer_.reset(static_cast<uint8_t*>(::operator new(blockBytes_, std::align_val_t(BLOCK_ALIGNMENT))));
+}
+
+BlockFileWriter::~BlockFileWriter()
+{
+    close();
+}
+
+bool BlockFileWriter::open(const std::string& fileName)
+{
+    close();
+
+    file_ = std::fopen(fileName.c_str(), "wb");
+    if (file_ == nullptr)
+    {
+        return false;
+    }
+
+    // Whole blocks are written at once, no need for stdio buffering
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+
+    bufferValidBytes_ = 0;
+    flushedBytes_ = 0;
+    hasError_ = false;
+    return true;
+}
+
+void BlockFileWriter::close()
+{
+    if (file_ == nullptr)
+    {
+        return;
+    }
+
+    flush();
+    std::fclose(file_);
+    file_ = nullptr;
+}
+
+void BlockFileWriter::write(const void* data, size_t numBytes)
+{
+    if (file_ == nullptr)
+    {
+        return;
+    }
+
+    auto bytes = static_cast<const uint8_t*>(data);
+    while (numBytes > 0)
+    {
+        if ((latencyTracker_ != nullptr) && (bufferValidBytes_ == 0))
+        {
+            bufferStartNs_ = steadyTimeNs();
+        }
+
+        const size_t bytesToCopy = std::min(numBytes, blockBytes_ - bufferValidBytes_);
+        memcpy(buffer_.get() + bufferValidBytes_, bytes, bytesToCopy);
+        bufferValidBytes_ += bytesToCopy;
+        bytes += bytesToCopy;
+        numBytes -= bytesToCopy;
+
+        if (bufferValidBytes_ == blockBytes_)
+        {
+            flush();
+        }
+    }
+}
+
+void BlockFileWriter::flush()
+{
+    if ((file_ == nullptr) || (bufferValidBytes_ == 0))
+    {
+        return;
+    }
+
+    const int64_t submitNs = (latencyTracker_ != nullptr)? steadyTimeNs() : 0;
+    if (std::fwrite(buffer_.get(), 1, bufferValidBytes_, file_) != bufferValidBytes_)
+    {
+        hasError_ = true;
+    }
+    if (latencyTracker_ != nullptr)
+    {
+        latencyTracker_->record(LatencyTracker::STAGE_BUFFERED_TO_SUBMITTED, submitNs - bufferStartNs_);
+        latencyTracker_->record(LatencyTracker::STAGE_SUBMITTED_TO_WRITTEN, steadyTimeNs() - submitNs);
+    }
+
+    flushedBytes_ += bufferValidBytes_;
+    bufferValidBytes_ = 0;
+}
+
+bool BlockFileWriter::preallocate(uint64_t numBytes)
+{
+    if (file_ == nullptr)
+    {
+        return false;
+    }
+
+#ifdef __linux__
+    return fallocate(fileno(file_), FALLOC_FL_KEEP_SIZE, static_cast<off_t>(fileOffset()), static_cast<off_t>(numBytes)) == 0;
+#else
+    (void)numBytes;
+    return false;
+#endif
+}
@@ -0,0 +1,73 @@
+#ifndef BLOCKFILEWRITER_H
+#define BLOCKFILEWRITER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+
+class LatencyTracker;
+
+
+/// Sequential file writer that collects data in a large aligned buffer and writes it in whole blocks
+class BlockFileWriter
+{
+public:
+    static constexpr size_t DEFAULT_BLOCK_BYTES = 4 * 1024 * 1024;
+    static constexpr size_t BLOCK_ALIGNMENT = 4096;
+
+    explicit BlockFileWriter(size_t blockBytes = DEFAULT_BLOCK_BYTES);
+    ~BlockFileWriter();
+
+    BlockFileWriter(const BlockFileWriter&) = delete;
+    BlockFileWriter& operator=(const BlockFileWriter&) = delete;
+
+    bool open(const std::string& fileName);
+
+    /// Flush and close
+    void close();
+
+    bool isOpen() const {return file_ != nullptr;}
+
+    /// Set when a write to the file failed. The data of the failed block is lost.
+    bool hasError() const {return hasError_;}
+
+    void write(const void* data, size_t numBytes);
+
+    /// Write out the buffered data, even if the block is not full
+    void flush();
+
+    /// Reserve disk space for numBytes from the current position without changing the file size.
+    /// Only supported on Linux, returns false elsewhere or on failure.
+    bool preallocate(uint64_t numBytes);
+
+    /// Block writes are recorded in \p tracker (may be nullptr): the age of the first byte of a block when it is
+    /// written and the duration of the write
+    void setLatencyTracker(LatencyTracker* tracker) {latencyTracker_ = tracker;}
+
+    /// Logical file size, including buffered data
+    uint64_t fileOffset() const {return flushedBytes_ + bufferValidBytes_;}
+
+protected:
+    std::FILE* file() const {return file_;}
+
+private:
+    struct AlignedDeleter
+    {
+        void operator()(uint8_t* ptr) const;
+    };
+
+    std::unique_ptr<uint8_t[], AlignedDeleter> buffer_;
+    size_t blockBytes_;
+    size_t bufferValidBytes_{0};
+
+    std::FILE* file_ = nullptr;
+    uint64_t flushedBytes_{0};
+    bool hasError_{false};
+
+    LatencyTracker* latencyTracker_ = nullptr;
+    int64_t bufferStartNs_{0};          ///< steady_clock time of the first byte in the buffer
+};
+
+#endif // BLOCKFILEWRITER_H
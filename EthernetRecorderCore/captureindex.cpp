@@ -0,0 +1,284 @@
+#include "captureindex.h"
+#include "packetparser.h"
+#include "pcapngformat.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+
+namespace {
+
+constexpr char INDEX_MAGIC[8] = {'E', 'T', 'H', 'R', 'I', 'D', 'X', '1'};
+
+struct IndexFileHeader
+{
+    char magic[8];
+    uint32_t entryBytes;
+    uint32_t reserved;
+    uint64_t frameInterval;
+    uint64_t timeIntervalNs;
+};
+
+constexpr size_t READ_CHUNK_BYTES = 4 * 1024 * 1024;
+
+bool rebuildFromRawStream(std::FILE* capture, CaptureIndexWriter& indexWriter)
+{
+    PacketParser parser;
+    RawStreamIndexer indexer(parser, indexWriter);
+    parser.setSink(&indexer);
+
+    auto buffer = std::make_unique<uint8_t[]>(READ_CHUNK_BYTES);
+    size_t numBytes;
+    while ((numBytes = std::fread(buffer.get(), 1, READ_CHUNK_BYTES, capture)) > 0)
+    {
+        parser.parseRawStream(buffer.get(), numBytes);
+    }
+    parser.finish();
+
+    return std::ferror(capture) == 0;
+}
+
+bool rebuildFromPcapng(std::FILE* capture, CaptureIndexWriter& indexWriter)
+{
+    std::vector<pcapng::Interface> interfaces;
+    std::vector<uint8_t> block;
+    uint64_t fileOffset = 0;
+
+    uint32_t blockHeader[2];
+    while (std::fread(blockHeader, sizeof(blockHeader), 1, capture) == 1)
+    {
+        const uint32_t blockType = blockHeader[0];
+        const uint32_t blockLength = blockHeader[1];
+        if ((blockLength < 12) || (blockLength % 4 != 0))
+        {
+            return false;
+        }
+
+        if (blockType == pcapng::BLOCK_TYPE_SHB)
+        {
+            interfaces.clear();
+        }
+
+        if ((blockType == pcapng::BLOCK_TYPE_IDB) || (blockType == pcapng::BLOCK_TYPE_EPB))
+        {
+            // Only the IDB options and the EPB timestamp are needed
+            const size_t bytesToRead = (blockType == pcapng::BLOCK_TYPE_IDB)? (blockLength - sizeof(blockHeader)) : 12;
+            if (blockLength < sizeof(blockHeader) + bytesToRead)
+            {
+                return false;
+            }
+            block.resize(sizeof(blockHeader) + bytesToRead);
+            memcpy(block.data(), blockHeader, sizeof(blockHeader));
+            if (std::fread(block.data() + sizeof(blockHeader), 1, bytesToRead, capture) != bytesToRead)
+            {
+                return false;
+            }
+
+            if (blockType == pcapng::BLOCK_TYPE_IDB)
+            {
+                const auto interfaceId = static_cast<uint32_t>(interfaces.size());
+                interfaces.push_back(pcapng::parseInterface(block.data(), static_cast<uint32_t>(block.size()), interfaceId));
+            }
+            else
+            {
+                uint32_t fields[3];
+                memcpy(fields, block.data() + sizeof(blockHeader), sizeof(fields));
+                const uint32_t interfaceId = fields[0];
+                const uint64_t ticks = (static_cast<uint64_t>(fields[1]) << 32) | fields[2];
+                const uint64_t factor = (interfaceId < interfaces.size())? interfaces[interfaceId].nanosecondsPerTick : 1000;
+                indexWriter.addFrame(ticks * factor, fileOffset);
+            }
+
+            if (std::fseek(capture, static_cast<long>(blockLength - block.size()), SEEK_CUR) != 0)
+            {
+                return false;
+            }
+        }
+        else if (std::fseek(capture, static_cast<long>(blockLength - sizeof(blockHeader)), SEEK_CUR) != 0)
+        {
+            return false;
+        }
+
+        fileOffset += blockLength;
+    }
+
+    return std::ferror(capture) == 0;
+}
+
+}   // anonymous namespace
+
+
+CaptureIndexWriter::CaptureIndexWriter(uint64_t frameInterval, uint64_t timeIntervalNs)
+    : frameInterval_(std::max<uint64_t>(frameInterval, 1))
+    , timeIntervalNs_(timeIntervalNs)
+{
+}
+
+CaptureIndexWriter::~CaptureIndexWriter()
+{
+    close();
+}
+
+bool CaptureIndexWriter::open(const std::string& fileName)
+{
+    close();
+
+    file_ = std::fopen(fileName.c_str(), "wb");
+    if (file_ == nullptr)
+    {
+        return false;
+    }
+
+    hasError_ = false;
+    numFrames_ = 0;
+    maxTimestamp_ = 0;
+
+    IndexFileHeader header = {};
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.entryBytes = sizeof(CaptureIndexEntry);
+    header.frameInterval = frameInterval_;
+    header.timeIntervalNs = timeIntervalNs_;
+    write(&header, sizeof(header));
+
+    return true;
+}
+
+void CaptureIndexWriter::close()
+{
+    if (file_ != nullptr)
+    {
+        if (std::fclose(file_) != 0)
+        {
+            hasError_ = true;
+        }
+        file_ = nullptr;
+    }
+}
+
+void CaptureIndexWriter::addFrame(uint64_t timestamp, uint64_t fileOffset)
+{
+    if (file_ == nullptr)
+    {
+        return;
+    }
+
+    maxTimestamp_ = std::max(maxTimestamp_, timestamp);
+
+    const bool isFirst = (numFrames_ == 0);
+    const bool isRecordStart = isFirst || (fileOffset != lastFileOffset_);
+    lastFileOffset_ = fileOffset;
+    if (isRecordStart && (isFirst || (numFrames_ - lastEntryFrame_ >= frameInterval_) || ((timeIntervalNs_ > 0) && (maxTimestamp_ - lastEntryTime_ >= timeIntervalNs_))))
+    {
+        const CaptureIndexEntry entry = {maxTimestamp_, numFrames_, fileOffset};
+        write(&entry, sizeof(entry));
+
+        lastEntryFrame_ = numFrames_;
+        lastEntryTime_ = maxTimestamp_;
+    }
+
+    ++numFrames_;
+}
+
+void CaptureIndexWriter::write(const void* data, size_t numBytes)
+{
+    if (std::fwrite(data, 1, numBytes, file_) != numBytes)
+    {
+        hasError_ = true;
+    }
+}
+
+
+RawStreamIndexer::RawStreamIndexer(const PacketParser& parser, CaptureIndexWriter& indexWriter)
+    : parser_(parser)
+    , indexWriter_(indexWriter)
+{
+}
+
+void RawStreamIndexer::processPacket(const EthRecHeader& header, const uint8_t* /*data*/)
+{
+    indexWriter_.addFrame(header.timestamp, parser_.packetOffset());
+}
+
+
+bool CaptureIndex::load(const std::string& fileName)
+{
+    entries_.clear();
+
+    std::FILE* file = std::fopen(fileName.c_str(), "rb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    IndexFileHeader header;
+    bool isValid = (std::fread(&header, sizeof(header), 1, file) == 1)
+                   && (memcmp(header.magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) == 0)
+                   && (header.entryBytes == sizeof(CaptureIndexEntry));
+    if (isValid)
+    {
+        CaptureIndexEntry entry;
+        while (std::fread(&entry, sizeof(entry), 1, file) == 1)
+        {
+            entries_.push_back(entry);
+        }
+        isValid = (std::ferror(file) == 0);
+    }
+
+    std::fclose(file);
+    return isValid;
+}
+
+bool CaptureIndex::rebuild(const std::string& captureFileName, const std::string& indexFileName)
+{
+    std::FILE* capture = std::fopen(captureFileName.c_str(), "rb");
+    if (capture == nullptr)
+    {
+        return false;
+    }
+
+    CaptureIndexWriter indexWriter;
+    if (!indexWriter.open(indexFileName))
+    {
+        std::fclose(capture);
+        return false;
+    }
+
+    // Format by the first word
+    uint32_t magic = 0;
+    const bool isPcapng = (std::fread(&magic, sizeof(magic), 1, capture) == 1) && (magic == pcapng::BLOCK_TYPE_SHB);
+    std::rewind(capture);
+
+    bool isOk = isPcapng? rebuildFromPcapng(capture, indexWriter) : rebuildFromRawStream(capture, indexWriter);
+
+    std::fclose(capture);
+    indexWriter.close();
+    return isOk && !indexWriter.hasError();
+}
+
+const CaptureIndexEntry* CaptureIndex::seekTime(uint64_t timestamp) const
+{
+    if (entries_.empty())
+    {
+        return nullptr;
+    }
+
+    // Entry timestamps are running maxima, hence sorted. Everything up to the last entry below t is below t.
+    auto it = std::lower_bound(entries_.begin(), entries_.end(), timestamp, [](const CaptureIndexEntry& entry, uint64_t t){
+        return entry.timestamp < t;
+    });
+    return (it == entries_.begin())? &entries_.front() : &*(it - 1);
+}
+
+const CaptureIndexEntry* CaptureIndex::seekFrame(uint64_t frameNumber) const
+{
+    if (entries_.empty())
+    {
+        return nullptr;
+    }
+
+    auto it = std::upper_bound(entries_.begin(), entries_.end(), frameNumber, [](uint64_t n, const CaptureIndexEntry& entry){
+        return n < entry.frameNumber;
+    });
+    return (it == entries_.begin())? &entries_.front() : &*(it - 1);
+}
@@ -0,0 +1,104 @@
+#ifndef CAPTUREINDEX_H
+#define CAPTUREINDEX_H
+
+#include "packetsink.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+class PacketParser;
+
+
+/// Sidecar index of a capture file (<capture>.idx): one entry every K frames or every M nanoseconds.
+/// File layout (little-endian): 8-byte magic, uint32 entry size, uint32 reserved, uint64 frame interval,
+/// uint64 time interval, then the entries.
+struct CaptureIndexEntry
+{
+    uint64_t timestamp;         ///< Largest EthRecHeader::timestamp up to and including this frame
+    uint64_t frameNumber;       ///< Zero-based
+    uint64_t fileOffset;        ///< Start of the frame record (pcapng block or EthRecHeader), never inside a batch
+};
+
+
+class CaptureIndexWriter
+{
+public:
+    static constexpr uint64_t DEFAULT_FRAME_INTERVAL = 1000;
+    static constexpr uint64_t DEFAULT_TIME_INTERVAL_NS = 100000000;
+
+    explicit CaptureIndexWriter(uint64_t frameInterval = DEFAULT_FRAME_INTERVAL, uint64_t timeIntervalNs = DEFAULT_TIME_INTERVAL_NS);
+    ~CaptureIndexWriter();
+
+    CaptureIndexWriter(const CaptureIndexWriter&) = delete;
+    CaptureIndexWriter& operator=(const CaptureIndexWriter&) = delete;
+
+    static std::string indexFileName(const std::string& captureFileName) {return captureFileName + ".idx";}
+
+    bool open(const std::string& fileName);
+
+    void close();
+
+    bool isOpen() const {return file_ != nullptr;}
+
+    bool hasError() const {return hasError_;}
+
+    /// To be called for every frame, in file order. Frames of one batch record share its offset; entries only
+    /// go to the first frame of a record, so that parsing from an entry starts with its frame.
+    void addFrame(uint64_t timestamp, uint64_t fileOffset);
+
+private:
+    void write(const void* data, size_t numBytes);
+
+    uint64_t frameInterval_;
+    uint64_t timeIntervalNs_;
+
+    std::FILE* file_ = nullptr;
+    bool hasError_{false};
+
+    uint64_t numFrames_{0};
+    uint64_t maxTimestamp_{0};
+    uint64_t lastEntryFrame_{0};
+    uint64_t lastEntryTime_{0};
+    uint64_t lastFileOffset_{0};
+};
+
+
+/// Indexes a raw stream file (RawStreamWriter) while it is parsed: file offsets are stream offsets
+class RawStreamIndexer : public PacketSink
+{
+public:
+    RawStreamIndexer(const PacketParser& parser, CaptureIndexWriter& indexWriter);
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+private:
+    const PacketParser& parser_;
+    CaptureIndexWriter& indexWriter_;
+};
+
+
+/// Loaded index with O(log n) lookups
+class CaptureIndex
+{
+public:
+    bool load(const std::string& fileName);
+
+    /// Scan a raw stream or pcapng capture and write its index
+    static bool rebuild(const std::string& captureFileName, const std::string& indexFileName);
+
+    const std::vector<CaptureIndexEntry>& entries() const {return entries_;}
+
+    /// Entry to start scanning from to find the first frame with timestamp >= t. No frame before the
+    /// returned entry has a timestamp >= t. Returns nullptr if the index is empty.
+    const CaptureIndexEntry* seekTime(uint64_t timestamp) const;
+
+    /// Last entry at or before the frame. Returns nullptr if the index is empty.
+    const CaptureIndexEntry* seekFrame(uint64_t frameNumber) const;
+
+private:
+    std::vector<CaptureIndexEntry> entries_;
+};
+
+#endif // CAPTUREINDEX_H
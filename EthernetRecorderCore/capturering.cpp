@@ -0,0 +1,190 @@
+#include "capturering.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+CaptureRing::CaptureRing(size_t capacityBytes, uint64_t maxAgeNs)
+    : capacityBytes_(capacityBytes & ~(RECORD_ALIGNMENT - 1))
+    , maxAgeNs_(maxAgeNs)
+{
+    if (capacityBytes_ < sizeof(RecordHeader) + ETH_REC_MAX_PACKET_BYTES)
+    {
+        throw std::invalid_argument("CaptureRing::CaptureRing(): Capacity too small");
+    }
+
+    buffer_ = std::make_unique<uint8_t[]>(capacityBytes_);
+    dumpWriter_.setPacketSource(this);
+}
+
+void CaptureRing::setTriggerWindow(uint64_t preTriggerNs, uint64_t postTriggerNs)
+{
+    preTriggerNs_ = preTriggerNs;
+    postTriggerNs_ = postTriggerNs;
+}
+
+void CaptureRing::processPacket(const EthRecHeader& header, const uint8_t* data)
+{
+    const uint16_t originalBytes = (source_ != nullptr)? source_->originalBytes() : 0;
+    store(header, originalBytes, data);
+
+    if (dumpWriter_.isOpen())
+    {
+        if (header.timestamp > dumpEndTime_)
+        {
+            finishDump();
+        }
+        else
+        {
+            writeToDump(header, originalBytes, data);
+        }
+    }
+
+    bool isTriggered = isTriggerRequested_.exchange(false, std::memory_order_relaxed);
+    if (triggerFilter_ && triggerFilter_(header, data))
+    {
+        isTriggered = true;
+    }
+
+    if (isTriggered)
+    {
+        if (dumpWriter_.isOpen())
+        {
+            // Triggered again while dumping: extend the window
+            dumpEndTime_ = std::max(dumpEndTime_, header.timestamp + postTriggerNs_);
+        }
+        else
+        {
+            startDump(header.timestamp);
+        }
+    }
+}
+
+void CaptureRing::store(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data)
+{
+    const size_t recordBytes = (sizeof(RecordHeader) + header.numBytes + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
+    if (recordBytes > capacityBytes_)
+    {
+        return;
+    }
+
+    // Age limit, in device time
+    while ((maxAgeNs_ > 0) && (numRecords_ > 0) && (recordAt(tail_)->header.timestamp + maxAgeNs_ < header.timestamp))
+    {
+        popOldest();
+    }
+
+    while (!reserveAtHead(recordBytes))
+    {
+        popOldest();
+    }
+
+    auto record = reinterpret_cast<RecordHeader*>(buffer_.get() + head_);
+    record->recordBytes = static_cast<uint32_t>(recordBytes);
+    record->originalBytes = originalBytes;
+    record->header = header;
+    memcpy(record + 1, data, header.numBytes);
+
+    head_ += recordBytes;
+    usedBytes_ += recordBytes;
+    ++numRecords_;
+}
+
+bool CaptureRing::reserveAtHead(size_t recordBytes)
+{
+    if (numRecords_ == 0)
+    {
+        head_ = 0;
+        tail_ = 0;
+        isWrapped_ = false;
+        return true;
+    }
+
+    if (isWrapped_)
+    {
+        return (tail_ - head_ >= recordBytes);
+    }
+
+    if (capacityBytes_ - head_ >= recordBytes)
+    {
+        return true;
+    }
+
+    if (tail_ >= recordBytes)
+    {
+        // Leave the rest of the buffer unused and continue at the start
+        wrapOffset_ = head_;
+        head_ = 0;
+        isWrapped_ = true;
+        return true;
+    }
+
+    return false;
+}
+
+void CaptureRing::popOldest()
+{
+    const size_t recordBytes = recordAt(tail_)->recordBytes;
+    tail_ += recordBytes;
+    usedBytes_ -= recordBytes;
+    --numRecords_;
+
+    if (isWrapped_ && (tail_ == wrapOffset_))
+    {
+        tail_ = 0;
+        isWrapped_ = false;
+    }
+}
+
+void CaptureRing::startDump(uint64_t triggerTime)
+{
+    const auto fileName = dumpFilePrefix_ + "-" + std::to_string(writtenDumps_.load(std::memory_order_relaxed) + 1) + ".pcapng";
+    if (!dumpWriter_.open(fileName))
+    {
+        hasDumpError_.store(true, std::memory_order_relaxed);
+        return;
+    }
+    dumpEndTime_ = triggerTime + postTriggerNs_;
+
+    // Pre-trigger window from the ring, including the triggering packet
+    const uint64_t startTime = (triggerTime > preTriggerNs_)? (triggerTime - preTriggerNs_) : 0;
+    size_t offset = tail_;
+    bool isWrapped = isWrapped_;
+    for (size_t k = 0; k < numRecords_; ++k)
+    {
+        if (isWrapped && (offset == wrapOffset_))
+        {
+            offset = 0;
+            isWrapped = false;
+        }
+
+        const auto record = recordAt(offset);
+        if (record->header.timestamp >= startTime)
+        {
+            writeToDump(record->header, static_cast<uint16_t>(record->originalBytes), reinterpret_cast<const uint8_t*>(record + 1));
+        }
+        offset += record->recordBytes;
+    }
+}
+
+void CaptureRing::writeToDump(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data)
+{
+    dumpOriginalBytes_ = originalBytes;
+    dumpWriter_.processPacket(header, data);
+}
+
+void CaptureRing::finishDump()
+{
+    if (!dumpWriter_.isOpen())
+    {
+        return;
+    }
+
+    dumpWriter_.close();
+    if (dumpWriter_.hasError())
+    {
+        hasDumpError_.store(true, std::memory_order_relaxed);
+    }
+    writtenDumps_.fetch_add(1, std::memory_order_relaxed);
+}
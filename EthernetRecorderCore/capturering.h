@@ -0,0 +1,106 @@
+#ifndef CAPTURERING_H
+#define CAPTURERING_H
+
+#include "packetsink.h"
+#include "pcapngwriter.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+
+/// Rolling capture: keeps the most recent packets in a preallocated in-memory ring, limited by size and by age,
+/// and writes a pre/post window around a trigger to a pcapng file.
+/// All methods except trigger() and the atomic counters must be called on the thread that feeds the packets.
+class CaptureRing : public PacketSink, public PacketSource
+{
+public:
+    using TriggerFilter = std::function<bool(const EthRecHeader& header, const uint8_t* data)>;
+
+    /// maxAgeNs = 0: limited by capacity only
+    explicit CaptureRing(size_t capacityBytes, uint64_t maxAgeNs = 0);
+
+    /// Original lengths are taken from \p source (may be nullptr) and kept with the packets for the dumps, see
+    /// PcapngWriter::setPacketSource()
+    void setPacketSource(const PacketSource* source) {source_ = source;}
+
+    /// Dumps are written to <prefix>-<n>.pcapng
+    void setDumpFilePrefix(const std::string& prefix) {dumpFilePrefix_ = prefix;}
+
+    /// Window around the trigger time (device time) to write
+    void setTriggerWindow(uint64_t preTriggerNs, uint64_t postTriggerNs);
+
+    /// Trigger on every packet the filter accepts (e.g. a particular EtherType)
+    void setTriggerFilter(TriggerFilter filter) {triggerFilter_ = std::move(filter);}
+
+    /// Request a dump around the most recent packet. Safe to call from any thread (GUI button, signal handler).
+    void trigger() {isTriggerRequested_.store(true, std::memory_order_relaxed);}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+    /// Original length of the packet being written to a dump
+    uint16_t originalBytes() const override {return dumpOriginalBytes_;}
+
+    /// Finish a dump in progress without waiting for the post-trigger window
+    void finishDump();
+
+    size_t bufferedPackets() const {return numRecords_;}
+
+    size_t bufferedBytes() const {return usedBytes_;}
+
+    /// Safe to call from any thread
+    size_t writtenDumps() const {return writtenDumps_.load(std::memory_order_relaxed);}
+
+    /// Safe to call from any thread
+    bool hasDumpError() const {return hasDumpError_.load(std::memory_order_relaxed);}
+
+private:
+    struct RecordHeader
+    {
+        uint32_t recordBytes;       ///< Including this header and padding
+        uint32_t originalBytes;     ///< On the wire, 0: as stored
+        EthRecHeader header;
+    };
+
+    static constexpr size_t RECORD_ALIGNMENT = 8;
+
+    const RecordHeader* recordAt(size_t offset) const {return reinterpret_cast<const RecordHeader*>(buffer_.get() + offset);}
+
+    void store(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data);
+
+    bool reserveAtHead(size_t recordBytes);
+
+    void popOldest();
+
+    void startDump(uint64_t triggerTime);
+
+    void writeToDump(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data);
+
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t capacityBytes_;
+    uint64_t maxAgeNs_;
+    const PacketSource* source_ = nullptr;
+
+    // Records live in [tail_, head_) or, once wrapped, in [tail_, wrapOffset_) followed by [0, head_)
+    size_t head_{0};
+    size_t tail_{0};
+    size_t wrapOffset_{0};
+    bool isWrapped_{false};
+    size_t numRecords_{0};
+    size_t usedBytes_{0};
+
+    std::string dumpFilePrefix_{"trigger"};
+    uint64_t preTriggerNs_{10000000000ULL};
+    uint64_t postTriggerNs_{5000000000ULL};
+    TriggerFilter triggerFilter_;
+    std::atomic<bool> isTriggerRequested_{false};
+
+    PcapngWriter dumpWriter_;
+    uint16_t dumpOriginalBytes_{0};
+    uint64_t dumpEndTime_{0};
+    std::atomic<size_t> writtenDumps_{0};
+    std::atomic<bool> hasDumpError_{false};
+};
+
+#endif // CAPTURERING_H
@@ -0,0 +1,393 @@
+#include "capturescanner.h"
+#include "packetparser.h"
+#include "streamformat.h"
+#include "syncscan.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+
+namespace {
+
+/// Resolution assumed for packets on interfaces whose description was not seen (PcapngWriter default)
+constexpr uint64_t FALLBACK_NANOSECONDS_PER_TICK = 1;
+
+uint32_t read32(const uint8_t* data)
+{
+    uint32_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+}   // anonymous namespace
+
+
+CaptureScanStats& CaptureScanStats::operator+=(const CaptureScanStats& next)
+{
+    receivedPackets += next.receivedPackets;
+    errorBytes += next.errorBytes;
+    rejectedHeaders += next.rejectedHeaders;
+    lostFrames += next.lostFrames;
+    telemetry.insert(telemetry.end(), next.telemetry.begin(), next.telemetry.end());
+
+    for (size_t k = 0; k < sequenceRanges.size(); ++k)
+    {
+        auto& range = sequenceRanges[k];
+        const auto& nextRange = next.sequenceRanges[k];
+        if (!nextRange.isValid)
+        {
+            continue;
+        }
+
+        if (!range.isValid)
+        {
+            range = nextRange;
+            continue;
+        }
+
+        // Frames lost right at the chunk boundary. Going backwards is a device restart, as in the parser.
+        const uint32_t difference = nextRange.firstSequence - range.nextSequence;
+        if (difference < 0x80000000U)
+        {
+            lostFrames += difference;
+        }
+        range.nextSequence = nextRange.nextSequence;
+    }
+
+    return *this;
+}
+
+
+CaptureScanner::CaptureScanner(size_t numThreads, size_t chunkBytes)
+    : numThreads_(numThreads)
+    , chunkBytes_(chunkBytes)
+{
+    if (chunkBytes_ == 0)
+    {
+        throw std::invalid_argument("CaptureScanner::CaptureScanner(): Invalid chunk size");
+    }
+
+    if (numThreads_ == 0)
+    {
+        numThreads_ = std::max(1U, std::thread::hardware_concurrency());
+    }
+}
+
+bool CaptureScanner::open(const std::string& fileName)
+{
+    close();
+
+    if (!file_.open(fileName))
+    {
+        return false;
+    }
+
+    const uint8_t* data = file_.data();
+    const uint64_t numBytes = file_.size();
+    format_ = ((numBytes >= sizeof(uint32_t)) && (read32(data) == pcapng::BLOCK_TYPE_SHB))? FORMAT_PCAPNG : FORMAT_RAW_STREAM;
+
+    // Interface descriptions ahead of the first packet apply to all chunks. Later ones only to the rest of their chunk.
+    if (format_ == FORMAT_PCAPNG)
+    {
+        uint64_t offset = 0;
+        uint32_t blockLength;
+        while ((blockLength = pcapng::blockLength(data, numBytes, offset)) > 0)
+        {
+            const uint32_t blockType = read32(data + offset);
+            if (blockType == pcapng::BLOCK_TYPE_EPB)
+            {
+                break;
+            }
+
+            if (blockType == pcapng::BLOCK_TYPE_SHB)
+            {
+                interfaces_.clear();
+            }
+            else if (blockType == pcapng::BLOCK_TYPE_IDB)
+            {
+                const auto interfaceId = static_cast<uint32_t>(interfaces_.size());
+                interfaces_.push_back(pcapng::parseInterface(data + offset, blockLength, interfaceId));
+            }
+            offset += blockLength;
+        }
+    }
+
+    return true;
+}
+
+void CaptureScanner::close()
+{
+    file_.close();
+    interfaces_.clear();
+}
+
+CaptureScanStats CaptureScanner::scan(const ChunkSinkFactory& createChunkSink, const ChunkMerger& mergeChunk)
+{
+    CaptureScanStats totalStats;
+    if (!file_.isOpen())
+    {
+        return totalStats;
+    }
+
+    struct ChunkResult
+    {
+        std::unique_ptr<PacketSink> sink;
+        CaptureScanStats stats;
+    };
+
+    const size_t numChunks = static_cast<size_t>((file_.size() + chunkBytes_ - 1) / chunkBytes_);
+    const size_t maxChunksAhead = 2 * numThreads_;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::map<size_t, ChunkResult> finishedChunks;
+    size_t nextChunkIdx = 0;
+    size_t nextMergeIdx = 0;
+
+    auto worker = [&]()
+    {
+        while (true)
+        {
+            size_t chunkIdx;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&](){return (nextChunkIdx >= numChunks) || (nextChunkIdx < nextMergeIdx + maxChunksAhead);});
+                if (nextChunkIdx >= numChunks)
+                {
+                    return;
+                }
+                chunkIdx = nextChunkIdx++;
+            }
+
+            ChunkResult result;
+            result.sink = createChunkSink();
+
+            const uint64_t begin = chunkStart(chunkIdx);
+            const uint64_t end = chunkStart(chunkIdx + 1);
+            if (format_ == FORMAT_PCAPNG)
+            {
+                scanPcapng(begin, end, *result.sink, result.stats);
+            }
+            else
+            {
+                scanRawStream(begin, end, *result.sink, result.stats);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                finishedChunks.emplace(chunkIdx, std::move(result));
+            }
+            condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t k = 0; k < std::min(numThreads_, numChunks); ++k)
+    {
+        threads.emplace_back(worker);
+    }
+
+    for (size_t chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx)
+    {
+        ChunkResult result;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&](){return finishedChunks.count(chunkIdx) > 0;});
+            auto it = finishedChunks.find(chunkIdx);
+            result = std::move(it->second);
+            finishedChunks.erase(it);
+        }
+
+        mergeChunk(*result.sink);
+        totalStats += result.stats;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            nextMergeIdx = chunkIdx + 1;
+        }
+        condition.notify_all();
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+
+    return totalStats;
+}
+
+uint64_t CaptureScanner::chunkStart(size_t chunkIdx) const
+{
+    const uint64_t offset = static_cast<uint64_t>(chunkIdx) * chunkBytes_;
+    if (chunkIdx == 0)
+    {
+        return 0;
+    }
+    if (offset >= file_.size())
+    {
+        return file_.size();
+    }
+
+    return (format_ == FORMAT_PCAPNG)? alignPcapng(offset) : alignRawStream(offset);
+}
+
+uint64_t CaptureScanner::alignRawStream(uint64_t offset) const
+{
+    const uint8_t* data = file_.data();
+    const uint64_t numBytes = file_.size();
+
+    while (offset + streamformat::SYNC_WORD_BYTES <= numBytes)
+    {
+        offset += findSyncWord(data + offset, static_cast<size_t>(std::min<uint64_t>(numBytes - offset, SIZE_MAX)));
+        const size_t headerBytes = (offset + streamformat::SYNC_WORD_BYTES <= numBytes)? streamformat::headerBytes(read32(data + offset)) : 0;
+        if ((headerBytes == 0) || (offset + headerBytes > numBytes))
+        {
+            break;
+        }
+
+        // Same checks as the parser: CRC (v2), sizes in range, and the next record starts with a sync word (or the
+        // file ends). A v2 record cut short by the end of the file passes on its CRC.
+        streamformat::Header header;
+        if (streamformat::decodeHeader(data + offset, header) && streamformat::isHeaderInRange(header))
+        {
+            const uint64_t nextOffset = offset + headerBytes + header.header.numBytes;
+            const bool isNextBuffered = (nextOffset + sizeof(uint32_t) <= numBytes);
+            if ((nextOffset == numBytes) || (isNextBuffered && streamformat::isSyncWord(read32(data + nextOffset)))
+                || (!isNextBuffered && (header.version >= 2)))
+            {
+                return offset;
+            }
+        }
+
+        ++offset;
+    }
+
+    return numBytes;
+}
+
+uint64_t CaptureScanner::alignPcapng(uint64_t offset) const
+{
+    const uint8_t* data = file_.data();
+    const uint64_t numBytes = file_.size();
+
+    // Blocks are 32-bit aligned. Look for a packet block whose lengths agree, followed by another valid block.
+    for (offset = (offset + 3) & ~3ULL; offset < numBytes; offset += 4)
+    {
+        const uint32_t blockLength = pcapng::blockLength(data, numBytes, offset);
+        if ((blockLength < pcapng::EPB_HEADER_BYTES + 4) || (read32(data + offset) != pcapng::BLOCK_TYPE_EPB))
+        {
+            continue;
+        }
+
+        const uint32_t capturedBytes = read32(data + offset + 20);
+        const uint64_t nextOffset = offset + blockLength;
+        if ((capturedBytes <= blockLength - pcapng::EPB_HEADER_BYTES - 4)
+            && ((nextOffset == numBytes) || (pcapng::blockLength(data, numBytes, nextOffset) > 0)))
+        {
+            return offset;
+        }
+    }
+
+    return numBytes;
+}
+
+void CaptureScanner::scanRawStream(uint64_t begin, uint64_t end, PacketSink& sink, CaptureScanStats& stats) const
+{
+    PacketParser parser;
+    parser.setSink(&sink);
+    parser.setTelemetryCallback([&stats, begin](const DeviceTelemetry& telemetry){
+        stats.telemetry.push_back(telemetry);
+        stats.telemetry.back().streamOffset += begin;
+    });
+
+    // Whole frames only, so every packet is delivered straight from the mapping. The rest of the file is the
+    // lookahead, so that the last record of the chunk is checked against the sync word after it whatever the chunk
+    // size, and nothing needs to be held back.
+    parser.setEndOfStream(true);
+    const uint8_t* data = file_.data() + begin;
+    uint64_t numBytes = end - begin;
+    while (numBytes > 0)
+    {
+        const size_t partBytes = static_cast<size_t>(std::min<uint64_t>(numBytes, SIZE_MAX));
+        const uint64_t lookaheadBytes = file_.size() - (static_cast<uint64_t>(data - file_.data()) + partBytes);
+        parser.parseRawStream(data, partBytes, static_cast<size_t>(std::min<uint64_t>(lookaheadBytes, SIZE_MAX)));
+        data += partBytes;
+        numBytes -= partBytes;
+    }
+    parser.finish();
+
+    stats.receivedPackets = parser.receivedPackets();
+    stats.errorBytes = parser.errorBytes();
+    stats.rejectedHeaders = parser.rejectedHeaders();
+    stats.lostFrames = parser.lostFrames();
+    for (uint16_t networkInterface = 0; networkInterface < ETH_REC_MAX_NETWORK_INTERFACES; ++networkInterface)
+    {
+        auto& range = stats.sequenceRanges[networkInterface];
+        range.isValid = parser.sequenceRange(networkInterface, range.firstSequence, range.nextSequence);
+    }
+}
+
+void CaptureScanner::scanPcapng(uint64_t begin, uint64_t end, PacketSink& sink, CaptureScanStats& stats) const
+{
+    const uint8_t* data = file_.data();
+    const uint64_t numBytes = file_.size();
+
+    std::vector<pcapng::Interface> interfaces;
+    if (begin > 0)
+    {
+        interfaces = interfaces_;
+    }
+
+    uint64_t offset = begin;
+    while (offset < end)
+    {
+        const uint32_t blockLength = pcapng::blockLength(data, numBytes, offset);
+        if (blockLength == 0)
+        {
+            const uint64_t nextOffset = std::min(alignPcapng(offset + 4), end);
+            stats.errorBytes += nextOffset - offset;
+            ++stats.rejectedHeaders;
+            offset = nextOffset;
+            continue;
+        }
+
+        const uint8_t* block = data + offset;
+        const uint32_t blockType = read32(block);
+        if (blockType == pcapng::BLOCK_TYPE_SHB)
+        {
+            interfaces.clear();
+        }
+        else if (blockType == pcapng::BLOCK_TYPE_IDB)
+        {
+            const auto interfaceId = static_cast<uint32_t>(interfaces.size());
+            interfaces.push_back(pcapng::parseInterface(block, blockLength, interfaceId));
+        }
+        else if ((blockType == pcapng::BLOCK_TYPE_EPB) && (blockLength >= pcapng::EPB_HEADER_BYTES + 4))
+        {
+            const uint32_t interfaceId = read32(block + 8);
+            const uint64_t ticks = (static_cast<uint64_t>(read32(block + 12)) << 32) | read32(block + 16);
+            const uint32_t capturedBytes = std::min(read32(block + 20), blockLength - pcapng::EPB_HEADER_BYTES - 4);
+
+            EthRecHeader header;
+            header.syncWord = ETH_REC_SYNC_WORD;
+            header.networkInterface = static_cast<uint16_t>(interfaceId);
+            header.numBytes = static_cast<uint16_t>(std::min<uint32_t>(capturedBytes, UINT16_MAX));
+            header.timestamp = ticks * FALLBACK_NANOSECONDS_PER_TICK;
+            if (interfaceId < interfaces.size())
+            {
+                header.networkInterface = interfaces[interfaceId].networkInterface;
+                header.timestamp = ticks * interfaces[interfaceId].nanosecondsPerTick;
+            }
+
+            sink.processPacket(header, block + pcapng::EPB_HEADER_BYTES);
+            ++stats.receivedPackets;
+        }
+
+        offset += blockLength;
+    }
+}
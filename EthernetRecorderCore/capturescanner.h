@@ -0,0 +1,128 @@
+#ifndef CAPTURESCANNER_H
+#define CAPTURESCANNER_H
+
+#include "mappedfile.h"
+#include "packetparser.h"
+#include "pcapngformat.h"
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+struct CaptureScanStats
+{
+    uint64_t receivedPackets{0};
+    uint64_t errorBytes{0};
+    uint64_t rejectedHeaders{0};
+    uint64_t lostFrames{0};             ///< Sequence gaps (protocol v2), including the ones across chunk boundaries
+
+    struct SequenceRange
+    {
+        bool isValid{false};
+        uint32_t firstSequence{0};
+        uint32_t nextSequence{0};
+    };
+    std::array<SequenceRange, ETH_REC_MAX_NETWORK_INTERFACES> sequenceRanges;
+
+    std::vector<DeviceTelemetry> telemetry;     ///< Telemetry records of a raw stream, in file order
+
+    /// Append the stats of the following chunk
+    CaptureScanStats& operator+=(const CaptureScanStats& next);
+};
+
+
+/// Offline reader for raw stream and pcapng captures. The file is memory-mapped and split into chunks that are
+/// parsed in parallel. Chunk boundaries are moved forward to the next frame that passes the header checks
+/// (sync word, sizes, the header CRC and the following frame's sync word; the block lengths for pcapng), so
+/// every frame belongs to exactly one chunk. The parser of a raw stream chunk checks its last record against the
+/// bytes after the chunk, so the results do not depend on the chunk size.
+///
+/// Frame data passed to the sinks points into the mapping and stays valid until close().
+class CaptureScanner
+{
+public:
+    enum Format
+    {
+        FORMAT_RAW_STREAM,
+        FORMAT_PCAPNG,
+    };
+
+    static constexpr size_t DEFAULT_CHUNK_BYTES = 64 * 1024 * 1024;
+
+    /// \p numThreads 0: one per core
+    explicit CaptureScanner(size_t numThreads = 0, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+
+    bool open(const std::string& fileName);
+
+    void close();
+
+    bool isOpen() const {return file_.isOpen();}
+
+    Format format() const {return format_;}
+
+    uint64_t fileBytes() const {return file_.size();}
+
+    size_t numThreads() const {return numThreads_;}
+
+    /// Creates the sink of one chunk, called on a worker thread
+    using ChunkSinkFactory = std::function<std::unique_ptr<PacketSink>()>;
+
+    /// Called on the calling thread with the sinks of the chunks in file order, i.e. frames arrive in frame order
+    using ChunkMerger = std::function<void(PacketSink& chunkSink)>;
+
+    /// Parse the whole file. At most 2 * numThreads() chunks are parsed ahead of the merger.
+    CaptureScanStats scan(const ChunkSinkFactory& createChunkSink, const ChunkMerger& mergeChunk);
+
+private:
+    uint64_t chunkStart(size_t chunkIdx) const;
+
+    uint64_t alignRawStream(uint64_t offset) const;
+
+    uint64_t alignPcapng(uint64_t offset) const;
+
+    void scanRawStream(uint64_t begin, uint64_t end, PacketSink& sink, CaptureScanStats& stats) const;
+
+    void scanPcapng(uint64_t begin, uint64_t end, PacketSink& sink, CaptureScanStats& stats) const;
+
+    size_t numThreads_;
+    size_t chunkBytes_;
+
+    MappedFile file_;
+    Format format_{FORMAT_RAW_STREAM};
+    std::vector<pcapng::Interface> interfaces_;     ///< pcapng interfaces described before the first packet
+};
+
+
+/// Collects the frames of a chunk by reference, to replay them in frame order from a ChunkMerger
+class FrameList : public PacketSink
+{
+public:
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override
+    {
+        frames_.push_back({header, data});
+    }
+
+    void replay(PacketSink& sink) const
+    {
+        for (const auto& frame : frames_)
+        {
+            sink.processPacket(frame.header, frame.data);
+        }
+    }
+
+    size_t size() const {return frames_.size();}
+
+private:
+    struct Frame
+    {
+        EthRecHeader header;
+        const uint8_t* data;
+    };
+
+    std::vector<Frame> frames_;
+};
+
+#endif // CAPTURESCANNER_H
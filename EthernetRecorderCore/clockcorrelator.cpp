@@ -0,0 +1,246 @@
+#include "clockcorrelator.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+/// A sample this far below the fit, or window minima this far above it, mean that a clock was stepped
+constexpr double STEP_NS = 100e6;
+
+/// Consecutive window minima above the fit by STEP_NS before a forward step of the host clock is assumed. Fewer may
+/// be a congested USB link.
+constexpr size_t MAX_HIGH_WINDOWS = 5;
+
+}   // anonymous namespace
+
+
+ClockCorrelator::ClockCorrelator(uint64_t windowNs, size_t maxWindows)
+    : windowNs_(windowNs)
+    , maxWindows_(std::max<size_t>(maxWindows, 1))
+{
+}
+
+void ClockCorrelator::reset()
+{
+    hasSamples_ = false;
+    minima_.clear();
+    highWindows_ = 0;
+    offset_ = 0;
+    drift_ = 0;
+    errorNs_ = 0;
+    fittedWindows_ = 0;
+}
+
+void ClockCorrelator::start(uint64_t deviceTimeNs, int64_t hostTimeNs)
+{
+    reset();
+    hasSamples_ = true;
+    referenceDevice_ = deviceTimeNs;
+    referenceOffset_ = hostTimeNs - static_cast<int64_t>(deviceTimeNs);
+    windowStart_ = deviceTimeNs;
+    windowMinimum_ = {0, 0};
+}
+
+void ClockCorrelator::addSample(uint64_t deviceTimeNs, int64_t hostTimeNs)
+{
+    if (!hasSamples_)
+    {
+        start(deviceTimeNs, hostTimeNs);
+        return;
+    }
+
+    if (deviceTimeNs + windowNs_ < windowStart_)
+    {
+        // The device restarted
+        ++resets_;
+        start(deviceTimeNs, hostTimeNs);
+        return;
+    }
+
+    const Point point = {static_cast<double>(static_cast<int64_t>(deviceTimeNs - referenceDevice_)),
+                         static_cast<double>(hostTimeNs - static_cast<int64_t>(deviceTimeNs) - referenceOffset_)};
+
+    if (point.y < offset_ + drift_ * point.x - STEP_NS)
+    {
+        // Delays are never negative: the host clock was stepped back
+        ++resets_;
+        start(deviceTimeNs, hostTimeNs);
+        return;
+    }
+
+    if (deviceTimeNs >= windowStart_ + windowNs_)
+    {
+        closeWindow();
+        windowStart_ = deviceTimeNs;
+        windowMinimum_ = point;
+    }
+    else if (point.y < windowMinimum_.y)
+    {
+        windowMinimum_ = point;
+    }
+
+    if (fittedWindows_ == 0)
+    {
+        // No fit yet: the offset of the best sample so far
+        offset_ = std::min(offset_, point.y);
+    }
+}
+
+void ClockCorrelator::closeWindow()
+{
+    if ((fittedWindows_ > 0) && (windowMinimum_.y > offset_ + drift_ * windowMinimum_.x + STEP_NS))
+    {
+        // Congestion or a forward step of the host clock: kept out of the fit until it is clearly the latter
+        if (++highWindows_ < MAX_HIGH_WINDOWS)
+        {
+            return;
+        }
+        ++resets_;
+        minima_.clear();
+    }
+    highWindows_ = 0;
+
+    minima_.push_back(windowMinimum_);
+    if (minima_.size() > maxWindows_)
+    {
+        minima_.pop_front();
+    }
+    fit();
+}
+
+bool ClockCorrelator::fitLine(bool isBelowOnly, double& offset, double& drift) const
+{
+    size_t numPoints = 0;
+    double meanX = 0;
+    double meanY = 0;
+    for (const auto& point : minima_)
+    {
+        if (!isBelowOnly || (point.y <= offset + drift * point.x))
+        {
+            ++numPoints;
+            meanX += point.x;
+            meanY += point.y;
+        }
+    }
+    if (numPoints == 0)
+    {
+        return false;
+    }
+    meanX /= static_cast<double>(numPoints);
+    meanY /= static_cast<double>(numPoints);
+
+    double sxx = 0;
+    double sxy = 0;
+    for (const auto& point : minima_)
+    {
+        if (!isBelowOnly || (point.y <= offset + drift * point.x))
+        {
+            sxx += (point.x - meanX) * (point.x - meanX);
+            sxy += (point.x - meanX) * (point.y - meanY);
+        }
+    }
+    if ((sxx <= 0) && (numPoints > 1))
+    {
+        return false;
+    }
+
+    drift = (sxx > 0)? sxy / sxx : 0;
+    offset = meanY - drift * meanX;
+    return true;
+}
+
+void ClockCorrelator::fit()
+{
+    // Least squares over all minima, then again over those on or below the first line: minima above it carry more
+    // delay than the others, so they would pull the line up
+    double offset = 0;
+    double drift = 0;
+    fitLine(false, offset, drift);
+    double belowOffset = offset;
+    double belowDrift = drift;
+    if (fitLine(true, belowOffset, belowDrift))
+    {
+        offset = belowOffset;
+        drift = belowDrift;
+    }
+
+    // The minima are upper bounds of offset plus the smallest delay: lower the line onto the lowest of them
+    double minResidual = 0;
+    double sumSquares = 0;
+    size_t numBelow = 0;
+    for (const auto& point : minima_)
+    {
+        const double residual = point.y - (offset + drift * point.x);
+        minResidual = std::min(minResidual, residual);
+        if (residual <= 0)
+        {
+            sumSquares += residual * residual;
+            ++numBelow;
+        }
+    }
+    offset_ = offset + minResidual;
+    drift_ = drift;
+    errorNs_ = (numBelow > 2)? std::sqrt(sumSquares / static_cast<double>(numBelow - 2)) : 0;
+
+    fittedWindows_ = minima_.size();
+    ++numFits_;
+}
+
+int64_t ClockCorrelator::toHostTime(uint64_t deviceTimeNs) const
+{
+    const double x = static_cast<double>(static_cast<int64_t>(deviceTimeNs - referenceDevice_));
+    return static_cast<int64_t>(deviceTimeNs) + referenceOffset_ + std::llround(offset_ + drift_ * x);
+}
+
+ClockEstimate ClockCorrelator::estimate() const
+{
+    ClockEstimate estimate;
+    estimate.isValid = hasSamples_;
+    estimate.driftPpm = (1 / (1 + drift_) - 1) * 1e6;    // y grows by drift_ per device nanosecond
+    estimate.errorNs = errorNs_;
+    estimate.numWindows = fittedWindows_;
+    estimate.resets = resets_;
+    return estimate;
+}
+
+
+void ClockSampler::processPacket(const EthRecHeader& header, const uint8_t* data)
+{
+    correlator_.addSample(header.timestamp, arrivalTimeNs_);
+    if (latencyTracker_ != nullptr)
+    {
+        latencyTracker_->record(LatencyTracker::STAGE_DEVICE_TO_READ_EXCESS, arrivalTimeNs_ - correlator_.toHostTime(header.timestamp));
+    }
+    if (sink_ != nullptr)
+    {
+        sink_->processPacket(header, data);
+    }
+}
+
+
+void HostTimestampSink::processPacket(const EthRecHeader& header, const uint8_t* data)
+{
+    if (sink_ == nullptr)
+    {
+        return;
+    }
+    if (!correlator_.isValid())
+    {
+        sink_->processPacket(header, data);
+        return;
+    }
+
+    EthRecHeader hostHeader = header;
+    hostHeader.timestamp = static_cast<uint64_t>(correlator_.toHostTime(header.timestamp));
+    if (hasTimestamp_ && (header.timestamp >= lastDeviceTime_) && (hostHeader.timestamp < lastHostTime_))
+    {
+        hostHeader.timestamp = lastHostTime_;
+    }
+    hasTimestamp_ = true;
+    lastDeviceTime_ = header.timestamp;
+    lastHostTime_ = hostHeader.timestamp;
+
+    sink_->processPacket(hostHeader, data);
+}
@@ -0,0 +1,142 @@
+#ifndef CLOCKCORRELATOR_H
+#define CLOCKCORRELATOR_H
+
+#include "latencytracker.h"
+#include "packetsink.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+
+/// Current mapping of the device clock to host time
+struct ClockEstimate
+{
+    bool isValid{false};
+    double driftPpm{0};                 ///< Device clock rate relative to the host clock, minus one
+    double errorNs{0};                  ///< RMS distance of the window minima below the fit, not counting the constant
+                                        ///< part of the transport delay
+    size_t numWindows{0};               ///< Fitted; 0: offset from the samples so far, no drift
+    uint64_t resets{0};                 ///< Device restarts and host clock steps
+};
+
+
+/// Maps device timestamps (nanoseconds since the start of the MCU program) to host time (UTC nanoseconds since 1970).
+///
+/// Each sample pairs a device timestamp with a host time at which the data carrying it had arrived at the latest, so
+/// host - device is the clock offset plus a transport delay that is never negative. Per window of device time only the
+/// sample with the smallest delay is kept. Offset and drift are fitted to the last window minima by linear regression
+/// when a window closes, and the line is then lowered onto the lowest of them. Adding a sample is O(1), a fit is
+/// O(maxWindows) once per window, so it can run for every packet.
+class ClockCorrelator
+{
+public:
+    static constexpr uint64_t DEFAULT_WINDOW_NS = 1000000000;
+    static constexpr size_t DEFAULT_MAX_WINDOWS = 300;
+
+    explicit ClockCorrelator(uint64_t windowNs = DEFAULT_WINDOW_NS, size_t maxWindows = DEFAULT_MAX_WINDOWS);
+
+    /// Forget all samples, e.g. for a new device. The reset count stays.
+    void reset();
+
+    /// \p hostTimeNs: UTC time at which the data with the device time \p deviceTimeNs had been received at the latest
+    void addSample(uint64_t deviceTimeNs, int64_t hostTimeNs);
+
+    /// True after the first sample
+    bool isValid() const {return hasSamples_;}
+
+    /// UTC nanoseconds since 1970 of the device time \p deviceTimeNs. Only valid if isValid().
+    int64_t toHostTime(uint64_t deviceTimeNs) const;
+
+    ClockEstimate estimate() const;
+
+    /// Incremented with every fit, to tell when estimate() changed
+    uint64_t numFits() const {return numFits_;}
+
+private:
+    struct Point
+    {
+        double x;                       ///< Device time - referenceDevice_
+        double y;                       ///< Host - device time - referenceOffset_
+    };
+
+    void closeWindow();
+
+    /// Least squares line through the minima, with \p isBelowOnly only through those on or below the line given
+    bool fitLine(bool isBelowOnly, double& offset, double& drift) const;
+
+    void fit();
+
+    void start(uint64_t deviceTimeNs, int64_t hostTimeNs);
+
+    uint64_t windowNs_;
+    size_t maxWindows_;
+
+    bool hasSamples_{false};
+    uint64_t referenceDevice_{0};
+    int64_t referenceOffset_{0};
+
+    uint64_t windowStart_{0};           ///< Device time
+    Point windowMinimum_{0, 0};         ///< Of the open window
+    std::deque<Point> minima_;          ///< Of the last closed windows, oldest first
+    size_t highWindows_{0};             ///< Consecutive window minima far above the fit, not fitted
+
+    double offset_{0};                  ///< Fit: y = offset_ + drift_ * x
+    double drift_{0};
+    double errorNs_{0};
+    size_t fittedWindows_{0};
+    uint64_t numFits_{0};
+    uint64_t resets_{0};
+};
+
+
+/// Feeds the timestamps of the packets passing through to a ClockCorrelator, paired with the arrival time of the
+/// chunk of the stream they came in
+class ClockSampler : public PacketSink
+{
+public:
+    explicit ClockSampler(ClockCorrelator& correlator) : correlator_(correlator) {}
+
+    void setSink(PacketSink* sink) {sink_ = sink;}
+
+    /// UTC time at which the chunk being parsed had been received at the latest
+    void setArrivalTime(int64_t hostTimeNs) {arrivalTimeNs_ = hostTimeNs;}
+
+    int64_t arrivalTime() const {return arrivalTimeNs_;}
+
+    /// The delay from the capture on the device to the arrival, above the smallest one, is recorded in \p tracker
+    /// (may be nullptr)
+    void setLatencyTracker(LatencyTracker* tracker) {latencyTracker_ = tracker;}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+private:
+    ClockCorrelator& correlator_;
+    PacketSink* sink_ = nullptr;
+    LatencyTracker* latencyTracker_ = nullptr;
+    int64_t arrivalTimeNs_{0};
+};
+
+
+/// Passes packets on with their timestamps mapped to UTC, e.g. to the pcapng writers. The mapped timestamps do not go
+/// backwards when a new fit moves the clock back a little.
+class HostTimestampSink : public PacketSink
+{
+public:
+    explicit HostTimestampSink(const ClockCorrelator& correlator) : correlator_(correlator) {}
+
+    void setSink(PacketSink* sink) {sink_ = sink;}
+
+    void reset() {hasTimestamp_ = false;}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+private:
+    const ClockCorrelator& correlator_;
+    PacketSink* sink_ = nullptr;
+    bool hasTimestamp_{false};
+    uint64_t lastDeviceTime_{0};
+    uint64_t lastHostTime_{0};
+};
+
+#endif // CLOCKCORRELATOR_H
@@ -0,0 +1,133 @@
+#include "devicecommand.h"
+
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+
+static_assert(sizeof(EthRecCommandHeader) == ETH_REC_COMMAND_HEADER_BYTES, "Unexpected command header size");
+static_assert(sizeof(EthRecCaptureRule) == ETH_REC_CAPTURE_RULE_BYTES, "Unexpected capture rule size");
+
+void appendCommand(std::vector<uint8_t>& commands, uint8_t command, uint8_t networkInterface, const void* payload, uint16_t numBytes)
+{
+    EthRecCommandHeader header;
+    header.syncWord = ETH_REC_COMMAND_SYNC_WORD;
+    header.command = command;
+    header.networkInterface = networkInterface;
+    header.numBytes = numBytes;
+
+    const size_t start = commands.size();
+    commands.resize(start + ETH_REC_COMMAND_HEADER_BYTES + numBytes);
+    memcpy(commands.data() + start, &header, sizeof(header));
+    if (numBytes > 0)
+    {
+        memcpy(commands.data() + start + ETH_REC_COMMAND_HEADER_BYTES, payload, numBytes);
+    }
+
+    const uint16_t crc = ethRecCrc16(commands.data() + start, commands.size() - start);
+    commands.push_back(static_cast<uint8_t>(crc));
+    commands.push_back(static_cast<uint8_t>(crc >> 8));
+}
+
+bool parseNumber(const std::string& text, uint32_t maxValue, uint16_t& value)
+{
+    if (text.empty())
+    {
+        return false;
+    }
+
+    char* end = nullptr;
+    const unsigned long number = strtoul(text.c_str(), &end, 0);
+    if ((*end != '\0') || (number > maxValue))
+    {
+        return false;
+    }
+
+    value = static_cast<uint16_t>(number);
+    return true;
+}
+
+bool parseMac(const std::string& text, uint8_t* mac)
+{
+    if (text.size() != 17)
+    {
+        return false;
+    }
+
+    for (size_t k = 0; k < 6; ++k)
+    {
+        const char digits[3] = {text[3 * k], text[3 * k + 1], '\0'};
+        char* end = nullptr;
+        mac[k] = static_cast<uint8_t>(strtoul(digits, &end, 16));
+        if ((end != digits + 2) || (digits[0] == '+') || (digits[0] == '-') || ((k < 5) && (text[3 * k + 2] != ':')))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}   // anonymous namespace
+
+
+namespace devicecommand {
+
+void appendSnapLength(std::vector<uint8_t>& commands, uint8_t networkInterface, uint16_t snapLength)
+{
+    appendCommand(commands, ETH_REC_COMMAND_SET_SNAP_LENGTH, networkInterface, &snapLength, sizeof(snapLength));
+}
+
+void appendCaptureRule(std::vector<uint8_t>& commands, uint8_t networkInterface, const EthRecCaptureRule& rule)
+{
+    appendCommand(commands, ETH_REC_COMMAND_ADD_RULE, networkInterface, &rule, ETH_REC_CAPTURE_RULE_BYTES);
+}
+
+void appendClearRules(std::vector<uint8_t>& commands, uint8_t networkInterface)
+{
+    appendCommand(commands, ETH_REC_COMMAND_CLEAR_RULES, networkInterface, nullptr, 0);
+}
+
+bool parseCaptureRule(const std::string& text, EthRecCaptureRule& rule)
+{
+    memset(&rule, 0, sizeof(rule));
+
+    const size_t separator = text.find('=');
+    if (separator == std::string::npos)
+    {
+        return false;
+    }
+    const std::string field = text.substr(0, separator);
+    const std::string value = text.substr(separator + 1);
+
+    if (field == "ethertype")
+    {
+        rule.field = ETH_REC_RULE_ETHERTYPE;
+        return parseNumber(value, 0xFFFF, rule.value);
+    }
+    if (field == "vlan")
+    {
+        rule.field = ETH_REC_RULE_VLAN_ID;
+        return parseNumber(value, 0x0FFF, rule.value);
+    }
+    if (field == "src")
+    {
+        rule.field = ETH_REC_RULE_SRC_MAC;
+        return parseMac(value, rule.mac);
+    }
+    if (field == "dst")
+    {
+        rule.field = ETH_REC_RULE_DST_MAC;
+        return parseMac(value, rule.mac);
+    }
+    if (field == "mac")
+    {
+        rule.field = ETH_REC_RULE_ANY_MAC;
+        return parseMac(value, rule.mac);
+    }
+
+    return false;
+}
+
+}   // namespace devicecommand
@@ -0,0 +1,28 @@
+#ifndef DEVICECOMMAND_H
+#define DEVICECOMMAND_H
+
+#include "eth_rec_common.h"
+
+#include <string>
+#include <vector>
+
+
+/// Host to device commands (EthRecCommandHeader), appended to a byte buffer that is written to the device
+namespace devicecommand {
+
+/// Record at most \p snapLength bytes per frame on \p networkInterface (or ETH_REC_ALL_INTERFACES), 0: whole frames
+void appendSnapLength(std::vector<uint8_t>& commands, uint8_t networkInterface, uint16_t snapLength);
+
+/// Also record the frames matching \p rule
+void appendCaptureRule(std::vector<uint8_t>& commands, uint8_t networkInterface, const EthRecCaptureRule& rule);
+
+/// Record every frame again
+void appendClearRules(std::vector<uint8_t>& commands, uint8_t networkInterface);
+
+/// Parse "ethertype=0x88f7", "vlan=100", "src=", "dst=" or "mac=" followed by "aa:bb:cc:dd:ee:ff".
+/// Numbers may be decimal or 0x hex. Returns false if the text is none of these.
+bool parseCaptureRule(const std::string& text, EthRecCaptureRule& rule);
+
+}   // namespace devicecommand
+
+#endif // DEVICECOMMAND_H
@@ -0,0 +1,83 @@
+#include "devicetelemetry.h"
+
+
+namespace {
+
+/// Increase of a device counter; after a restart the counter started over from 0
+uint64_t counterIncrease(uint32_t previous, uint32_t current, bool isRestart)
+{
+    return isRestart? current : static_cast<uint32_t>(current - previous);
+}
+
+uint64_t counterIncrease(uint64_t previous, uint64_t current, bool isRestart)
+{
+    return isRestart? current : current - previous;
+}
+
+}   // anonymous namespace
+
+
+TelemetryTracker::TelemetryTracker(size_t maxSamples)
+    : maxSamples_(maxSamples)
+{
+}
+
+void TelemetryTracker::reset()
+{
+    numRecords_ = 0;
+    elapsedTime_ = 0;
+    totals_ = TelemetryTotals();
+    samples_.clear();
+}
+
+void TelemetryTracker::addRecord(const DeviceTelemetry& telemetry)
+{
+    if (numRecords_++ == 0)
+    {
+        last_ = telemetry;
+        return;
+    }
+
+    const auto& previous = last_.counters;
+    const auto& current = telemetry.counters;
+    const bool isRestart = (telemetry.timestamp <= last_.timestamp);
+    if (isRestart)
+    {
+        ++totals_.deviceRestarts;
+    }
+
+    const uint64_t ringFullDrops = counterIncrease(previous.ringFullDrops, current.ringFullDrops, isRestart);
+    const uint64_t usbDroppedFrames = counterIncrease(previous.usbDroppedFrames, current.usbDroppedFrames, isRestart);
+    const uint64_t usbBytes = counterIncrease(previous.usbBytes, current.usbBytes, isRestart);
+    totals_.ringFullDrops += ringFullDrops;
+    totals_.usbDroppedFrames += usbDroppedFrames;
+    totals_.usbDiscardedBytes += counterIncrease(previous.usbDiscardedBytes, current.usbDiscardedBytes, isRestart);
+    totals_.usbStalls += counterIncrease(previous.usbStalls, current.usbStalls, isRestart);
+    totals_.usbStallUs += counterIncrease(previous.usbStallUs, current.usbStallUs, isRestart);
+    totals_.cutFrames += counterIncrease(previous.cutFrames, current.cutFrames, isRestart);
+    totals_.filteredFrames += counterIncrease(previous.filteredFrames, current.filteredFrames, isRestart);
+    totals_.zeroCopyFallbacks += counterIncrease(previous.zeroCopyFallbacks, current.zeroCopyFallbacks, isRestart);
+
+    if (!isRestart)
+    {
+        // The rates need the interval, which is unknown across a restart
+        const double interval = static_cast<double>(telemetry.timestamp - last_.timestamp) * 1e-9;
+        elapsedTime_ += interval;
+
+        TelemetrySample sample;
+        sample.time = elapsedTime_;
+        sample.usbBytesPerSecond = static_cast<double>(usbBytes) / interval;
+        sample.droppedFramesPerSecond = static_cast<double>(ringFullDrops + usbDroppedFrames) / interval;
+        sample.cpuLoad = current.cpuLoad * 0.01;
+        sample.ringPeakUsage = (current.ringBytes > 0)? 1.0 - static_cast<double>(current.ringMinFreeBytes) / current.ringBytes : 0.0;
+        sample.maxHeldPbufs = current.maxHeldPbufs;
+
+        samples_.push_back(sample);
+        while (samples_.size() > maxSamples_)
+        {
+            samples_.pop_front();
+        }
+    }
+
+    last_ = telemetry;
+}
@@ -0,0 +1,74 @@
+#ifndef DEVICETELEMETRY_H
+#define DEVICETELEMETRY_H
+
+#include "packetparser.h"
+
+#include <cstddef>
+#include <deque>
+
+
+/// Rates between two telemetry records
+struct TelemetrySample
+{
+    double time;                        ///< Device seconds since the first record, not counting device restarts
+    double usbBytesPerSecond;
+    double droppedFramesPerSecond;      ///< Ring full and USB write failures
+    double cpuLoad;                     ///< Percent
+    double ringPeakUsage;               ///< Highest fill level of the record ring, 0..1
+    uint32_t maxHeldPbufs;
+};
+
+/// Device counters summed since the first telemetry record. A device restart (timestamp going backwards) starts its
+/// counters over; the sums go on.
+struct TelemetryTotals
+{
+    uint64_t ringFullDrops{0};
+    uint64_t usbDroppedFrames{0};
+    uint64_t usbDiscardedBytes{0};
+    uint64_t usbStalls{0};
+    uint64_t usbStallUs{0};
+    uint64_t cutFrames{0};
+    uint64_t filteredFrames{0};
+    uint64_t zeroCopyFallbacks{0};
+    uint64_t deviceRestarts{0};
+
+    /// Frames counted by the device sequence numbers but never sent: these show up as sequence gaps on the host
+    uint64_t deviceDroppedFrames() const {return ringFullDrops + usbDroppedFrames;}
+};
+
+
+/// Turns the telemetry records of one stream into totals and a bounded history of rates
+class TelemetryTracker
+{
+public:
+    static constexpr size_t DEFAULT_MAX_SAMPLES = 600;
+
+    explicit TelemetryTracker(size_t maxSamples = DEFAULT_MAX_SAMPLES);
+
+    void reset();
+
+    /// In stream order, e.g. from PacketParser::setTelemetryCallback()
+    void addRecord(const DeviceTelemetry& telemetry);
+
+    bool hasTelemetry() const {return numRecords_ > 0;}
+
+    size_t numRecords() const {return numRecords_;}
+
+    /// Valid if hasTelemetry()
+    const DeviceTelemetry& lastRecord() const {return last_;}
+
+    const TelemetryTotals& totals() const {return totals_;}
+
+    /// Oldest first, one per record after the first, except across device restarts
+    const std::deque<TelemetrySample>& samples() const {return samples_;}
+
+private:
+    size_t maxSamples_;
+    size_t numRecords_{0};
+    double elapsedTime_{0};
+    DeviceTelemetry last_;
+    TelemetryTotals totals_;
+    std::deque<TelemetrySample> samples_;
+};
+
+#endif // DEVICETELEMETRY_H
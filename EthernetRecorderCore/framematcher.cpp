@@ -0,0 +1,453 @@
+#include "framematcher.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+
+namespace {
+
+constexpr uint16_t ETHER_TYPE_IPV4 = 0x0800;
+constexpr uint16_t ETHER_TYPE_IPV6 = 0x86DD;
+constexpr uint16_t ETHER_TYPE_VLAN = 0x8100;
+constexpr uint16_t ETHER_TYPE_QINQ = 0x88A8;
+
+constexpr uint8_t IP_PROTOCOL_TCP = 6;
+constexpr uint8_t IP_PROTOCOL_UDP = 17;
+constexpr uint8_t IP_PROTOCOL_SCTP = 132;
+
+/// Bytes of the network header copied to mask the fields a router changes
+constexpr size_t MASKED_HEADER_BYTES = 64;
+
+constexpr uint64_t HASH_MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+
+inline uint16_t readBigEndian16(const uint8_t* data)
+{
+    return static_cast<uint16_t>((data[0] << 8) | data[1]);
+}
+
+inline uint64_t mixWord(uint64_t hash, uint64_t word)
+{
+    hash = (hash ^ word) * HASH_MULTIPLIER;
+    return hash ^ (hash >> 29);
+}
+
+/// 8 bytes at a time; not stable across byte orders, which is fine for matching within one run
+uint64_t hashBytes(uint64_t hash, const uint8_t* data, size_t numBytes)
+{
+    for (; numBytes >= 8; data += 8, numBytes -= 8)
+    {
+        uint64_t word;
+        std::memcpy(&word, data, 8);
+        hash = mixWord(hash, word);
+    }
+    if (numBytes > 0)
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, data, numBytes);
+        hash = mixWord(hash, word ^ (static_cast<uint64_t>(numBytes) << 56));
+    }
+    return hash;
+}
+
+inline uint64_t finalizeHash(uint64_t hash)
+{
+    // MurmurHash3 finalizer
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return (hash != 0)? hash : 1;
+}
+
+bool hasPorts(uint8_t protocol)
+{
+    return (protocol == IP_PROTOCOL_TCP) || (protocol == IP_PROTOCOL_UDP) || (protocol == IP_PROTOCOL_SCTP);
+}
+
+void appendHistogramJson(std::string& json, const LatencyHistogram& histogram)
+{
+    char text[192];
+    std::snprintf(text, sizeof(text),
+                  "{\"count\": %" PRIu64 ", \"meanNs\": %.0f, \"p50Ns\": %" PRId64 ", \"p99Ns\": %" PRId64 ", \"p999Ns\": %" PRId64
+                  ", \"maxNs\": %" PRId64 "}",
+                  histogram.count(), histogram.mean(), histogram.percentile(50), histogram.percentile(99),
+                  histogram.percentile(99.9), histogram.max());
+    json += text;
+}
+
+}   // anonymous namespace
+
+
+bool FlowKey::operator==(const FlowKey& other) const
+{
+    return (etherType == other.etherType) && (ipProtocol == other.ipProtocol) && (addressBytes == other.addressBytes)
+           && (source == other.source) && (destination == other.destination)
+           && (sourcePort == other.sourcePort) && (destinationPort == other.destinationPort);
+}
+
+std::string FlowKey::toString() const
+{
+    auto address = [this](const std::array<uint8_t, 16>& bytes, uint16_t port){
+        char text[64];
+        int length = 0;
+        if (addressBytes == 4)
+        {
+            length = std::snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+        }
+        else if (addressBytes == 16)
+        {
+            length = std::snprintf(text, sizeof(text), "[");
+            for (size_t k = 0; k < 16; k += 2)
+            {
+                length += std::snprintf(text + length, sizeof(text) - static_cast<size_t>(length), "%s%x",
+                                        (k > 0)? ":" : "", readBigEndian16(&bytes[k]));
+            }
+            length += std::snprintf(text + length, sizeof(text) - static_cast<size_t>(length), "]");
+        }
+        else
+        {
+            length = std::snprintf(text, sizeof(text), "%02x:%02x:%02x:%02x:%02x:%02x",
+                                   bytes[0], bytes[1], bytes[2], bytes[3], bytes[4], bytes[5]);
+        }
+        if (hasPorts(ipProtocol))
+        {
+            std::snprintf(text + length, sizeof(text) - static_cast<size_t>(length), ":%u", port);
+        }
+        return std::string(text);
+    };
+
+    char protocol[16];
+    switch (ipProtocol)
+    {
+    case 0:
+        std::snprintf(protocol, sizeof(protocol), "0x%04x", etherType);
+        break;
+    case IP_PROTOCOL_TCP:
+        std::snprintf(protocol, sizeof(protocol), "tcp");
+        break;
+    case IP_PROTOCOL_UDP:
+        std::snprintf(protocol, sizeof(protocol), "udp");
+        break;
+    case IP_PROTOCOL_SCTP:
+        std::snprintf(protocol, sizeof(protocol), "sctp");
+        break;
+    default:
+        std::snprintf(protocol, sizeof(protocol), "ip/%u", ipProtocol);
+        break;
+    }
+    return std::string(protocol) + " " + address(source, sourcePort) + " > " + address(destination, destinationPort);
+}
+
+
+size_t FrameMatcher::FlowKeyHash::operator()(const FlowKey& key) const
+{
+    uint64_t hash = mixWord(0, (static_cast<uint64_t>(key.etherType) << 48) | (static_cast<uint64_t>(key.ipProtocol) << 40)
+                               | (static_cast<uint64_t>(key.sourcePort) << 16) | key.destinationPort);
+    hash = hashBytes(hash, key.source.data(), key.addressBytes);
+    hash = hashBytes(hash, key.destination.data(), key.addressBytes);
+    return static_cast<size_t>(finalizeHash(hash));
+}
+
+
+FrameMatcher::FrameMatcher(uint64_t windowNs, size_t tableEntries, size_t maxFlows, uint16_t interface0, uint16_t interface1)
+    : windowNs_(windowNs)
+    , interfaces_{interface0, interface1}
+    , maxFlows_(std::max<size_t>(maxFlows, 1))
+{
+    size_t capacity = 16;
+    while (capacity < tableEntries)
+    {
+        capacity *= 2;
+    }
+    table_.assign(capacity, Entry{0, 0, 0, 0});
+    mask_ = capacity - 1;
+    maxEntries_ = capacity / 4 * 3;
+    fifo_.resize(capacity);
+}
+
+FrameDigest FrameMatcher::digest(const EthRecHeader& header, const uint8_t* data)
+{
+    FrameDigest frame;
+    frame.timestamp = header.timestamp;
+    frame.networkInterface = header.networkInterface;
+
+    const size_t numBytes = header.numBytes;
+    if (numBytes < 14)
+    {
+        frame.hash = finalizeHash(hashBytes(0, data, numBytes));
+        return frame;
+    }
+
+    // The MAC addresses and VLAN tags may differ on the two sides
+    uint16_t etherType = readBigEndian16(data + 12);
+    size_t offset = 14;
+    while (((etherType == ETHER_TYPE_VLAN) || (etherType == ETHER_TYPE_QINQ)) && (offset + 4 <= numBytes))
+    {
+        etherType = readBigEndian16(data + offset + 2);
+        offset += 4;
+    }
+
+    auto& flow = frame.flow;
+    flow.etherType = etherType;
+
+    uint8_t head[MASKED_HEADER_BYTES];
+    const size_t headBytes = std::min(numBytes - offset, MASKED_HEADER_BYTES);
+    std::memcpy(head, data + offset, headBytes);
+
+    size_t transportOffset = 0;
+    if ((etherType == ETHER_TYPE_IPV4) && (headBytes >= 20) && ((head[0] >> 4) == 4))
+    {
+        flow.ipProtocol = head[9];
+        flow.addressBytes = 4;
+        std::memcpy(flow.source.data(), head + 12, 4);
+        std::memcpy(flow.destination.data(), head + 16, 4);
+        const bool isFirstFragment = (readBigEndian16(head + 6) & 0x1FFFU) == 0;
+        transportOffset = isFirstFragment? offset + (head[0] & 0x0FU) * 4U : 0;
+
+        head[8] = 0;                    // TTL
+        head[10] = 0;                   // Header checksum
+        head[11] = 0;
+    }
+    else if ((etherType == ETHER_TYPE_IPV6) && (headBytes >= 40) && ((head[0] >> 4) == 6))
+    {
+        flow.ipProtocol = head[6];      // Extension headers are not followed
+        flow.addressBytes = 16;
+        std::memcpy(flow.source.data(), head + 8, 16);
+        std::memcpy(flow.destination.data(), head + 24, 16);
+        transportOffset = offset + 40;
+
+        head[7] = 0;                    // Hop limit
+    }
+    else
+    {
+        flow.addressBytes = 6;
+        std::memcpy(flow.source.data(), data + 6, 6);
+        std::memcpy(flow.destination.data(), data, 6);
+    }
+
+    if (hasPorts(flow.ipProtocol) && (transportOffset > 0) && (transportOffset + 4 <= numBytes))
+    {
+        flow.sourcePort = readBigEndian16(data + transportOffset);
+        flow.destinationPort = readBigEndian16(data + transportOffset + 2);
+    }
+
+    uint64_t hash = mixWord(0, etherType);
+    hash = hashBytes(hash, head, headBytes);
+    hash = hashBytes(hash, data + offset + headBytes, numBytes - offset - headBytes);
+    frame.hash = finalizeHash(hash);
+    return frame;
+}
+
+uint32_t FrameMatcher::flowIndex(const FlowKey& key)
+{
+    const auto it = flowIndices_.find(key);
+    if (it != flowIndices_.end())
+    {
+        return it->second;
+    }
+
+    if (flowIndices_.size() < maxFlows_)
+    {
+        const auto index = static_cast<uint32_t>(flows_.size());
+        flows_.emplace_back();
+        flows_.back().key = key;
+        flowIndices_.emplace(key, index);
+        return index;
+    }
+
+    if (otherFlowIndex_ == UINT32_MAX)
+    {
+        otherFlowIndex_ = static_cast<uint32_t>(flows_.size());
+        flows_.emplace_back();
+        flows_.back().isOther = true;
+    }
+    return otherFlowIndex_;
+}
+
+size_t FrameMatcher::find(uint64_t hash, uint8_t side, uint64_t timestamp, bool isExact) const
+{
+    for (size_t index = hash & mask_; table_[index].hash != 0; index = (index + 1) & mask_)
+    {
+        const auto& entry = table_[index];
+        if ((entry.hash == hash) && (isExact? ((entry.side == side) && (entry.timestamp == timestamp)) : (entry.side != side)))
+        {
+            return index;
+        }
+    }
+    return table_.size();
+}
+
+void FrameMatcher::erase(size_t index)
+{
+    // Backward-shift deletion: move up the following entries that may live here, so probing needs no tombstones
+    size_t next = index;
+    while (true)
+    {
+        next = (next + 1) & mask_;
+        if (table_[next].hash == 0)
+        {
+            break;
+        }
+
+        const size_t home = table_[next].hash & mask_;
+        const bool isBetween = (index <= next)? ((home > index) && (home <= next)) : ((home > index) || (home <= next));
+        if (!isBetween)
+        {
+            table_[index] = table_[next];
+            index = next;
+        }
+    }
+    table_[index].hash = 0;
+    --numEntries_;
+}
+
+void FrameMatcher::evictOldest(bool isEarly)
+{
+    const auto oldest = fifo_[fifoHead_];
+    fifoHead_ = (fifoHead_ + 1) & mask_;
+    --fifoCount_;
+
+    // Matched frames left the table already
+    const size_t index = find(oldest.hash, oldest.side, oldest.timestamp, true);
+    if (index == table_.size())
+    {
+        return;
+    }
+
+    ++flows_[table_[index].flowIndex].unmatchedFrames[oldest.side];
+    ++unmatchedFrames_[oldest.side];
+    if (isEarly)
+    {
+        ++evictedEarly_;
+    }
+    erase(index);
+}
+
+void FrameMatcher::addFrame(const FrameDigest& frame)
+{
+    uint8_t side = 0;
+    if (frame.networkInterface == interfaces_[1])
+    {
+        side = 1;
+    }
+    else if (frame.networkInterface != interfaces_[0])
+    {
+        return;
+    }
+
+    // Time-based eviction: frames older than the window cannot be matched any more
+    while ((fifoCount_ > 0) && (fifo_[fifoHead_].timestamp + windowNs_ < frame.timestamp))
+    {
+        evictOldest(false);
+    }
+
+    const uint32_t index = flowIndex(frame.flow);
+    auto& flow = flows_[index];
+    ++flow.frames[side];
+
+    const size_t match = find(frame.hash, side, 0, false);
+    if ((match != table_.size()) && (table_[match].timestamp + windowNs_ >= frame.timestamp))
+    {
+        // The direction is from the side that saw the frame first
+        const auto& waiting = table_[match];
+        const bool isWaitingFirst = (waiting.timestamp <= frame.timestamp);
+        const uint8_t direction = isWaitingFirst? waiting.side : side;
+        const auto latencyNs = static_cast<int64_t>(isWaitingFirst? frame.timestamp - waiting.timestamp : waiting.timestamp - frame.timestamp);
+
+        auto& waitingFlow = flows_[waiting.flowIndex];
+        if (!waitingFlow.latency[direction])
+        {
+            waitingFlow.latency[direction] = std::make_unique<LatencyHistogram>();
+        }
+        waitingFlow.latency[direction]->record(latencyNs);
+        ++waitingFlow.matchedFrames[direction];
+        latency_[direction].record(latencyNs);
+        ++matchedFrames_;
+        erase(match);
+        return;
+    }
+
+    // Full table or FIFO: the oldest frame goes early
+    while ((numEntries_ >= maxEntries_) || (fifoCount_ == fifo_.size()))
+    {
+        evictOldest(true);
+    }
+
+    size_t slot = frame.hash & mask_;
+    while (table_[slot].hash != 0)
+    {
+        slot = (slot + 1) & mask_;
+    }
+    table_[slot] = {frame.hash, frame.timestamp, index, side};
+    ++numEntries_;
+
+    fifo_[(fifoHead_ + fifoCount_) & mask_] = {frame.hash, frame.timestamp, side};
+    ++fifoCount_;
+}
+
+void FrameMatcher::flush()
+{
+    while (fifoCount_ > 0)
+    {
+        evictOldest(false);
+    }
+}
+
+std::string FrameMatcher::toJson() const
+{
+    char text[256];
+    std::snprintf(text, sizeof(text),
+                  "{\n  \"interfaces\": [%u, %u],\n  \"windowNs\": %" PRIu64 ",\n  \"matchedFrames\": %" PRIu64
+                  ",\n  \"unmatchedFrames\": [%" PRIu64 ", %" PRIu64 "],\n  \"evictedEarly\": %" PRIu64 ",\n  \"latency\": [",
+                  interfaces_[0], interfaces_[1], windowNs_, matchedFrames_, unmatchedFrames_[0], unmatchedFrames_[1], evictedEarly_);
+    std::string json = text;
+    appendHistogramJson(json, latency_[0]);
+    json += ", ";
+    appendHistogramJson(json, latency_[1]);
+    json += "],\n  \"flows\": [\n";
+
+    for (size_t k = 0; k < flows_.size(); ++k)
+    {
+        const auto& flow = flows_[k];
+        std::snprintf(text, sizeof(text),
+                      "    {\"flow\": \"%s\", \"frames\": [%" PRIu64 ", %" PRIu64 "], \"unmatchedFrames\": [%" PRIu64 ", %" PRIu64
+                      "], \"latency\": [",
+                      flow.isOther? "other" : flow.key.toString().c_str(), flow.frames[0], flow.frames[1],
+                      flow.unmatchedFrames[0], flow.unmatchedFrames[1]);
+        json += text;
+        for (size_t direction = 0; direction < 2; ++direction)
+        {
+            if (direction > 0)
+            {
+                json += ", ";
+            }
+            if (flow.latency[direction])
+            {
+                appendHistogramJson(json, *flow.latency[direction]);
+            }
+            else
+            {
+                json += "null";
+            }
+        }
+        json += (k + 1 < flows_.size())? "]},\n" : "]}\n";
+    }
+    json += "  ]\n}\n";
+    return json;
+}
+
+bool FrameMatcher::writeJson(const std::string& fileName) const
+{
+    std::FILE* file = std::fopen(fileName.c_str(), "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    const std::string json = toJson();
+    const bool isOk = (std::fwrite(json.data(), 1, json.size(), file) == json.size());
+    return (std::fclose(file) == 0) && isOk;
+}
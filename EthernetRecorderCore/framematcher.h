@@ -0,0 +1,155 @@
+#ifndef FRAMEMATCHER_H
+#define FRAMEMATCHER_H
+
+#include "latencytracker.h"
+#include "packetsink.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/// Flow of a frame: IP addresses, protocol and ports, or the MAC addresses of non-IP frames
+struct FlowKey
+{
+    uint16_t etherType{0};
+    uint8_t ipProtocol{0};              ///< 0: not IP
+    uint8_t addressBytes{0};            ///< 4 (IPv4), 16 (IPv6) or 6 (MAC)
+    std::array<uint8_t, 16> source{};
+    std::array<uint8_t, 16> destination{};
+    uint16_t sourcePort{0};             ///< TCP, UDP and SCTP
+    uint16_t destinationPort{0};
+
+    bool operator==(const FlowKey& other) const;
+
+    /// E.g. "udp 10.0.0.1:319 > 10.0.0.2:319" or "0x88f7 00:11:22:33:44:55 > 01:1b:19:00:00:00"
+    std::string toString() const;
+};
+
+/// What the matcher needs of a frame; computed by FrameMatcher::digest(), e.g. on the worker threads of a scan
+struct FrameDigest
+{
+    uint64_t hash;                      ///< Of the bytes a device under test does not change, never 0
+    uint64_t timestamp;
+    uint16_t networkInterface;
+    FlowKey flow;
+};
+
+
+/// Online one-way latency across the two mirrored interfaces of a tap around a device under test: a frame seen on
+/// one interface is matched with the same frame on the other one within a time window, and the delay goes into the
+/// histograms of its flow and direction.
+///
+/// Frames are identified by a hash of their invariant bytes: from the EtherType on, behind any VLAN tags, without the
+/// MAC addresses, the IPv4 TTL and header checksum and the IPv6 hop limit, so routed and re-tagged frames match too.
+/// Waiting frames are kept in an open-addressing table (linear probing, backward-shift deletion) of fixed capacity,
+/// and a FIFO in arrival order evicts them once they are older than the window, so memory stays bounded and each
+/// frame costs O(1). Frames must arrive in timestamp order, up to the window.
+class FrameMatcher : public PacketSink
+{
+public:
+    static constexpr uint64_t DEFAULT_WINDOW_NS = 10000000;
+    static constexpr size_t DEFAULT_TABLE_ENTRIES = 64 * 1024;
+    static constexpr size_t DEFAULT_MAX_FLOWS = 256;
+
+    /// Per flow; index k of the arrays: interface k of the pair, or the direction from interface k to the other one
+    struct FlowStats
+    {
+        FlowKey key;
+        bool isOther{false};                                ///< Frames beyond maxFlows
+        std::array<uint64_t, 2> frames{};
+        std::array<uint64_t, 2> unmatchedFrames{};          ///< No counterpart within the window
+        std::array<uint64_t, 2> matchedFrames{};
+        std::array<std::unique_ptr<LatencyHistogram>, 2> latency;   ///< Allocated with the first match
+    };
+
+    /// Frames of interfaces other than \p interface0 and \p interface1 are ignored. \p tableEntries is rounded up to
+    /// a power of two; at most 3/4 of it is used.
+    explicit FrameMatcher(uint64_t windowNs = DEFAULT_WINDOW_NS, size_t tableEntries = DEFAULT_TABLE_ENTRIES,
+                          size_t maxFlows = DEFAULT_MAX_FLOWS, uint16_t interface0 = 0, uint16_t interface1 = 1);
+
+    static FrameDigest digest(const EthRecHeader& header, const uint8_t* data);
+
+    void addFrame(const FrameDigest& frame);
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override {addFrame(digest(header, data));}
+
+    /// The waiting frames count as unmatched, e.g. at the end of a capture
+    void flush();
+
+    const std::vector<FlowStats>& flows() const {return flows_;}
+
+    /// Over all flows, by direction
+    const LatencyHistogram& latency(size_t direction) const {return latency_[direction];}
+
+    uint64_t matchedFrames() const {return matchedFrames_;}
+
+    uint64_t unmatchedFrames(size_t index) const {return unmatchedFrames_[index];}
+
+    /// Frames that left the table before the window had passed, because it was full
+    uint64_t evictedEarly() const {return evictedEarly_;}
+
+    /// Totals, then the flows with their frame counts and latency percentiles
+    std::string toJson() const;
+
+    bool writeJson(const std::string& fileName) const;
+
+private:
+    struct Entry
+    {
+        uint64_t hash;                  ///< 0: empty
+        uint64_t timestamp;
+        uint32_t flowIndex;
+        uint8_t side;                   ///< 0: interface0, 1: interface1
+    };
+
+    struct FifoEntry
+    {
+        uint64_t hash;
+        uint64_t timestamp;
+        uint8_t side;
+    };
+
+    struct FlowKeyHash
+    {
+        size_t operator()(const FlowKey& key) const;
+    };
+
+    uint32_t flowIndex(const FlowKey& key);
+
+    /// Index of the entry of \p hash waiting on the other side than \p side, or of the entry with exactly these
+    /// values if \p isExact; the table capacity if there is none
+    size_t find(uint64_t hash, uint8_t side, uint64_t timestamp, bool isExact) const;
+
+    void erase(size_t index);
+
+    /// Remove the oldest FIFO entry; its frame counts as unmatched if it is still waiting
+    void evictOldest(bool isEarly);
+
+    uint64_t windowNs_;
+    uint16_t interfaces_[2];
+    size_t maxFlows_;
+
+    std::vector<Entry> table_;
+    size_t mask_;
+    size_t numEntries_{0};
+    size_t maxEntries_;
+
+    std::vector<FifoEntry> fifo_;       ///< Ring in arrival order
+    size_t fifoHead_{0};
+    size_t fifoCount_{0};
+
+    std::vector<FlowStats> flows_;
+    std::unordered_map<FlowKey, uint32_t, FlowKeyHash> flowIndices_;
+    uint32_t otherFlowIndex_{UINT32_MAX};
+    std::array<LatencyHistogram, 2> latency_;
+    uint64_t matchedFrames_{0};
+    std::array<uint64_t, 2> unmatchedFrames_{};
+    uint64_t evictedEarly_{0};
+};
+
+#endif // FRAMEMATCHER_H
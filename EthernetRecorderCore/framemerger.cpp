@@ -0,0 +1,177 @@
+#include "framemerger.h"
+
+#include <algorithm>
+
+
+namespace {
+
+/// Frame buffers kept for reuse at most
+constexpr size_t MAX_FREE_BUFFERS = 4096;
+
+}   // anonymous namespace
+
+
+FrameMerger::FrameMerger(size_t numInputs, size_t maxQueuedBytes)
+    : maxQueuedBytes_(maxQueuedBytes)
+{
+    for (size_t k = 0; k < numInputs; ++k)
+    {
+        inputs_.push_back(std::make_unique<Input>(*this));
+    }
+}
+
+void FrameMerger::reset()
+{
+    for (auto& input : inputs_)
+    {
+        input->isIdle = false;
+        input->hasTimestamp = false;
+        input->maxTimestamp = 0;
+        input->latePackets = 0;
+        input->restarts = 0;
+    }
+
+    queue_.clear();
+    originalBytes_ = 0;
+    nextOrder_ = 0;
+    queuedBytes_ = 0;
+    hasDelivered_ = false;
+    deliveredTimestamp_ = 0;
+    forcedPackets_ = 0;
+    latePackets_ = 0;
+    restarts_ = 0;
+}
+
+void FrameMerger::setInputIdle(size_t index, bool isIdle)
+{
+    inputs_[index]->isIdle = isIdle;
+    if (isIdle)
+    {
+        releasePackets(false);
+    }
+}
+
+void FrameMerger::flush()
+{
+    releasePackets(true);
+}
+
+void FrameMerger::restart()
+{
+    releasePackets(true);
+    for (auto& input : inputs_)
+    {
+        input->hasTimestamp = false;
+        input->maxTimestamp = 0;
+    }
+    hasDelivered_ = false;
+    deliveredTimestamp_ = 0;
+    ++restarts_;
+}
+
+bool FrameMerger::isLater(const QueuedPacket& a, const QueuedPacket& b)
+{
+    return (a.header.timestamp != b.header.timestamp)? (a.header.timestamp > b.header.timestamp) : (a.order > b.order);
+}
+
+void FrameMerger::queuePacket(Input& input, const EthRecHeader& header, const uint8_t* data)
+{
+    EthRecHeader mergedHeader = header;
+    mergedHeader.networkInterface = static_cast<uint16_t>(header.networkInterface + input.interfaceOffset);
+    const uint16_t originalBytes = (input.source != nullptr)? input.source->originalBytes() : 0;
+
+    if (input.hasTimestamp && (header.timestamp + input.maxSkewNs < input.maxTimestamp))
+    {
+        // Out of order beyond its own window: the input restarted, nothing before can be ordered with what follows
+        ++input.restarts;
+        restart();
+    }
+
+    input.isIdle = false;
+    input.maxTimestamp = input.hasTimestamp? std::max(input.maxTimestamp, header.timestamp) : header.timestamp;
+    input.hasTimestamp = true;
+
+    if (hasDelivered_ && (header.timestamp < deliveredTimestamp_))
+    {
+        // Waiting would not put it in order any more
+        ++input.latePackets;
+        ++latePackets_;
+        deliver(mergedHeader, originalBytes, data);
+        return;
+    }
+
+    // If nothing older can come, the packet goes out straight from the parser's buffer
+    if (queue_.empty() && isReleasable(header.timestamp))
+    {
+        deliver(mergedHeader, originalBytes, data);
+        return;
+    }
+
+    std::vector<uint8_t> buffer;
+    if (!freeBuffers_.empty())
+    {
+        buffer = std::move(freeBuffers_.back());
+        freeBuffers_.pop_back();
+    }
+    buffer.assign(data, data + header.numBytes);
+
+    queue_.push_back({mergedHeader, originalBytes, nextOrder_++, std::move(buffer)});
+    std::push_heap(queue_.begin(), queue_.end(), isLater);
+    queuedBytes_ += header.numBytes;
+
+    releasePackets(false);
+}
+
+bool FrameMerger::isReleasable(uint64_t timestamp) const
+{
+    for (const auto& input : inputs_)
+    {
+        // A busy input may still deliver packets down to maxTimestamp - maxSkewNs
+        if (!input->isIdle && (!input->hasTimestamp || (input->maxTimestamp < timestamp + input->maxSkewNs)))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void FrameMerger::releasePackets(bool isFlushing)
+{
+    while (!queue_.empty())
+    {
+        if (!isFlushing && !isReleasable(queue_.front().header.timestamp))
+        {
+            if (queuedBytes_ <= maxQueuedBytes_)
+            {
+                return;
+            }
+            ++forcedPackets_;
+        }
+
+        std::pop_heap(queue_.begin(), queue_.end(), isLater);
+        QueuedPacket packet = std::move(queue_.back());
+        queue_.pop_back();
+        queuedBytes_ -= packet.header.numBytes;
+
+        deliver(packet.header, packet.originalBytes, packet.data.data());
+        if (freeBuffers_.size() < MAX_FREE_BUFFERS)
+        {
+            freeBuffers_.push_back(std::move(packet.data));
+        }
+    }
+}
+
+void FrameMerger::deliver(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data)
+{
+    if (!hasDelivered_ || (header.timestamp > deliveredTimestamp_))
+    {
+        deliveredTimestamp_ = header.timestamp;
+        hasDelivered_ = true;
+    }
+
+    originalBytes_ = originalBytes;
+    if (sink_ != nullptr)
+    {
+        sink_->processPacket(header, data);
+    }
+}
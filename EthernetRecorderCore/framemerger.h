@@ -0,0 +1,132 @@
+#ifndef FRAMEMERGER_H
+#define FRAMEMERGER_H
+
+#include "packetsink.h"
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+
+/// Streaming k-way merge of the packets of several inputs into timestamp order, e.g. the USB data channels of one
+/// device or the streams of several recorders, each with its own PacketParser.
+///
+/// Waiting packets are kept in one min-heap. An input may be out of order by up to its maximum skew: once it
+/// delivered a packet at T, none older than T - maxSkew may follow. The oldest waiting packet is delivered once no
+/// busy input can still deliver an older one, so memory is bounded by the reorder windows, not by the capture.
+/// A packet older than one already delivered is late: it is delivered at once, out of order, and counted.
+/// An input going back beyond its own reorder window restarted, e.g. the device: the waiting packets are delivered
+/// and the merge starts over without counting late packets, see restart().
+class FrameMerger : public PacketSource
+{
+public:
+    static constexpr size_t DEFAULT_MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+    /// Beyond \p maxQueuedBytes of waiting packets, the oldest ones are delivered without waiting for the other inputs
+    explicit FrameMerger(size_t numInputs, size_t maxQueuedBytes = DEFAULT_MAX_QUEUED_BYTES);
+
+    /// Drop the waiting packets and start over, all inputs busy. The input settings stay.
+    void reset();
+
+    /// Merged packets are delivered to \p sink (may be nullptr)
+    void setSink(PacketSink* sink) {sink_ = sink;}
+
+    size_t numInputs() const {return inputs_.size();}
+
+    /// Sink for the parser of input \p index
+    PacketSink* input(size_t index) {return inputs_[index].get();}
+
+    /// Original lengths of input \p index are taken from \p source (may be nullptr), usually its parser
+    void setInputSource(size_t index, const PacketSource* source) {inputs_[index]->source = source;}
+
+    /// Reorder window of input \p index in nanoseconds (default 0: the input is in timestamp order)
+    void setInputMaxSkew(size_t index, uint64_t maxSkewNs) {inputs_[index]->maxSkewNs = maxSkewNs;}
+
+    /// Added to the networkInterface of the packets of input \p index, e.g. to keep the interfaces of several devices
+    /// apart in the merged capture (default 0)
+    void setInputInterfaceOffset(size_t index, uint16_t offset) {inputs_[index]->interfaceOffset = offset;}
+
+    /// An idle input, e.g. one that had no data for a while, does not hold back the others. Its next packet makes it
+    /// busy again.
+    void setInputIdle(size_t index, bool isIdle);
+
+    /// Deliver all waiting packets, e.g. at the end of the streams
+    void flush();
+
+    /// Deliver all waiting packets and forget the timestamps seen so far, e.g. after a reconnect, so that the new
+    /// timestamps are not late. The counters, the idle states and the input settings stay.
+    void restart();
+
+    uint16_t originalBytes() const override {return originalBytes_;}
+
+    size_t queuedPackets() const {return queue_.size();}
+
+    size_t queuedBytes() const {return queuedBytes_;}
+
+    /// Packets delivered early because maxQueuedBytes was exceeded
+    uint64_t forcedPackets() const {return forcedPackets_;}
+
+    /// Packets that arrived after a newer one was delivered, in total and of input \p index
+    uint64_t latePackets() const {return latePackets_;}
+    uint64_t latePackets(size_t index) const {return inputs_[index]->latePackets;}
+
+    /// Restarts of input \p index detected from its timestamps going back, and those plus the calls of restart()
+    uint64_t restarts(size_t index) const {return inputs_[index]->restarts;}
+    uint64_t restarts() const {return restarts_;}
+
+private:
+    struct QueuedPacket
+    {
+        EthRecHeader header;
+        uint16_t originalBytes;
+        uint64_t order;                     ///< Arrival order, for equal timestamps
+        std::vector<uint8_t> data;
+    };
+
+    struct Input : public PacketSink
+    {
+        explicit Input(FrameMerger& merger) : merger(merger) {}
+
+        void processPacket(const EthRecHeader& header, const uint8_t* data) override {merger.queuePacket(*this, header, data);}
+
+        FrameMerger& merger;
+        const PacketSource* source = nullptr;
+        uint64_t maxSkewNs{0};
+        uint16_t interfaceOffset{0};
+
+        bool isIdle{false};
+        bool hasTimestamp{false};
+        uint64_t maxTimestamp{0};           ///< Of the packets received
+        uint64_t latePackets{0};
+        uint64_t restarts{0};
+    };
+
+    /// Heap order: the oldest packet on top
+    static bool isLater(const QueuedPacket& a, const QueuedPacket& b);
+
+    void queuePacket(Input& input, const EthRecHeader& header, const uint8_t* data);
+
+    /// True if no busy input can deliver a packet older than \p timestamp any more
+    bool isReleasable(uint64_t timestamp) const;
+
+    void releasePackets(bool isFlushing);
+
+    void deliver(const EthRecHeader& header, uint16_t originalBytes, const uint8_t* data);
+
+    std::vector<std::unique_ptr<Input>> inputs_;
+    size_t maxQueuedBytes_;
+    PacketSink* sink_ = nullptr;
+    uint16_t originalBytes_{0};
+
+    std::vector<QueuedPacket> queue_;       ///< Min-heap, see isLater()
+    std::vector<std::vector<uint8_t>> freeBuffers_;     ///< Frame buffers of delivered packets, for reuse
+    uint64_t nextOrder_{0};
+    size_t queuedBytes_{0};
+    bool hasDelivered_{false};
+    uint64_t deliveredTimestamp_{0};        ///< Newest delivered
+    uint64_t forcedPackets_{0};
+    uint64_t latePackets_{0};
+    uint64_t restarts_{0};
+};
+
+#endif // FRAMEMERGER_H
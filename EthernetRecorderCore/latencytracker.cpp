@@ -0,0 +1,158 @@
+#include "latencytracker.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace {
+
+constexpr uint64_t SUB_BUCKETS = uint64_t(1) << LatencyHistogram::SUB_BUCKET_BITS;
+
+inline unsigned highestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanReverse64(&idx, value);
+    return static_cast<unsigned>(idx);
+#else
+    return 63U - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+}
+
+}   // anonymous namespace
+
+
+size_t LatencyHistogram::bucketIndex(uint64_t value)
+{
+    // Exact up to 2 * SUB_BUCKETS, then SUB_BUCKETS buckets per power of two
+    if (value < 2 * SUB_BUCKETS)
+    {
+        return static_cast<size_t>(value);
+    }
+    const unsigned shift = highestBit(value) - SUB_BUCKET_BITS;
+    return static_cast<size_t>(shift * SUB_BUCKETS + (value >> shift));
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index)
+{
+    if (index < 2 * SUB_BUCKETS)
+    {
+        return index;
+    }
+    const uint64_t shift = index / SUB_BUCKETS - 1;
+    const uint64_t subBucket = index % SUB_BUCKETS + SUB_BUCKETS;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(int64_t latencyNs)
+{
+    const uint64_t value = (latencyNs > 0)? static_cast<uint64_t>(latencyNs) : 0;
+    ++counts_[bucketIndex(value)];
+    ++count_;
+    max_ = std::max(max_, static_cast<int64_t>(value));
+    sum_ += static_cast<double>(value);
+}
+
+void LatencyHistogram::reset()
+{
+    counts_.fill(0);
+    count_ = 0;
+    max_ = 0;
+    sum_ = 0;
+}
+
+int64_t LatencyHistogram::percentile(double percent) const
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, 1-based
+    const double rank = std::max(1.0, percent / 100 * static_cast<double>(count_));
+    uint64_t total = 0;
+    for (size_t k = 0; k < NUM_BUCKETS; ++k)
+    {
+        total += counts_[k];
+        if (static_cast<double>(total) >= rank)
+        {
+            return std::min(static_cast<int64_t>(bucketUpperBound(k)), max_);
+        }
+    }
+    return max_;
+}
+
+
+const char* LatencyTracker::stageName(Stage stage)
+{
+    switch (stage)
+    {
+    case STAGE_DEVICE_TO_READ_EXCESS:
+        return "deviceToReadExcess";
+    case STAGE_READ_TO_PARSED:
+        return "readToParsed";
+    case STAGE_BUFFERED_TO_SUBMITTED:
+        return "bufferedToSubmitted";
+    case STAGE_SUBMITTED_TO_WRITTEN:
+        return "submittedToWritten";
+    default:
+        return "unknown";
+    }
+}
+
+void LatencyTracker::reset()
+{
+    for (auto& histogram : histograms_)
+    {
+        histogram.reset();
+    }
+}
+
+std::string LatencyTracker::toJson() const
+{
+    std::string json = "{\n";
+    char text[256];
+    for (size_t stage = 0; stage < NUM_STAGES; ++stage)
+    {
+        const auto& histogram = histograms_[stage];
+        std::snprintf(text, sizeof(text),
+                      "  \"%s\": {\"count\": %" PRIu64 ", \"meanNs\": %.0f, \"p50Ns\": %" PRId64 ", \"p99Ns\": %" PRId64
+                      ", \"p999Ns\": %" PRId64 ", \"maxNs\": %" PRId64 ", \"buckets\": [",
+                      stageName(static_cast<Stage>(stage)), histogram.count(), histogram.mean(), histogram.percentile(50),
+                      histogram.percentile(99), histogram.percentile(99.9), histogram.max());
+        json += text;
+
+        bool isFirst = true;
+        for (size_t k = 0; k < LatencyHistogram::NUM_BUCKETS; ++k)
+        {
+            if (histogram.bucketCount(k) > 0)
+            {
+                std::snprintf(text, sizeof(text), "%s[%" PRIu64 ", %" PRIu64 "]", isFirst? "" : ", ",
+                              LatencyHistogram::bucketUpperBound(k), histogram.bucketCount(k));
+                json += text;
+                isFirst = false;
+            }
+        }
+        json += (stage + 1 < NUM_STAGES)? "]},\n" : "]}\n";
+    }
+    json += "}\n";
+    return json;
+}
+
+bool LatencyTracker::writeJson(const std::string& fileName) const
+{
+    std::FILE* file = std::fopen(fileName.c_str(), "w");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    const std::string json = toJson();
+    const bool isOk = (std::fwrite(json.data(), 1, json.size(), file) == json.size());
+    return (std::fclose(file) == 0) && isOk;
+}
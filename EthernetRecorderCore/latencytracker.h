@@ -0,0 +1,82 @@
+#ifndef LATENCYTRACKER_H
+#define LATENCYTRACKER_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/// HDR-style histogram of latencies in nanoseconds: exact below 64 ns, above with 32 buckets per power of two, so a
+/// percentile is within 3 % of the recorded value. Recording is O(1) and does not allocate.
+class LatencyHistogram
+{
+public:
+    static constexpr size_t SUB_BUCKET_BITS = 5;
+    static constexpr size_t NUM_BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+    /// Negative latencies, e.g. from a clock mapping that is off, count as 0
+    void record(int64_t latencyNs);
+
+    void reset();
+
+    uint64_t count() const {return count_;}
+
+    int64_t max() const {return max_;}
+
+    double mean() const {return (count_ > 0)? sum_ / static_cast<double>(count_) : 0;}
+
+    /// Upper bound of the bucket holding the value at \p percent (0..100), at most max(). 0 without values.
+    int64_t percentile(double percent) const;
+
+    uint64_t bucketCount(size_t index) const {return counts_[index];}
+
+    /// Largest value that falls into bucket \p index
+    static uint64_t bucketUpperBound(size_t index);
+
+private:
+    static size_t bucketIndex(uint64_t value);
+
+    std::array<uint64_t, NUM_BUCKETS> counts_{};
+    uint64_t count_{0};
+    int64_t max_{0};
+    double sum_{0};
+};
+
+
+/// Latency histograms of the stages from the capture on the device to the disk write, see Stage. Not thread-safe:
+/// recorded on the parser thread, copied for other threads.
+class LatencyTracker
+{
+public:
+    enum Stage
+    {
+        STAGE_DEVICE_TO_READ_EXCESS = 0,    ///< Device timestamp (mapped to UTC) to the host read that completed its
+                                            ///< chunk, above the smallest such delay: the clock mapping is fitted to
+                                            ///< the fastest chunks, so this is the waiting in firmware queues, USB and
+                                            ///< the serial driver beyond their constant latency, which is not included
+        STAGE_READ_TO_PARSED,               ///< Host read to the end of the parse of its chunk: host ring and parser
+        STAGE_BUFFERED_TO_SUBMITTED,        ///< First byte in a write block to the write of the block
+        STAGE_SUBMITTED_TO_WRITTEN,         ///< Duration of the block write
+        NUM_STAGES,
+    };
+
+    /// Short name, also the key in the JSON output
+    static const char* stageName(Stage stage);
+
+    void record(Stage stage, int64_t latencyNs) {histograms_[stage].record(latencyNs);}
+
+    const LatencyHistogram& histogram(Stage stage) const {return histograms_[stage];}
+
+    void reset();
+
+    /// Per stage the count, mean, p50, p99, p99.9 and maximum, and the non-empty buckets as [upper bound, count]
+    std::string toJson() const;
+
+    bool writeJson(const std::string& fileName) const;
+
+private:
+    std::array<LatencyHistogram, NUM_STAGES> histograms_;
+};
+
+#endif // LATENCYTRACKER_H
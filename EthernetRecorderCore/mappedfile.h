@@ -0,0 +1,38 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstdint>
+#include <string>
+
+
+/// Read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& fileName);
+
+    void close();
+
+    bool isOpen() const {return data_ != nullptr;}
+
+    const uint8_t* data() const {return data_;}
+
+    uint64_t size() const {return size_;}
+
+private:
+    const uint8_t* data_ = nullptr;
+    uint64_t size_{0};
+
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#endif
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,471 @@
+#include "packetparser.h"
+#include "syncscan.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr size_t INITIAL_PACKET_BUFFER_BYTES = 2048;
+
+}   // anonymous namespace
+
+
+PacketParser::PacketParser()
+{
+    if ((sizeof(EthRecHeader) != ETH_REC_HEADER_BYTES) || (sizeof(EthRecHeaderV2) != ETH_REC_HEADER_V2_BYTES))
+    {
+        throw std::invalid_argument("PacketParser::PacketParser(): Invalid header size");
+    }
+
+    packetBuffer_.reserve(INITIAL_PACKET_BUFFER_BYTES);
+
+    reset();
+}
+
+void PacketParser::reset()
+{
+    restart();
+    streamOffset_ = 0;
+}
+
+void PacketParser::restart()
+{
+    resetParsing();
+    heldBytes_.clear();
+
+    hasTimestamps_.fill(false);
+    hasSequences_.fill(false);
+    header_.version = 0;
+
+    errorBytes_ = 0;
+    receivedPackets_ = 0;
+    rejectedHeaders_ = 0;
+    lostFrames_ = 0;
+    skippedRecords_ = 0;
+    telemetryRecords_ = 0;
+}
+
+void PacketParser::resetParsing()
+{
+    state_ = FIND_SYNC;
+    bufferValidBytes_ = 0;
+    batchBytesRemaining_ = 0;
+}
+
+uint32_t PacketParser::bufferedSyncWord() const
+{
+    uint32_t syncWord;
+    memcpy(&syncWord, buffer_.data(), sizeof(syncWord));
+    return syncWord;
+}
+
+void PacketParser::parseRawStream(const uint8_t* data, size_t numBytes, size_t lookaheadBytes)
+{
+    auto inputData = data;
+    auto numInputBytes = numBytes;
+    while (!heldBytes_.empty() && (numInputBytes > 0))
+    {
+        const size_t bytesToHold = std::min(heldBytesNeeded_ - heldBytes_.size(), numInputBytes);
+        heldBytes_.insert(heldBytes_.end(), inputData, inputData + bytesToHold);
+        inputData += bytesToHold;
+        numInputBytes -= bytesToHold;
+        if (heldBytes_.size() < heldBytesNeeded_)
+        {
+            break;
+        }
+
+        // Complete: parse it again, now with the sync word after the record. That may hold back a later record.
+        const std::vector<uint8_t> heldBytes = std::move(heldBytes_);
+        heldBytes_.clear();
+        inputOffset_ = heldOffset_;
+        parseBytes(heldBytes.data(), heldBytes.size(), 0);
+    }
+
+    if (numInputBytes > 0)
+    {
+        inputOffset_ = streamOffset_ + static_cast<uint64_t>(inputData - data);
+        parseBytes(inputData, numInputBytes, lookaheadBytes);
+    }
+
+    streamOffset_ += numBytes;
+}
+
+void PacketParser::finish()
+{
+    if (!heldBytes_.empty())
+    {
+        const std::vector<uint8_t> heldBytes = std::move(heldBytes_);
+        heldBytes_.clear();
+        inputOffset_ = heldOffset_;
+        const bool isEndOfStream = isEndOfStream_;
+        isEndOfStream_ = true;
+        parseBytes(heldBytes.data(), heldBytes.size(), 0);
+        isEndOfStream_ = isEndOfStream;
+    }
+
+    if ((state_ == FIND_SYNC) || (state_ == PARSE_HEADER))
+    {
+        errorBytes_ += bufferValidBytes_;
+        bufferValidBytes_ = 0;
+        state_ = FIND_SYNC;
+    }
+}
+
+bool PacketParser::isHeldBack(size_t availableBytes) const
+{
+    return validateHeaders_ && !isEndOfStream_ && (header_.version >= 2)
+        && (availableBytes < header_.header.numBytes + streamformat::SYNC_WORD_BYTES);
+}
+
+void PacketParser::parseBytes(const uint8_t* data, size_t numBytes, size_t lookaheadBytes)
+{
+    constexpr size_t syncWordSize = streamformat::SYNC_WORD_BYTES;
+
+    auto inputData = data;
+    auto numInputBytes = numBytes;
+
+    const auto bufferData = buffer_.data();
+
+    while (numInputBytes > 0)
+    {
+        if ((state_ == FIND_SYNC) && (bufferValidBytes_ == 0))
+        {
+            // Scan the whole remaining input for the sync word. Every byte before the match (or all but the
+            // last syncWordSize - 1 bytes, if there is no match) would have been shifted out one by one.
+            const size_t syncOffset = findSyncWord(inputData, numInputBytes);
+            const size_t bytesToSkip = (syncOffset < numInputBytes)? syncOffset : (numInputBytes - std::min(numInputBytes, syncWordSize - 1));
+            inputData += bytesToSkip;
+            numInputBytes -= bytesToSkip;
+            errorBytes_ += bytesToSkip;
+        }
+
+        if (state_ == PARSE_BATCH_ENTRY)
+        {
+            const size_t bytesToRead = std::min(ETH_REC_BATCH_ENTRY_BYTES - bufferValidBytes_, numInputBytes);
+            memcpy(bufferData + bufferValidBytes_, inputData, bytesToRead);
+            bufferValidBytes_ += bytesToRead;
+            inputData += bytesToRead;
+            numInputBytes -= bytesToRead;
+
+            if (bufferValidBytes_ == ETH_REC_BATCH_ENTRY_BYTES)
+            {
+                // The entry CRC is checked even without header validation: a cut-short batch runs into the next record
+                const bool isDecoded = streamformat::decodeBatchEntry(bufferData, batchTimestamp_, header_);
+                const size_t entryBytes = ETH_REC_BATCH_ENTRY_BYTES + header_.header.numBytes;
+                if (!isDecoded || (entryBytes > batchBytesRemaining_) || (validateHeaders_ && !streamformat::isHeaderInRange(header_)))
+                {
+                    // The batch is cut short or broken: look for the next record from this entry on
+                    batchBytesRemaining_ = 0;
+                    rejectHeader(0);
+                    continue;
+                }
+
+                batchBytesRemaining_ -= entryBytes;
+                state_ = PARSE_PACKET;
+                packetBytesRemaining_ = header_.header.numBytes;
+                packetBuffer_.clear();
+                checkSequence();
+
+                if (packetBytesRemaining_ == 0)
+                {
+                    finishPacket(inputData);
+                }
+            }
+        }
+        else if (state_ != PARSE_PACKET)
+        {
+            const size_t expectedBytes = (state_ == FIND_SYNC)? syncWordSize : headerBytes_;
+            const size_t bytesToRead = std::min(expectedBytes - bufferValidBytes_, numInputBytes);
+            if (bytesToRead > 0)
+            {
+                memcpy(bufferData + bufferValidBytes_, inputData, bytesToRead);
+                bufferValidBytes_ += bytesToRead;
+                inputData += bytesToRead;
+                numInputBytes -= bytesToRead;
+            }
+
+            if (bufferValidBytes_ >= expectedBytes)
+            {
+                if (state_ == FIND_SYNC)
+                {
+                    // Enough data to process sync word
+                    const uint32_t syncWord = bufferedSyncWord();
+                    if (streamformat::isSyncWord(syncWord))
+                    {
+                        // Sync word found
+                        state_ = PARSE_HEADER;
+                        headerBytes_ = streamformat::headerBytes(syncWord);
+                    }
+                    else
+                    {
+                        // Wrong sync word, shift left one byte
+                        memmove(bufferData, bufferData + 1, syncWordSize - 1);
+                        --bufferValidBytes_;
+                        ++errorBytes_;
+
+                        if (static_cast<size_t>(inputData - data) >= bufferValidBytes_)
+                        {
+                            // The remaining buffered bytes came from this input chunk: hand them back to the scanner
+                            inputData -= bufferValidBytes_;
+                            numInputBytes += bufferValidBytes_;
+                            bufferValidBytes_ = 0;
+                        }
+                    }
+                }
+                else
+                {
+                    // Enough data to process header
+                    // A v2 header failing its CRC is not decoded, so it is rejected even without validation
+                    const bool isDecoded = streamformat::decodeHeader(bufferData, header_);
+                    if (isDecoded && isHeldBack(numInputBytes + lookaheadBytes))
+                    {
+                        // Parsed again from the sync word once the record and the next sync word are there
+                        heldOffset_ = inputOffset_ + static_cast<uint64_t>(inputData - data) - headerBytes_;
+                        heldBytesNeeded_ = headerBytes_ + header_.header.numBytes + syncWordSize;
+                        heldBytes_.assign(bufferData, bufferData + headerBytes_);
+                        heldBytes_.insert(heldBytes_.end(), inputData, inputData + numInputBytes);
+                        resetParsing();
+                        return;
+                    }
+                    if (!isDecoded || (validateHeaders_ && !isHeaderValid(inputData, numInputBytes + lookaheadBytes)))
+                    {
+                        rejectHeader();
+                        continue;
+                    }
+
+                    state_ = PARSE_PACKET;
+                    packetOffset_ = inputOffset_ + static_cast<uint64_t>(inputData - data) - headerBytes_;
+                    packetBytesRemaining_ = header_.header.numBytes;
+                    packetBuffer_.clear();
+
+                    if (header_.recordType == ETH_REC_RECORD_BATCH)
+                    {
+                        // The entries follow; packetOffset_ stays at the batch header
+                        batchBytesRemaining_ = header_.header.numBytes;
+                        batchTimestamp_ = header_.header.timestamp;
+                        nextBatchEntry();
+                        continue;
+                    }
+
+                    if (header_.recordType == ETH_REC_RECORD_PACKET)
+                    {
+                        checkSequence();
+                    }
+
+                    if (packetBytesRemaining_ == 0)
+                    {
+                        // Empty packet
+                        finishPacket(inputData);
+                    }
+                }
+            }
+        }
+        else
+        {
+            const size_t bytesToRead = std::min(packetBytesRemaining_, numInputBytes);
+            const bool isComplete = (bytesToRead == packetBytesRemaining_);
+            const uint8_t* packetData = inputData;
+            const bool isDelivered = ((sink_ != nullptr) && (header_.recordType == ETH_REC_RECORD_PACKET))
+                || (header_.recordType == ETH_REC_RECORD_TELEMETRY);
+            if (isDelivered && (!isComplete || !packetBuffer_.empty()))
+            {
+                // Packet body straddles input chunks: stage it
+                packetBuffer_.insert(packetBuffer_.end(), inputData, inputData + bytesToRead);
+                packetData = packetBuffer_.data();
+            }
+
+            inputData += bytesToRead;
+            numInputBytes -= bytesToRead;
+            packetBytesRemaining_ -= bytesToRead;
+
+            if (isComplete)
+            {
+                // Unless staged, the packet body is delivered in place from the input chunk
+                finishPacket(packetData);
+            }
+        }
+    }
+}
+
+bool PacketParser::isHeaderValid(const uint8_t* lookahead, size_t lookaheadBytes)
+{
+    if (!streamformat::isHeaderInRange(header_))
+    {
+        return false;
+    }
+
+    const auto& header = header_.header;
+    if (lookaheadBytes >= header.numBytes + sizeof(uint32_t))
+    {
+        // The next sync word is already buffered. It confirms the framing even if the timestamp jumps back
+        // (e.g. after an MCU restart), and catches v2 frames that were cut short after a good header.
+        uint32_t nextSyncWord;
+        memcpy(&nextSyncWord, lookahead + header.numBytes, sizeof(nextSyncWord));
+        if (!streamformat::isSyncWord(nextSyncWord))
+        {
+            return false;
+        }
+    }
+    else if (header_.version >= 2)
+    {
+        // The CRC already confirmed the header
+        return true;
+    }
+    else if (hasTimestamps_[header.networkInterface] && (header.timestamp < lastTimestamps_[header.networkInterface]))
+    {
+        return false;
+    }
+
+    if (header_.recordType == ETH_REC_RECORD_PACKET)
+    {
+        lastTimestamps_[header.networkInterface] = header.timestamp;
+        hasTimestamps_[header.networkInterface] = true;
+    }
+    return true;
+}
+
+void PacketParser::rejectHeader(size_t firstSyncOffset)
+{
+    // False sync word: drop its first byte and look for another sync word in the rest of the header.
+    // A broken batch entry is searched from its first byte.
+    constexpr size_t syncWordSize = streamformat::SYNC_WORD_BYTES;
+    const auto bufferData = buffer_.data();
+
+    ++rejectedHeaders_;
+
+    size_t syncOffset = firstSyncOffset;
+    size_t nextHeaderBytes = 0;
+    for (; syncOffset + syncWordSize <= bufferValidBytes_; ++syncOffset)
+    {
+        uint32_t word;
+        memcpy(&word, bufferData + syncOffset, sizeof(word));
+
+        // A shorter header than the bytes already buffered (v1 within v2) is skipped, the buffer never runs ahead
+        nextHeaderBytes = streamformat::headerBytes(word);
+        if ((nextHeaderBytes > 0) && (bufferValidBytes_ - syncOffset <= nextHeaderBytes))
+        {
+            break;
+        }
+    }
+
+    // Keep the bytes from the match onwards, or a possible partial sync word at the end of the header
+    memmove(bufferData, bufferData + syncOffset, bufferValidBytes_ - syncOffset);
+    bufferValidBytes_ -= syncOffset;
+    errorBytes_ += syncOffset;
+    if (bufferValidBytes_ >= syncWordSize)
+    {
+        state_ = PARSE_HEADER;
+        headerBytes_ = nextHeaderBytes;
+    }
+    else
+    {
+        state_ = FIND_SYNC;
+    }
+}
+
+void PacketParser::checkSequence()
+{
+    const uint16_t networkInterface = header_.header.networkInterface;
+    if (!header_.hasSequence || (networkInterface >= ETH_REC_MAX_NETWORK_INTERFACES))
+    {
+        return;
+    }
+
+    const uint32_t sequence = header_.sequence;
+    if (hasSequences_[networkInterface] && (sequence != nextSequences_[networkInterface]))
+    {
+        const uint32_t difference = sequence - nextSequences_[networkInterface];
+        if (difference < 0x80000000U)
+        {
+            lostFrames_ += difference;
+            if (sequenceGapCallback_)
+            {
+                const SequenceGap gap = {networkInterface, nextSequences_[networkInterface], sequence, difference, header_.header.timestamp, packetOffset_};
+                sequenceGapCallback_(gap);
+            }
+        }
+    }
+
+    if (!hasSequences_[networkInterface])
+    {
+        firstSequences_[networkInterface] = sequence;
+        hasSequences_[networkInterface] = true;
+    }
+    nextSequences_[networkInterface] = sequence + 1;
+}
+
+bool PacketParser::sequenceRange(uint16_t networkInterface, uint32_t& firstSequence, uint32_t& nextSequence) const
+{
+    if ((networkInterface >= ETH_REC_MAX_NETWORK_INTERFACES) || !hasSequences_[networkInterface])
+    {
+        return false;
+    }
+
+    firstSequence = firstSequences_[networkInterface];
+    nextSequence = nextSequences_[networkInterface];
+    return true;
+}
+
+void PacketParser::finishPacket(const uint8_t* data)
+{
+    if (header_.recordType == ETH_REC_RECORD_TELEMETRY)
+    {
+        finishTelemetry(data);
+    }
+    else if (header_.recordType != ETH_REC_RECORD_PACKET)
+    {
+        ++skippedRecords_;
+    }
+    else
+    {
+        if (sink_ != nullptr)
+        {
+            sink_->processPacket(header_.header, data);
+        }
+        ++receivedPackets_;
+    }
+
+    if (batchBytesRemaining_ > 0)
+    {
+        nextBatchEntry();
+    }
+    else
+    {
+        resetParsing();
+    }
+}
+
+void PacketParser::finishTelemetry(const uint8_t* data)
+{
+    DeviceTelemetry telemetry;
+    if (!streamformat::decodeTelemetry(data, header_.header.numBytes, telemetry.counters))
+    {
+        ++skippedRecords_;
+        return;
+    }
+
+    ++telemetryRecords_;
+    if (telemetryCallback_)
+    {
+        telemetry.timestamp = header_.header.timestamp;
+        telemetry.sequence = header_.sequence;
+        telemetry.streamOffset = packetOffset_;
+        telemetryCallback_(telemetry);
+    }
+}
+
+void PacketParser::nextBatchEntry()
+{
+    if (batchBytesRemaining_ == 0)
+    {
+        // Empty batch
+        resetParsing();
+        return;
+    }
+
+    state_ = PARSE_BATCH_ENTRY;
+    bufferValidBytes_ = 0;
+}
@@ -0,0 +1,181 @@
+#ifndef PACKETPARSER_H
+#define PACKETPARSER_H
+
+#include "packetsink.h"
+#include "streamformat.h"
+
+#include <array>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+
+/// Frames missing between two protocol v2 headers of an interface, lost on the device or on the link
+struct SequenceGap
+{
+    uint16_t networkInterface;
+    uint32_t expectedSequence;
+    uint32_t receivedSequence;
+    uint64_t lostFrames;
+    uint64_t timestamp;             ///< Of the frame after the gap
+    uint64_t streamOffset;          ///< Of the frame after the gap
+};
+
+
+/// Decoded ETH_REC_RECORD_TELEMETRY record
+struct DeviceTelemetry
+{
+    uint64_t timestamp;             ///< Device time of the record in nanoseconds
+    uint32_t sequence;              ///< Counts the telemetry records since the device started
+    uint64_t streamOffset;          ///< Of the record header
+    EthRecTelemetry counters;
+};
+
+
+/// Parser for the recorder stream. Protocol v1 (EthRecHeader) and v2 (EthRecHeaderV2) headers may be mixed;
+/// sinks always get the packet header in v1 form. The frames of a v2 batch record are delivered one by one.
+class PacketParser : public PacketSource
+{
+public:
+    using SequenceGapCallback = std::function<void(const SequenceGap& gap)>;
+    using TelemetryCallback = std::function<void(const DeviceTelemetry& telemetry)>;
+
+    PacketParser();
+
+    /// Start over with a new stream
+    void reset();
+
+    /// Like reset(), but stream offsets continue (e.g. after a reconnect, when the stream goes to the same file)
+    void restart();
+
+    /// Packets are delivered to \p sink (may be nullptr). Packet bodies that are complete within one input
+    /// chunk are passed straight from the caller's buffer; only packets straddling two chunks are staged.
+    void setSink(PacketSink* sink) {sink_ = sink;}
+
+    /// With header validation (default), a header is only accepted if numBytes and networkInterface are in
+    /// range and, for v2, the header CRC matches, and the next sync word must follow the record. A v2 record whose
+    /// end is not buffered yet is held back until it is (at most one record, a few KB), since its CRC covers the
+    /// header only; finish() accepts it at the end of the stream. For v1, timestamps must instead be monotonic per
+    /// interface.
+    /// Rejected headers are rescanned from the byte after their sync word. A batch entry that fails its CRC, is out
+    /// of range or does not fit into its batch ends the batch; the stream is rescanned from that entry.
+    /// Without validation, v2 headers and batch entries failing their CRC are still rejected.
+    void setHeaderValidation(bool enabled) {validateHeaders_ = enabled;}
+
+    /// Called for every gap in the v2 sequence numbers of an interface, before the frame after the gap is delivered.
+    /// A sequence number going backwards (device restart) is not a gap.
+    void setSequenceGapCallback(SequenceGapCallback callback) {sequenceGapCallback_ = std::move(callback);}
+
+    /// Called for every telemetry record that passes its CRC; the others count as skipped records
+    void setTelemetryCallback(TelemetryCallback callback) {telemetryCallback_ = std::move(callback);}
+
+    /// \p lookaheadBytes valid bytes may follow the input, e.g. the rest of a mapped file. They are only read to
+    /// check the sync word after a record, no record starts in them.
+    void parseRawStream(const uint8_t* data, size_t numBytes, size_t lookaheadBytes = 0);
+
+    /// End of the stream: a v2 record held back for the sync word after it is parsed on its CRC alone, its frames
+    /// delivered from a copy. The bytes of an incomplete sync word or header count as error bytes.
+    void finish();
+
+    /// With \p isEndOfStream, nothing follows the next inputs and their lookahead, so nothing is held back and every
+    /// frame is delivered from the caller's buffer, e.g. for a chunk of a mapped file
+    void setEndOfStream(bool isEndOfStream) {isEndOfStream_ = isEndOfStream;}
+
+    size_t receivedPackets() const {return receivedPackets_;}
+
+    size_t errorBytes() const {return errorBytes_;}
+
+    size_t rejectedHeaders() const {return rejectedHeaders_;}
+
+    /// Sum of all sequence gaps
+    uint64_t lostFrames() const {return lostFrames_;}
+
+    /// First and next expected v2 sequence number of an interface since the last reset. False before the first one.
+    bool sequenceRange(uint16_t networkInterface, uint32_t& firstSequence, uint32_t& nextSequence) const;
+
+    /// Records of types this parser does not handle, and broken telemetry records
+    size_t skippedRecords() const {return skippedRecords_;}
+
+    /// Telemetry records decoded since the last reset
+    size_t telemetryRecords() const {return telemetryRecords_;}
+
+    /// Of the last accepted header, 0 before the first one
+    uint8_t protocolVersion() const {return header_.version;}
+
+    /// Number of bytes parsed since reset()
+    uint64_t streamOffset() const {return streamOffset_;}
+
+    /// Stream offset of the sync word of the current packet, or of its batch. Valid during PacketSink::processPacket().
+    uint64_t packetOffset() const {return packetOffset_;}
+
+    uint16_t originalBytes() const override {return header_.originalBytes;}
+
+private:
+    enum State
+    {
+        FIND_SYNC = 0,
+        PARSE_HEADER,
+        PARSE_PACKET,
+        PARSE_BATCH_ENTRY,
+    };
+
+    void resetParsing();
+
+    /// \p data starts at stream offset inputOffset_
+    void parseBytes(const uint8_t* data, size_t numBytes, size_t lookaheadBytes);
+
+    /// True if the v2 header just decoded is to be held back, with its record, until the sync word after it
+    bool isHeldBack(size_t availableBytes) const;
+
+    uint32_t bufferedSyncWord() const;
+
+    bool isHeaderValid(const uint8_t* lookahead, size_t lookaheadBytes);
+
+    void rejectHeader(size_t firstSyncOffset = 1);
+
+    void nextBatchEntry();
+
+    void checkSequence();
+
+    void finishPacket(const uint8_t* data);
+
+    void finishTelemetry(const uint8_t* data);
+
+    alignas(uint64_t) std::array<uint8_t, streamformat::MAX_HEADER_BYTES> buffer_;
+    streamformat::Header header_;
+    std::vector<uint8_t> packetBuffer_;
+    PacketSink* sink_ = nullptr;
+    SequenceGapCallback sequenceGapCallback_;
+    TelemetryCallback telemetryCallback_;
+
+    State state_;
+    size_t bufferValidBytes_{0};
+    size_t headerBytes_{0};                 ///< Of the header being parsed
+    size_t packetBytesRemaining_{0};
+    size_t batchBytesRemaining_{0};         ///< Entries of the current batch not parsed yet
+    uint64_t batchTimestamp_{0};
+    uint64_t streamOffset_{0};
+    uint64_t inputOffset_{0};               ///< Stream offset of the bytes being parsed
+    uint64_t packetOffset_{0};
+
+    std::vector<uint8_t> heldBytes_;        ///< From the sync word of a record held back
+    size_t heldBytesNeeded_{0};             ///< The record and the next sync word
+    uint64_t heldOffset_{0};
+    bool isEndOfStream_{false};
+
+    bool validateHeaders_{true};
+    std::array<uint64_t, ETH_REC_MAX_NETWORK_INTERFACES> lastTimestamps_;
+    std::array<bool, ETH_REC_MAX_NETWORK_INTERFACES> hasTimestamps_;
+    std::array<uint32_t, ETH_REC_MAX_NETWORK_INTERFACES> firstSequences_;
+    std::array<uint32_t, ETH_REC_MAX_NETWORK_INTERFACES> nextSequences_;
+    std::array<bool, ETH_REC_MAX_NETWORK_INTERFACES> hasSequences_;
+
+    size_t errorBytes_{0};
+    size_t receivedPackets_{0};
+    size_t rejectedHeaders_{0};
+    uint64_t lostFrames_{0};
+    size_t skippedRecords_{0};
+    size_t telemetryRecords_{0};
+};
+
+#endif // PACKETPARSER_H
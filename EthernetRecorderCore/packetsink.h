@@ -0,0 +1,55 @@
+#ifndef PACKETSINK_H
+#define PACKETSINK_H
+
+#include "eth_rec_common.h"
+
+#include <vector>
+
+
+/// Consumer of parsed packets
+class PacketSink
+{
+public:
+    virtual ~PacketSink() = default;
+
+    /// Called once per complete packet. \p data points to header.numBytes bytes of the layer-2 frame and
+    /// is only valid for the duration of the call.
+    virtual void processPacket(const EthRecHeader& header, const uint8_t* data) = 0;
+};
+
+
+/// Deliverer of packets with details beyond the header, e.g. PacketParser
+class PacketSource
+{
+public:
+    virtual ~PacketSource() = default;
+
+    /// Wire length of the packet being delivered, more than its numBytes if the device cut it to its snap length.
+    /// Valid during PacketSink::processPacket().
+    virtual uint16_t originalBytes() const = 0;
+};
+
+
+/// Forwards every packet to several sinks
+class PacketSinkGroup : public PacketSink
+{
+public:
+    void addSink(PacketSink* sink) {sinks_.push_back(sink);}
+
+    void clear() {sinks_.clear();}
+
+    bool isEmpty() const {return sinks_.empty();}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override
+    {
+        for (auto sink : sinks_)
+        {
+            sink->processPacket(header, data);
+        }
+    }
+
+private:
+    std::vector<PacketSink*> sinks_;
+};
+
+#endif // PACKETSINK_H
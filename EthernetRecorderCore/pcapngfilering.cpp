@@ -0,0 +1,59 @@
+#include "pcapngfilering.h"
+
+#include <stdexcept>
+
+
+PcapngFileRing::PcapngFileRing(const std::string& prefix, uint64_t fileBytes, size_t numFiles)
+    : prefix_(prefix)
+    , fileBytes_(fileBytes)
+    , numFiles_(numFiles)
+{
+    if ((fileBytes == 0) || (numFiles == 0))
+    {
+        throw std::invalid_argument("PcapngFileRing::PcapngFileRing(): Invalid file ring size");
+    }
+}
+
+bool PcapngFileRing::open()
+{
+    hasError_ = false;
+    return openFile(0);
+}
+
+void PcapngFileRing::close()
+{
+    writer_.close();
+    indexWriter_.close();
+    hasError_ = hasError_ || writer_.hasError() || indexWriter_.hasError();
+}
+
+bool PcapngFileRing::openFile(size_t fileIdx)
+{
+    close();
+
+    fileIdx_ = fileIdx;
+    const std::string fileName = prefix_ + "." + std::to_string(fileIdx_) + ".pcapng";
+    if (!writer_.open(fileName) || !indexWriter_.open(CaptureIndexWriter::indexFileName(fileName)))
+    {
+        hasError_ = true;
+        return false;
+    }
+    writer_.setIndexWriter(&indexWriter_);
+
+    return true;
+}
+
+void PcapngFileRing::processPacket(const EthRecHeader& header, const uint8_t* data)
+{
+    if (!writer_.isOpen())
+    {
+        return;
+    }
+
+    writer_.processPacket(header, data);
+
+    if (writer_.fileOffset() >= fileBytes_)
+    {
+        openFile((fileIdx_ + 1) % numFiles_);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef PCAPNGFILERING_H
+#define PCAPNGFILERING_H
+
+#include "pcapngwriter.h"
+
+#include <string>
+
+
+/// On-disk ring of pcapng files: <prefix>.<n>.pcapng with n = 0 .. numFiles - 1.
+/// When the current file reaches fileBytes, the next file is started, overwriting the oldest one.
+/// Each file gets its own sidecar index.
+class PcapngFileRing : public PacketSink
+{
+public:
+    PcapngFileRing(const std::string& prefix, uint64_t fileBytes, size_t numFiles);
+
+    bool open();
+
+    void close();
+
+    bool isOpen() const {return writer_.isOpen();}
+
+    bool hasError() const {return hasError_;}
+
+    /// See PcapngWriter::setPacketSource()
+    void setPacketSource(const PacketSource* source) {writer_.setPacketSource(source);}
+
+    /// See BlockFileWriter::setLatencyTracker()
+    void setLatencyTracker(LatencyTracker* tracker) {writer_.setLatencyTracker(tracker);}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+private:
+    bool openFile(size_t fileIdx);
+
+    std::string prefix_;
+    uint64_t fileBytes_;
+    size_t numFiles_;
+
+    PcapngWriter writer_;
+    CaptureIndexWriter indexWriter_;
+    size_t fileIdx_{0};
+    bool hasError_{false};
+};
+
+#endif // PCAPNGFILERING_H
@@ -0,0 +1,78 @@
+#include "pcapngformat.h"
+
+#include <cstring>
+
+
+namespace pcapng {
+
+Interface parseInterface(const uint8_t* block, uint32_t blockLength, uint32_t interfaceId)
+{
+    Interface description = {static_cast<uint16_t>(interfaceId), 1000};     // Default resolution: microseconds
+
+    // Options start after block type, length, link type, reserved and snap length
+    uint32_t offset = 16;
+    while (offset + 4 <= blockLength - 4)
+    {
+        uint16_t code;
+        uint16_t length;
+        memcpy(&code, block + offset, sizeof(code));
+        memcpy(&length, block + offset + 2, sizeof(length));
+        const uint8_t* value = block + offset + 4;
+        if ((code == OPT_ENDOFOPT) || (offset + 4 + length > blockLength - 4))
+        {
+            break;
+        }
+
+        if ((code == OPT_IF_TSRESOL) && (length >= 1))
+        {
+            const uint8_t resolution = value[0];
+            description.nanosecondsPerTick = 0;
+            if (!(resolution & 0x80U) && (resolution <= 9))
+            {
+                description.nanosecondsPerTick = 1;
+                for (uint8_t k = resolution; k < 9; ++k)
+                {
+                    description.nanosecondsPerTick *= 10;
+                }
+            }
+        }
+        else if ((code == OPT_IF_NAME) && (length > 3) && (memcmp(value, "eth", 3) == 0))
+        {
+            uint32_t number = 0;
+            uint16_t k = 3;
+            for (; (k < length) && (value[k] >= '0') && (value[k] <= '9') && (number <= 0xFFFFU); ++k)
+            {
+                number = number * 10 + (value[k] - '0');
+            }
+            if ((k == length) && (number <= 0xFFFFU))
+            {
+                description.networkInterface = static_cast<uint16_t>(number);
+            }
+        }
+
+        offset += 4 + padded(length);
+    }
+
+    return description;
+}
+
+uint32_t blockLength(const uint8_t* data, uint64_t numBytes, uint64_t offset)
+{
+    if ((offset % 4 != 0) || (offset + MIN_BLOCK_BYTES > numBytes))
+    {
+        return 0;
+    }
+
+    uint32_t length;
+    memcpy(&length, data + offset + 4, sizeof(length));
+    if ((length < MIN_BLOCK_BYTES) || (length % 4 != 0) || (length > numBytes - offset))
+    {
+        return 0;
+    }
+
+    uint32_t trailer;
+    memcpy(&trailer, data + offset + length - 4, sizeof(trailer));
+    return (trailer == length)? length : 0;
+}
+
+}   // namespace pcapng
@@ -0,0 +1,45 @@
+#ifndef PCAPNGFORMAT_H
+#define PCAPNGFORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/// pcapng constants and block helpers shared by the writers and readers (host byte order only)
+namespace pcapng {
+
+constexpr uint32_t BLOCK_TYPE_SHB = 0x0A0D0D0AU;
+constexpr uint32_t BLOCK_TYPE_IDB = 0x00000001U;
+constexpr uint32_t BLOCK_TYPE_EPB = 0x00000006U;
+constexpr uint32_t BYTE_ORDER_MAGIC = 0x1A2B3C4DU;
+
+constexpr uint16_t LINKTYPE_ETHERNET = 1;
+
+constexpr uint16_t OPT_ENDOFOPT = 0;
+constexpr uint16_t OPT_IF_NAME = 2;
+constexpr uint16_t OPT_IF_TSRESOL = 9;
+constexpr uint16_t OPT_SHB_USERAPPL = 4;
+
+constexpr uint32_t MIN_BLOCK_BYTES = 12;
+constexpr uint32_t EPB_HEADER_BYTES = 28;       ///< Block type up to original length
+
+constexpr uint32_t padded(uint32_t numBytes)
+{
+    return (numBytes + 3U) & ~3U;
+}
+
+/// What the readers need from an Interface Description Block
+struct Interface
+{
+    uint16_t networkInterface;      ///< N of if_name "ethN" (as written by PcapngWriter), else the interface ID
+    uint64_t nanosecondsPerTick;    ///< 0 if if_tsresol is not a power of ten down to nanoseconds
+};
+
+Interface parseInterface(const uint8_t* block, uint32_t blockLength, uint32_t interfaceId);
+
+/// Length of the block at \p offset if its header and trailer lengths agree and it fits into the data, else 0
+uint32_t blockLength(const uint8_t* data, uint64_t numBytes, uint64_t offset);
+
+}   // namespace pcapng
+
+#endif // PCAPNGFORMAT_H
@@ -0,0 +1,166 @@
+#include "pcapngwriter.h"
+#include "pcapngformat.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+using namespace pcapng;
+
+/// Little helper to assemble a block with options in host byte order
+class BlockBuilder
+{
+public:
+    explicit BlockBuilder(uint32_t blockType)
+    {
+        append32(blockType);
+        append32(0);    // Block total length, patched in finish()
+    }
+
+    void append16(uint16_t value) {append(&value, sizeof(value));}
+
+    void append32(uint32_t value) {append(&value, sizeof(value));}
+
+    void append64(uint64_t value) {append(&value, sizeof(value));}
+
+    void append(const void* data, size_t numBytes)
+    {
+        auto bytes = static_cast<const uint8_t*>(data);
+        block_.insert(block_.end(), bytes, bytes + numBytes);
+    }
+
+    void appendOption(uint16_t code, const void* data, uint16_t numBytes)
+    {
+        append16(code);
+        append16(numBytes);
+        append(data, numBytes);
+        block_.resize(padded(static_cast<uint32_t>(block_.size())), 0);
+    }
+
+    const std::vector<uint8_t>& finish()
+    {
+        appendOption(OPT_ENDOFOPT, nullptr, 0);
+
+        const auto totalLength = static_cast<uint32_t>(block_.size() + sizeof(uint32_t));
+        append32(totalLength);
+        memcpy(block_.data() + sizeof(uint32_t), &totalLength, sizeof(totalLength));
+        return block_;
+    }
+
+private:
+    std::vector<uint8_t> block_;
+};
+
+}   // anonymous namespace
+
+
+PcapngWriter::PcapngWriter(uint8_t timestampResolution, size_t blockBytes)
+    : file_(blockBytes)
+    , timestampResolution_(timestampResolution)
+{
+}
+
+bool PcapngWriter::open(const std::string& fileName)
+{
+    interfaceIds_.clear();
+    numInterfaces_ = 0;
+    writtenPackets_ = 0;
+
+    if (!file_.open(fileName))
+    {
+        return false;
+    }
+
+    writeSectionHeader();
+
+    // Describe the device interfaces up front, so that readers find all of them before the first packet
+    for (uint16_t networkInterface = 0; networkInterface < ETH_REC_MAX_NETWORK_INTERFACES; ++networkInterface)
+    {
+        interfaceId(networkInterface);
+    }
+    return true;
+}
+
+void PcapngWriter::close()
+{
+    file_.close();
+}
+
+void PcapngWriter::writeSectionHeader()
+{
+    BlockBuilder block(BLOCK_TYPE_SHB);
+    block.append32(BYTE_ORDER_MAGIC);
+    block.append16(1);          // Major version
+    block.append16(0);          // Minor version
+    block.append64(~0ULL);      // Section length not specified
+
+    const char application[] = "EthernetRecorder";
+    block.appendOption(OPT_SHB_USERAPPL, application, sizeof(application) - 1);
+
+    const auto& data = block.finish();
+    file_.write(data.data(), data.size());
+}
+
+uint32_t PcapngWriter::interfaceId(uint16_t networkInterface)
+{
+    if (networkInterface >= interfaceIds_.size())
+    {
+        interfaceIds_.resize(networkInterface + 1U, -1);
+    }
+
+    if (interfaceIds_[networkInterface] < 0)
+    {
+        BlockBuilder block(BLOCK_TYPE_IDB);
+        block.append16(LINKTYPE_ETHERNET);
+        block.append16(0);          // Reserved
+        block.append32(0);          // No snap length limit
+
+        const std::string name = "eth" + std::to_string(networkInterface);
+        block.appendOption(OPT_IF_NAME, name.data(), static_cast<uint16_t>(name.size()));
+        block.appendOption(OPT_IF_TSRESOL, &timestampResolution_, sizeof(timestampResolution_));
+
+        const auto& data = block.finish();
+        file_.write(data.data(), data.size());
+
+        interfaceIds_[networkInterface] = static_cast<int32_t>(numInterfaces_++);
+    }
+
+    return static_cast<uint32_t>(interfaceIds_[networkInterface]);
+}
+
+void PcapngWriter::processPacket(const EthRecHeader& header, const uint8_t* data)
+{
+    if (!file_.isOpen())
+    {
+        return;
+    }
+
+    // Enhanced Packet Block, written piecewise to avoid staging the packet
+    const uint32_t id = interfaceId(header.networkInterface);
+    const uint32_t paddedBytes = padded(header.numBytes);
+    const uint32_t totalLength = 32U + paddedBytes;
+
+    if (indexWriter_ != nullptr)
+    {
+        indexWriter_->addFrame(header.timestamp, file_.fileOffset());
+    }
+
+    uint32_t fields[7];
+    fields[0] = BLOCK_TYPE_EPB;
+    fields[1] = totalLength;
+    fields[2] = id;
+    fields[3] = static_cast<uint32_t>(header.timestamp >> 32);
+    fields[4] = static_cast<uint32_t>(header.timestamp);
+    fields[5] = header.numBytes;    // Captured length
+    fields[6] = (source_ != nullptr)? std::max<uint32_t>(source_->originalBytes(), header.numBytes) : header.numBytes;    // Original length
+    file_.write(fields, sizeof(fields));
+    file_.write(data, header.numBytes);
+
+    const uint8_t padding[4] = {0, 0, 0, 0};
+    file_.write(padding, paddedBytes - header.numBytes);
+    file_.write(&totalLength, sizeof(totalLength));
+
+    ++writtenPackets_;
+}
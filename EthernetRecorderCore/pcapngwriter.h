@@ -0,0 +1,60 @@
+#ifndef PCAPNGWRITER_H
+#define PCAPNGWRITER_H
+
+#include "blockfilewriter.h"
+#include "captureindex.h"
+#include "packetsink.h"
+
+#include <string>
+#include <vector>
+
+/// Streaming pcapng writer.
+/// Interface Description Blocks for the device interfaces are written with the section header, so that the pcapng
+/// interface ID equals EthRecHeader::networkInterface. Other networkInterface values are described when first seen.
+class PcapngWriter : public PacketSink
+{
+public:
+    /// Device timestamps are in units of 10^-timestampResolution seconds (9: nanoseconds)
+    explicit PcapngWriter(uint8_t timestampResolution = 9, size_t blockBytes = BlockFileWriter::DEFAULT_BLOCK_BYTES);
+
+    bool open(const std::string& fileName);
+
+    void close();
+
+    bool isOpen() const {return file_.isOpen();}
+
+    /// Every Enhanced Packet Block is reported to \p indexWriter (may be nullptr)
+    void setIndexWriter(CaptureIndexWriter* indexWriter) {indexWriter_ = indexWriter;}
+
+    /// The original length of a packet is taken from \p source (may be nullptr), which must be the one delivering
+    /// the packets, e.g. the PacketParser. Without a source, it is the captured length.
+    void setPacketSource(const PacketSource* source) {source_ = source;}
+
+    /// See BlockFileWriter::setLatencyTracker()
+    void setLatencyTracker(LatencyTracker* tracker) {file_.setLatencyTracker(tracker);}
+
+    bool hasError() const {return file_.hasError();}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override;
+
+    size_t writtenPackets() const {return writtenPackets_;}
+
+    /// Logical file size, including buffered data
+    uint64_t fileOffset() const {return file_.fileOffset();}
+
+private:
+    void writeSectionHeader();
+
+    uint32_t interfaceId(uint16_t networkInterface);
+
+    BlockFileWriter file_;
+    uint8_t timestampResolution_;
+    CaptureIndexWriter* indexWriter_ = nullptr;
+    const PacketSource* source_ = nullptr;
+
+    std::vector<int32_t> interfaceIds_;     ///< pcapng interface ID by networkInterface, -1 if not described yet
+    uint32_t numInterfaces_{0};
+    size_t writtenPackets_{0};
+};
+
+#endif // PCAPNGWRITER_H
@@ -0,0 +1,36 @@
+#include "rawstreamwriter.h"
+
+
+RawStreamWriter::RawStreamWriter(size_t blockBytes)
+    : file_(blockBytes)
+{
+}
+
+bool RawStreamWriter::open(const std::string& fileName, uint64_t preallocateBytes)
+{
+    bytesWritten_ = 0;
+
+    if (!file_.open(fileName))
+    {
+        return false;
+    }
+
+    if (preallocateBytes > 0)
+    {
+        // Not fatal: the file still grows as needed
+        file_.preallocate(preallocateBytes);
+    }
+
+    return true;
+}
+
+void RawStreamWriter::close()
+{
+    file_.close();
+}
+
+void RawStreamWriter::processStream(const uint8_t* data, size_t numBytes)
+{
+    file_.write(data, numBytes);
+    bytesWritten_.store(file_.fileOffset(), std::memory_order_relaxed);
+}
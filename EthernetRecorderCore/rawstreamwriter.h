@@ -0,0 +1,40 @@
+#ifndef RAWSTREAMWRITER_H
+#define RAWSTREAMWRITER_H
+
+#include "blockfilewriter.h"
+#include "streamsink.h"
+
+#include <atomic>
+#include <string>
+
+
+/// Writes the byte stream from the recorder exactly as received, EthRecHeader framing included.
+/// Convert to pcapng offline with eth-rec-convert.
+class RawStreamWriter : public StreamSink
+{
+public:
+    explicit RawStreamWriter(size_t blockBytes = BlockFileWriter::DEFAULT_BLOCK_BYTES);
+
+    /// preallocateBytes of disk space are reserved up front (Linux only)
+    bool open(const std::string& fileName, uint64_t preallocateBytes = 0);
+
+    void close();
+
+    bool isOpen() const {return file_.isOpen();}
+
+    bool hasError() const {return file_.hasError();}
+
+    /// See BlockFileWriter::setLatencyTracker()
+    void setLatencyTracker(LatencyTracker* tracker) {file_.setLatencyTracker(tracker);}
+
+    void processStream(const uint8_t* data, size_t numBytes) override;
+
+    /// Safe to call from any thread
+    uint64_t bytesWritten() const {return bytesWritten_.load(std::memory_order_relaxed);}
+
+private:
+    BlockFileWriter file_;
+    std::atomic<uint64_t> bytesWritten_{0};
+};
+
+#endif // RAWSTREAMWRITER_H
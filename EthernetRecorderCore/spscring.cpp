@@ -0,0 +1,21 @@
+#include "spscring.h"
+
+#include <stdexcept>
+
+
+SpscByteRing::SpscByteRing(size_t capacity)
+{
+    if (capacity == 0)
+    {
+        throw std::invalid_argument("SpscByteRing::SpscByteRing(): Invalid capacity");
+    }
+
+    capacity_ = 1;
+    while (capacity_ < capacity)
+    {
+        capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+
+    buffer_ = std::make_unique<uint8_t[]>(capacity_);
+}
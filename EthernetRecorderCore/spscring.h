@@ -0,0 +1,93 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+
+/// Lock-free single-producer/single-consumer byte ring.
+/// The producer writes straight into the ring through writePointer()/commitWrite(), the consumer reads
+/// straight out of it through readPointer()/commitRead(). Both return the largest contiguous region.
+class SpscByteRing
+{
+public:
+    /// The capacity is rounded up to a power of two
+    explicit SpscByteRing(size_t capacity);
+
+    size_t capacity() const {return capacity_;}
+
+    /// Producer: contiguous free space at the write position, numBytes is set to its size (0 if full)
+    uint8_t* writePointer(size_t& numBytes)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cachedTail_ == capacity_)
+        {
+            cachedTail_ = tail_.load(std::memory_order_acquire);
+        }
+
+        const size_t offset = head & mask_;
+        numBytes = std::min(capacity_ - (head - cachedTail_), capacity_ - offset);
+        return buffer_.get() + offset;
+    }
+
+    /// Producer: publish numBytes written at writePointer()
+    void commitWrite(size_t numBytes)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed) + numBytes;
+        head_.store(head, std::memory_order_release);
+
+        const size_t usedBytes = head - tail_.load(std::memory_order_relaxed);
+        if (usedBytes > highWaterMark_.load(std::memory_order_relaxed))
+        {
+            highWaterMark_.store(usedBytes, std::memory_order_relaxed);
+        }
+    }
+
+    /// Consumer: contiguous data at the read position, numBytes is set to its size (0 if empty)
+    const uint8_t* readPointer(size_t& numBytes)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (cachedHead_ == tail)
+        {
+            cachedHead_ = head_.load(std::memory_order_acquire);
+        }
+
+        const size_t offset = tail & mask_;
+        numBytes = std::min(cachedHead_ - tail, capacity_ - offset);
+        return buffer_.get() + offset;
+    }
+
+    /// Consumer: release numBytes read at readPointer()
+    void commitRead(size_t numBytes)
+    {
+        tail_.store(tail_.load(std::memory_order_relaxed) + numBytes, std::memory_order_release);
+    }
+
+    /// Approximate number of buffered bytes, safe to call from any thread
+    size_t usedBytes() const {return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);}
+
+    /// Largest number of buffered bytes seen by the producer, safe to call from any thread
+    size_t highWaterMark() const {return highWaterMark_.load(std::memory_order_relaxed);}
+
+    void resetHighWaterMark() {highWaterMark_.store(0, std::memory_order_relaxed);}
+
+private:
+    static constexpr size_t CACHE_LINE_BYTES = 64;
+
+    std::unique_ptr<uint8_t[]> buffer_;
+    size_t capacity_;
+    size_t mask_;
+
+    alignas(CACHE_LINE_BYTES) std::atomic<size_t> head_{0};
+    size_t cachedTail_{0};          // Producer's copy of tail_
+
+    alignas(CACHE_LINE_BYTES) std::atomic<size_t> tail_{0};
+    size_t cachedHead_{0};          // Consumer's copy of head_
+
+    alignas(CACHE_LINE_BYTES) std::atomic<size_t> highWaterMark_{0};
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,93 @@
+#include "streamformat.h"
+
+#include <cstring>
+
+
+namespace streamformat {
+
+bool decodeHeader(const uint8_t* data, Header& header)
+{
+    uint32_t syncWord;
+    memcpy(&syncWord, data, sizeof(syncWord));
+
+    if (syncWord == ETH_REC_SYNC_WORD_V2)
+    {
+        EthRecHeaderV2 headerV2;
+        memcpy(&headerV2, data, sizeof(headerV2));
+        if (ethRecCrc16(data, ETH_REC_HEADER_V2_CRC_BYTES) != headerV2.headerCrc)
+        {
+            return false;
+        }
+
+        header.header.syncWord = ETH_REC_SYNC_WORD;
+        header.header.networkInterface = headerV2.networkInterface;
+        header.header.numBytes = headerV2.numBytes;
+        header.header.timestamp = headerV2.timestamp;
+        header.version = 2;
+        header.recordType = headerV2.recordType;
+        header.hasSequence = true;
+        header.sequence = headerV2.sequence;
+        header.originalBytes = (headerV2.originalBytes > 0)? headerV2.originalBytes : headerV2.numBytes;
+        return true;
+    }
+
+    memcpy(&header.header, data, sizeof(header.header));
+    header.version = 1;
+    header.recordType = ETH_REC_RECORD_PACKET;
+    header.hasSequence = false;
+    header.sequence = 0;
+    header.originalBytes = header.header.numBytes;
+    return true;
+}
+
+bool decodeBatchEntry(const uint8_t* data, uint64_t batchTimestamp, Header& header)
+{
+    EthRecBatchEntry entry;
+    memcpy(&entry, data, sizeof(entry));
+    if (ethRecCrc16(data, ETH_REC_BATCH_ENTRY_CRC_BYTES) != entry.entryCrc)
+    {
+        return false;
+    }
+
+    header.header.syncWord = ETH_REC_SYNC_WORD;
+    header.header.networkInterface = entry.networkInterface;
+    header.header.numBytes = entry.numBytes;
+    header.header.timestamp = batchTimestamp + entry.timeOffset;
+    header.version = 2;
+    header.recordType = ETH_REC_RECORD_PACKET;
+    header.hasSequence = true;
+    header.sequence = entry.sequence;
+    header.originalBytes = (entry.originalBytes > 0)? entry.originalBytes : entry.numBytes;
+    return true;
+}
+
+bool decodeTelemetry(const uint8_t* data, size_t numBytes, EthRecTelemetry& telemetry)
+{
+    if ((numBytes != ETH_REC_TELEMETRY_BYTES) || (sizeof(telemetry) != ETH_REC_TELEMETRY_BYTES))
+    {
+        return false;
+    }
+
+    memcpy(&telemetry, data, sizeof(telemetry));
+    return ethRecCrc16(data, ETH_REC_TELEMETRY_CRC_BYTES) == telemetry.telemetryCrc;
+}
+
+bool isHeaderInRange(const Header& header)
+{
+    if (header.recordType == ETH_REC_RECORD_BATCH)
+    {
+        return header.header.numBytes >= ETH_REC_BATCH_ENTRY_BYTES;
+    }
+    if (header.recordType == ETH_REC_RECORD_TELEMETRY)
+    {
+        return header.header.numBytes == ETH_REC_TELEMETRY_BYTES;
+    }
+    if (header.recordType != ETH_REC_RECORD_PACKET)
+    {
+        return true;
+    }
+
+    return (header.header.numBytes <= ETH_REC_MAX_PACKET_BYTES) && (header.header.networkInterface < ETH_REC_MAX_NETWORK_INTERFACES);
+}
+
+}   // namespace streamformat
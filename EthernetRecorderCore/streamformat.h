@@ -0,0 +1,55 @@
+#ifndef STREAMFORMAT_H
+#define STREAMFORMAT_H
+
+#include "eth_rec_common.h"
+
+#include <cstddef>
+
+
+/// Recorder stream headers of all protocol versions
+namespace streamformat {
+
+constexpr size_t SYNC_WORD_BYTES = sizeof(uint32_t);
+constexpr size_t MAX_HEADER_BYTES = ETH_REC_HEADER_V2_BYTES;
+
+/// Header size for a sync word, 0 if it is none
+constexpr size_t headerBytes(uint32_t syncWord)
+{
+    return (syncWord == ETH_REC_SYNC_WORD)? ETH_REC_HEADER_BYTES : ((syncWord == ETH_REC_SYNC_WORD_V2)? ETH_REC_HEADER_V2_BYTES : 0);
+}
+
+constexpr bool isSyncWord(uint32_t syncWord)
+{
+    return headerBytes(syncWord) > 0;
+}
+
+/// A header of any version, with the packet header in v1 form for the sinks
+struct Header
+{
+    EthRecHeader header;            ///< syncWord is always ETH_REC_SYNC_WORD
+    uint8_t version;
+    uint8_t recordType;             ///< ETH_REC_RECORD_PACKET for v1
+    bool hasSequence;               ///< v2
+    uint32_t sequence;
+    uint16_t originalBytes;         ///< Frame length on the wire, header.numBytes unless the device cut the frame
+};
+
+/// Decode a complete header (headerBytes() bytes starting with a sync word).
+/// Returns false if a v2 header fails its CRC.
+bool decodeHeader(const uint8_t* data, Header& header);
+
+/// Decode an EthRecBatchEntry (ETH_REC_BATCH_ENTRY_BYTES) into the packet record it stands for.
+/// Returns false if the entry fails its CRC.
+bool decodeBatchEntry(const uint8_t* data, uint64_t batchTimestamp, Header& header);
+
+/// Decode the payload of an ETH_REC_RECORD_TELEMETRY record.
+/// Returns false if it has the wrong size or fails its CRC.
+bool decodeTelemetry(const uint8_t* data, size_t numBytes, EthRecTelemetry& telemetry);
+
+/// Plausibility of the sizes: packet records up to ETH_REC_MAX_PACKET_BYTES on a device interface,
+/// batches holding at least one entry, telemetry records of ETH_REC_TELEMETRY_BYTES
+bool isHeaderInRange(const Header& header);
+
+}   // namespace streamformat
+
+#endif // STREAMFORMAT_H
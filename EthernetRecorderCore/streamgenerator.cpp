@@ -0,0 +1,235 @@
+#include "streamgenerator.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace {
+
+constexpr size_t MAX_GARBAGE_BYTES = 64;
+
+}   // anonymous namespace
+
+
+std::vector<StreamGenerator::PacketSize> StreamGenerator::imix()
+{
+    return {{64, 7}, {594, 4}, {1514, 1}};
+}
+
+StreamGenerator::StreamGenerator(const std::vector<PacketSize>& packetSizes, uint32_t seed)
+    : packetSizes_(packetSizes)
+    , random_(seed)
+{
+    if (packetSizes_.empty())
+    {
+        throw std::invalid_argument("StreamGenerator::StreamGenerator(): No packet sizes");
+    }
+
+    std::vector<double> weights;
+    for (auto& packetSize : packetSizes_)
+    {
+        packetSize.numBytes = static_cast<uint16_t>(std::min<uint32_t>(packetSize.numBytes, ETH_REC_MAX_PACKET_BYTES));
+        weights.push_back(packetSize.weight);
+    }
+    sizeDistribution_ = std::discrete_distribution<size_t>(weights.begin(), weights.end());
+}
+
+void StreamGenerator::setCorruptionRate(double rate)
+{
+    corruptionDistribution_ = std::bernoulli_distribution(std::clamp(rate, 0.0, 1.0));
+}
+
+void StreamGenerator::setDropRate(double rate)
+{
+    dropDistribution_ = std::bernoulli_distribution(std::clamp(rate, 0.0, 1.0));
+}
+
+void StreamGenerator::appendFrame(std::vector<uint8_t>& stream)
+{
+    const uint16_t numBytes = packetSizes_[sizeDistribution_(random_)].numBytes;
+    const bool isCorrupted = corruptionDistribution_(random_);
+    const auto networkInterface = static_cast<uint16_t>((networkInterface_ >= 0)? networkInterface_ % ETH_REC_MAX_NETWORK_INTERFACES
+                                                                               : generatedFrames_ % ETH_REC_MAX_NETWORK_INTERFACES);
+    const uint32_t sequence = sequences_[networkInterface]++;
+
+    if ((telemetryIntervalNs_ > 0) && (protocolVersion_ >= 2) && (timestamp_ >= nextTelemetryTimestamp_))
+    {
+        flush(stream);
+        appendTelemetry(stream);
+        nextTelemetryTimestamp_ = timestamp_ + telemetryIntervalNs_;
+    }
+
+    timestamp_ += packetIntervalNs_;
+    ++generatedFrames_;
+
+    if (dropDistribution_(random_))
+    {
+        ++droppedFrames_;
+        return;
+    }
+
+    if (isCorrupted)
+    {
+        ++corruptedFrames_;
+    }
+
+    if ((batchBytes_ > 0) && (protocolVersion_ >= 2))
+    {
+        const size_t maxBatchBytes = std::min<size_t>(batchBytes_ - std::min<size_t>(batchBytes_, ETH_REC_HEADER_V2_BYTES), UINT16_MAX);
+        const size_t entryBytes = ETH_REC_BATCH_ENTRY_BYTES + numBytes;
+        if (!batch_.empty() && (batch_.size() + entryBytes > maxBatchBytes))
+        {
+            flush(stream);
+        }
+        if (batch_.empty())
+        {
+            batchTimestamp_ = timestamp_;
+        }
+
+        EthRecBatchEntry entry = {};
+        entry.networkInterface = static_cast<uint8_t>(networkInterface);
+        entry.numBytes = numBytes;
+        entry.sequence = sequence;
+        entry.timeOffset = static_cast<uint32_t>(timestamp_ - batchTimestamp_);
+        entry.entryCrc = ethRecCrc16(reinterpret_cast<const uint8_t*>(&entry), ETH_REC_BATCH_ENTRY_CRC_BYTES);
+
+        const size_t entryOffset = batch_.size();
+        batch_.resize(entryOffset + entryBytes);
+        memcpy(batch_.data() + entryOffset, &entry, sizeof(entry));
+        fillPacket(batch_.data() + entryOffset + sizeof(entry), numBytes);
+        generatedBytes_ += entryBytes;
+        isBatchCorrupted_ = isBatchCorrupted_ || isCorrupted;
+        return;
+    }
+
+    const size_t headerBytes = (protocolVersion_ >= 2)? ETH_REC_HEADER_V2_BYTES : ETH_REC_HEADER_BYTES;
+    const size_t frameOffset = stream.size();
+    stream.resize(frameOffset + headerBytes + numBytes);
+    uint8_t* frame = stream.data() + frameOffset;
+
+    if (protocolVersion_ >= 2)
+    {
+        EthRecHeaderV2 header = {};
+        header.syncWord = ETH_REC_SYNC_WORD_V2;
+        header.recordType = ETH_REC_RECORD_PACKET;
+        header.networkInterface = static_cast<uint8_t>(networkInterface);
+        header.numBytes = numBytes;
+        header.timestamp = timestamp_;
+        header.sequence = sequence;
+        header.headerCrc = ethRecCrc16(reinterpret_cast<const uint8_t*>(&header), ETH_REC_HEADER_V2_CRC_BYTES);
+        memcpy(frame, &header, sizeof(header));
+    }
+    else
+    {
+        EthRecHeader header;
+        header.syncWord = ETH_REC_SYNC_WORD;
+        header.networkInterface = networkInterface;
+        header.numBytes = numBytes;
+        header.timestamp = timestamp_;
+        memcpy(frame, &header, sizeof(header));
+    }
+
+    fillPacket(frame + headerBytes, numBytes);
+    generatedBytes_ += headerBytes + numBytes;
+
+    if (isCorrupted)
+    {
+        corruptRecord(stream, frameOffset);
+    }
+}
+
+void StreamGenerator::flush(std::vector<uint8_t>& stream)
+{
+    if (batch_.empty())
+    {
+        return;
+    }
+
+    EthRecHeaderV2 header = {};
+    header.syncWord = ETH_REC_SYNC_WORD_V2;
+    header.recordType = ETH_REC_RECORD_BATCH;
+    header.numBytes = static_cast<uint16_t>(batch_.size());
+    header.timestamp = batchTimestamp_;
+    header.sequence = batchSequence_++;
+    header.headerCrc = ethRecCrc16(reinterpret_cast<const uint8_t*>(&header), ETH_REC_HEADER_V2_CRC_BYTES);
+
+    const size_t recordOffset = stream.size();
+    const auto headerData = reinterpret_cast<const uint8_t*>(&header);
+    stream.insert(stream.end(), headerData, headerData + sizeof(header));
+    stream.insert(stream.end(), batch_.begin(), batch_.end());
+    generatedBytes_ += sizeof(header);
+
+    if (isBatchCorrupted_)
+    {
+        corruptRecord(stream, recordOffset);
+    }
+
+    batch_.clear();
+    isBatchCorrupted_ = false;
+}
+
+void StreamGenerator::fillPacket(uint8_t* packet, uint16_t numBytes)
+{
+    // Broadcast IPv4 frame with a counting payload
+    for (uint16_t k = 0; k < numBytes; ++k)
+    {
+        packet[k] = static_cast<uint8_t>(k);
+    }
+    const uint8_t ethernetHeader[14] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x02, 0x00, 0x00, 0x00, 0x00, 0x01, 0x08, 0x00};
+    memcpy(packet, ethernetHeader, std::min<size_t>(sizeof(ethernetHeader), numBytes));
+}
+
+void StreamGenerator::corruptRecord(std::vector<uint8_t>& stream, size_t recordOffset)
+{
+    // Half of the errors insert garbage ahead of the record, the other half drop its tail
+    if (random_() & 1U)
+    {
+        const size_t garbageBytes = 1 + random_() % MAX_GARBAGE_BYTES;
+        std::vector<uint8_t> garbage(garbageBytes);
+        for (auto& value : garbage)
+        {
+            value = static_cast<uint8_t>(random_());
+        }
+        stream.insert(stream.begin() + static_cast<ptrdiff_t>(recordOffset), garbage.begin(), garbage.end());
+    }
+    else
+    {
+        const size_t recordBytes = stream.size() - recordOffset;
+        stream.resize(recordOffset + 1 + random_() % (recordBytes - 1));
+    }
+}
+
+void StreamGenerator::appendTelemetry(std::vector<uint8_t>& stream)
+{
+    EthRecTelemetry telemetry = {};
+    telemetry.usbBytes = generatedBytes_;
+    telemetry.ringFullDrops = static_cast<uint32_t>(droppedFrames_);
+    telemetry.ringBytes = 131072;
+    telemetry.ringMinFreeBytes = telemetry.ringBytes;
+    telemetry.telemetryCrc = ethRecCrc16(reinterpret_cast<const uint8_t*>(&telemetry), ETH_REC_TELEMETRY_CRC_BYTES);
+
+    EthRecHeaderV2 header = {};
+    header.syncWord = ETH_REC_SYNC_WORD_V2;
+    header.recordType = ETH_REC_RECORD_TELEMETRY;
+    header.networkInterface = static_cast<uint8_t>((networkInterface_ >= 0)? networkInterface_ % ETH_REC_MAX_NETWORK_INTERFACES : 0);
+    header.numBytes = ETH_REC_TELEMETRY_BYTES;
+    header.timestamp = timestamp_;
+    header.sequence = telemetrySequence_++;
+    header.headerCrc = ethRecCrc16(reinterpret_cast<const uint8_t*>(&header), ETH_REC_HEADER_V2_CRC_BYTES);
+
+    const auto headerData = reinterpret_cast<const uint8_t*>(&header);
+    const auto telemetryData = reinterpret_cast<const uint8_t*>(&telemetry);
+    stream.insert(stream.end(), headerData, headerData + sizeof(header));
+    stream.insert(stream.end(), telemetryData, telemetryData + sizeof(telemetry));
+    generatedBytes_ += sizeof(header) + sizeof(telemetry);
+}
+
+void StreamGenerator::generate(std::vector<uint8_t>& stream, size_t numBytes)
+{
+    while (stream.size() < numBytes)
+    {
+        appendFrame(stream);
+    }
+    flush(stream);
+}
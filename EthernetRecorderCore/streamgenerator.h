@@ -0,0 +1,99 @@
+#ifndef STREAMGENERATOR_H
+#define STREAMGENERATOR_H
+
+#include "eth_rec_common.h"
+
+#include <random>
+#include <vector>
+
+
+/// Synthetic recorder stream (EthRecHeaderV2 or EthRecHeader framing) for benchmarks and the device simulator.
+/// Deterministic for a given seed.
+class StreamGenerator
+{
+public:
+    struct PacketSize
+    {
+        uint16_t numBytes;
+        uint32_t weight;
+    };
+
+    /// Simple IMIX: 7 x 64, 4 x 594, 1 x 1514 bytes
+    static std::vector<PacketSize> imix();
+
+    explicit StreamGenerator(const std::vector<PacketSize>& packetSizes, uint32_t seed = 1);
+
+    /// Probability per frame of a transfer error: garbage bytes before the frame, or the frame cut short
+    void setCorruptionRate(double rate);
+
+    /// 1 or 2 (default, as the current firmware)
+    void setProtocolVersion(uint8_t version) {protocolVersion_ = version;}
+
+    /// Probability per frame that the device drops it (v2: a sequence gap, v1: silently)
+    void setDropRate(double rate);
+
+    /// v2: pack frames into batch records of up to \p maxBytes, header included (0: one record per frame, default).
+    /// A corrupted frame corrupts its whole batch.
+    void setBatchBytes(size_t maxBytes) {batchBytes_ = maxBytes;}
+
+    /// Device time between two packets
+    void setPacketIntervalNs(uint64_t intervalNs) {packetIntervalNs_ = intervalNs;}
+
+    /// v2: device time between two telemetry records (0: none, default). The pending batch is flushed before each one.
+    /// The records report the dropped frames as ring-full drops and the bytes generated as USB bytes.
+    void setTelemetryIntervalNs(uint64_t intervalNs) {telemetryIntervalNs_ = intervalNs;}
+
+    /// Frames of one network interface only, like one USB data channel of the device (-1: both in turn, default)
+    void setNetworkInterface(int networkInterface) {networkInterface_ = networkInterface;}
+
+    /// Append one frame (possibly corrupted or dropped) to \p stream. With batching, the frame is appended to the
+    /// pending batch, which goes to \p stream when it is full.
+    void appendFrame(std::vector<uint8_t>& stream);
+
+    /// Append the pending batch, if any, to \p stream
+    void flush(std::vector<uint8_t>& stream);
+
+    /// Append frames until \p stream holds at least \p numBytes, then flush()
+    void generate(std::vector<uint8_t>& stream, size_t numBytes);
+
+    /// Frames generated so far, including corrupted ones
+    size_t generatedFrames() const {return generatedFrames_;}
+
+    /// Frames drawn as corrupted
+    size_t corruptedFrames() const {return corruptedFrames_;}
+
+    size_t droppedFrames() const {return droppedFrames_;}
+
+private:
+    void fillPacket(uint8_t* packet, uint16_t numBytes);
+
+    void corruptRecord(std::vector<uint8_t>& stream, size_t recordOffset);
+
+    void appendTelemetry(std::vector<uint8_t>& stream);
+
+    std::vector<PacketSize> packetSizes_;
+    std::discrete_distribution<size_t> sizeDistribution_;
+    std::bernoulli_distribution corruptionDistribution_{0};
+    std::bernoulli_distribution dropDistribution_{0};
+    std::mt19937 random_;
+
+    uint8_t protocolVersion_{2};
+    int networkInterface_{-1};
+    size_t batchBytes_{0};
+    std::vector<uint8_t> batch_;            ///< Entries of the pending batch
+    uint64_t batchTimestamp_{0};
+    uint32_t batchSequence_{0};
+    bool isBatchCorrupted_{false};
+    uint64_t packetIntervalNs_{10000};
+    uint64_t timestamp_{0};
+    size_t generatedFrames_{0};
+    size_t corruptedFrames_{0};
+    size_t droppedFrames_{0};
+    uint64_t telemetryIntervalNs_{0};
+    uint64_t nextTelemetryTimestamp_{0};
+    uint32_t telemetrySequence_{0};
+    uint64_t generatedBytes_{0};            ///< Records appended so far, before corruption
+    uint32_t sequences_[ETH_REC_MAX_NETWORK_INTERFACES] = {};
+};
+
+#endif // STREAMGENERATOR_H
@@ -0,0 +1,18 @@
+#ifndef STREAMSINK_H
+#define STREAMSINK_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/// Consumer of the raw byte stream from the recorder, before parsing
+class StreamSink
+{
+public:
+    virtual ~StreamSink() = default;
+
+    /// \p data is only valid for the duration of the call
+    virtual void processStream(const uint8_t* data, size_t numBytes) = 0;
+};
+
+#endif // STREAMSINK_H
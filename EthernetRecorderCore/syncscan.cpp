@@ -0,0 +1,173 @@
+#include "syncscan.h"
+#include "streamformat.h"
+
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SYNCSCAN_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(SYNCSCAN_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define SYNCSCAN_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace {
+
+constexpr size_t SYNC_WORD_BYTES = sizeof(uint32_t);
+
+// The sync words of all protocol versions share the first three bytes
+static_assert((ETH_REC_SYNC_WORD & 0x00FFFFFFU) == (ETH_REC_SYNC_WORD_V2 & 0x00FFFFFFU), "Sync words must share the first three bytes");
+
+constexpr uint8_t syncByte(unsigned idx)
+{
+    return static_cast<uint8_t>((ETH_REC_SYNC_WORD >> (8 * idx)) & 0xFFU);
+}
+
+constexpr uint8_t SYNC_BYTE3_V2 = static_cast<uint8_t>(ETH_REC_SYNC_WORD_V2 >> 24);
+
+inline unsigned countTrailingZeros(uint32_t mask)
+{
+#ifdef _MSC_VER
+    unsigned long idx = 0;
+    _BitScanForward(&idx, mask);
+    return static_cast<unsigned>(idx);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+size_t findScalar(const uint8_t* data, size_t numBytes, size_t startIdx)
+{
+    if (numBytes < SYNC_WORD_BYTES)
+    {
+        return numBytes;
+    }
+
+    const size_t lastIdx = numBytes - SYNC_WORD_BYTES;
+    size_t idx = startIdx;
+    while (idx <= lastIdx)
+    {
+        // Find candidates by the first byte, then verify the whole word
+        auto candidate = static_cast<const uint8_t*>(memchr(data + idx, syncByte(0), lastIdx - idx + 1));
+        if (candidate == nullptr)
+        {
+            break;
+        }
+
+        idx = static_cast<size_t>(candidate - data);
+        uint32_t word;
+        memcpy(&word, candidate, sizeof(word));
+        if (streamformat::isSyncWord(word))
+        {
+            return idx;
+        }
+        ++idx;
+    }
+
+    return numBytes;
+}
+
+#ifndef SYNCSCAN_HAVE_SSE2
+size_t findScalar(const uint8_t* data, size_t numBytes)
+{
+    return findScalar(data, numBytes, 0);
+}
+#else
+size_t findSse2(const uint8_t* data, size_t numBytes)
+{
+    constexpr size_t blockBytes = sizeof(__m128i);
+
+    const __m128i pattern0 = _mm_set1_epi8(static_cast<char>(syncByte(0)));
+    const __m128i pattern1 = _mm_set1_epi8(static_cast<char>(syncByte(1)));
+    const __m128i pattern2 = _mm_set1_epi8(static_cast<char>(syncByte(2)));
+    const __m128i pattern3 = _mm_set1_epi8(static_cast<char>(syncByte(3)));
+    const __m128i pattern3V2 = _mm_set1_epi8(static_cast<char>(SYNC_BYTE3_V2));
+
+    size_t idx = 0;
+    for (; idx + blockBytes + SYNC_WORD_BYTES - 1 <= numBytes; idx += blockBytes)
+    {
+        // Bit k of the mask is set when a sync word starts at idx + k
+        __m128i match = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + idx)), pattern0);
+        match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + idx + 1)), pattern1));
+        match = _mm_and_si128(match, _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + idx + 2)), pattern2));
+        const __m128i block3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + idx + 3));
+        match = _mm_and_si128(match, _mm_or_si128(_mm_cmpeq_epi8(block3, pattern3), _mm_cmpeq_epi8(block3, pattern3V2)));
+
+        const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(match));
+        if (mask != 0)
+        {
+            return idx + countTrailingZeros(mask);
+        }
+    }
+
+    return findScalar(data, numBytes, idx);
+}
+#endif
+
+#ifdef SYNCSCAN_HAVE_AVX2
+__attribute__((target("avx2")))
+size_t findAvx2(const uint8_t* data, size_t numBytes)
+{
+    constexpr size_t blockBytes = sizeof(__m256i);
+
+    const __m256i pattern0 = _mm256_set1_epi8(static_cast<char>(syncByte(0)));
+    const __m256i pattern1 = _mm256_set1_epi8(static_cast<char>(syncByte(1)));
+    const __m256i pattern2 = _mm256_set1_epi8(static_cast<char>(syncByte(2)));
+    const __m256i pattern3 = _mm256_set1_epi8(static_cast<char>(syncByte(3)));
+    const __m256i pattern3V2 = _mm256_set1_epi8(static_cast<char>(SYNC_BYTE3_V2));
+
+    size_t idx = 0;
+    for (; idx + blockBytes + SYNC_WORD_BYTES - 1 <= numBytes; idx += blockBytes)
+    {
+        // Bit k of the mask is set when a sync word starts at idx + k
+        __m256i match = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx)), pattern0);
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx + 1)), pattern1));
+        match = _mm256_and_si256(match, _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx + 2)), pattern2));
+        const __m256i block3 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + idx + 3));
+        match = _mm256_and_si256(match, _mm256_or_si256(_mm256_cmpeq_epi8(block3, pattern3), _mm256_cmpeq_epi8(block3, pattern3V2)));
+
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(match));
+        if (mask != 0)
+        {
+            return idx + countTrailingZeros(mask);
+        }
+    }
+
+    return findScalar(data, numBytes, idx);
+}
+#endif
+
+using FindFunction = size_t (*)(const uint8_t*, size_t);
+
+FindFunction selectFindFunction()
+{
+#ifdef SYNCSCAN_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return findAvx2;
+    }
+#endif
+
+#ifdef SYNCSCAN_HAVE_SSE2
+    return findSse2;
+#else
+    return findScalar;
+#endif
+}
+
+const FindFunction findFunction = selectFindFunction();
+
+}   // anonymous namespace
+
+
+size_t findSyncWord(const uint8_t* data, size_t numBytes)
+{
+    return findFunction(data, numBytes);
+}
@@ -0,0 +1,13 @@
+#ifndef SYNCSCAN_H
+#define SYNCSCAN_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+/// Find the first sync word of any protocol version (ETH_REC_SYNC_WORD, ETH_REC_SYNC_WORD_V2; little-endian) in \p data.
+/// Returns the byte offset of the match, or \p numBytes if there is none.
+/// Uses AVX2 or SSE2 when available, with a scalar fallback.
+size_t findSyncWord(const uint8_t* data, size_t numBytes);
+
+#endif // SYNCSCAN_H
@@ -0,0 +1,61 @@
+// Convert a raw stream dump (RawStreamWriter, eth-rec-cli --output) to pcapng, with a sidecar index.
+// The dump is parsed in parallel chunks; packets are written in frame order.
+
+#include "capturescanner.h"
+#include "pcapngwriter.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::fprintf(stderr, "Usage: %s <raw input> <pcapng output>\n", argv[0]);
+        return 1;
+    }
+
+    CaptureScanner scanner;
+    if (!scanner.open(argv[1]))
+    {
+        std::fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    if (scanner.format() != CaptureScanner::FORMAT_RAW_STREAM)
+    {
+        std::fprintf(stderr, "%s is not a raw stream dump\n", argv[1]);
+        return 1;
+    }
+
+    PcapngWriter writer;
+    if (!writer.open(argv[2]))
+    {
+        std::fprintf(stderr, "Cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    CaptureIndexWriter indexWriter;
+    if (indexWriter.open(CaptureIndexWriter::indexFileName(argv[2])))
+    {
+        writer.setIndexWriter(&indexWriter);
+    }
+
+    const auto stats = scanner.scan([](){return std::make_unique<FrameList>();},
+                                    [&writer](PacketSink& chunkSink){static_cast<FrameList&>(chunkSink).replay(writer);});
+
+    writer.close();
+    indexWriter.close();
+
+    std::printf("%" PRIu64 " byte(s) read, %zu packet(s) written, %" PRIu64 " error byte(s), %" PRIu64 " rejected header(s)\n",
+                scanner.fileBytes(), writer.writtenPackets(), stats.errorBytes, stats.rejectedHeaders);
+
+    if (writer.hasError() || indexWriter.hasError())
+    {
+        std::fprintf(stderr, "I/O error\n");
+        return 1;
+    }
+
+    return 0;
+}
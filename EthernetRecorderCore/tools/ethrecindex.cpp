@@ -0,0 +1,85 @@
+// Build the sidecar index of a capture file, or look up where to start reading
+
+#include "captureindex.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+
+int usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s build <capture>\n"
+                 "       %s time <capture> <timestamp ns>\n"
+                 "       %s frame <capture> <frame number>\n",
+                 program, program, program);
+    return 1;
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        return usage(argv[0]);
+    }
+
+    const char* command = argv[1];
+    const std::string indexFileName = CaptureIndexWriter::indexFileName(argv[2]);
+
+    if (strcmp(command, "build") == 0)
+    {
+        if (!CaptureIndex::rebuild(argv[2], indexFileName))
+        {
+            std::fprintf(stderr, "Cannot index %s\n", argv[2]);
+            return 1;
+        }
+
+        CaptureIndex index;
+        index.load(indexFileName);
+        std::printf("%zu entry(ies) written to %s\n", index.entries().size(), indexFileName.c_str());
+        return 0;
+    }
+
+    if (argc != 4)
+    {
+        return usage(argv[0]);
+    }
+
+    CaptureIndex index;
+    if (!index.load(indexFileName))
+    {
+        std::fprintf(stderr, "Cannot read %s\n", indexFileName.c_str());
+        return 1;
+    }
+
+    const uint64_t value = std::strtoull(argv[3], nullptr, 0);
+    const CaptureIndexEntry* entry;
+    if (strcmp(command, "time") == 0)
+    {
+        entry = index.seekTime(value);
+    }
+    else if (strcmp(command, "frame") == 0)
+    {
+        entry = index.seekFrame(value);
+    }
+    else
+    {
+        return usage(argv[0]);
+    }
+
+    if (entry == nullptr)
+    {
+        std::fprintf(stderr, "Empty index\n");
+        return 1;
+    }
+
+    std::printf("offset %" PRIu64 ", frame %" PRIu64 ", timestamp %" PRIu64 "\n", entry->fileOffset, entry->frameNumber, entry->timestamp);
+    return 0;
+}
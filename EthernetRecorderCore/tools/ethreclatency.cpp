@@ -0,0 +1,175 @@
+// One-way latency across the two mirrored interfaces of a tap around a device under test, from a raw stream or pcapng
+// capture. Frames are digested on all cores; the digests are matched in file order by a FrameMatcher, the same one
+// eth-rec-cli --match-latency runs live.
+
+#include "capturescanner.h"
+#include "framematcher.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+
+namespace {
+
+/// Smaller than the scanner default: the digests of a chunk are held until it is merged
+constexpr size_t CHUNK_BYTES = 8 * 1024 * 1024;
+
+constexpr size_t MAX_PRINTED_FLOWS = 20;
+
+void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] <capture>\n"
+                 "  --window <ms>          Longest latency matched (default %.0f)\n"
+                 "  --interfaces <a> <b>   The two sides of the device under test (default 0 1)\n"
+                 "  --table-entries <n>    Frames waiting for their match at most (default %zu)\n"
+                 "  --max-flows <n>        Flows kept apart, the rest are summed up as \"other\" (default %zu)\n"
+                 "  --json <file>          Write the totals and all flows as JSON\n"
+                 "  --threads <n>          Worker threads (default: one per core)\n",
+                 program, FrameMatcher::DEFAULT_WINDOW_NS * 1e-6, FrameMatcher::DEFAULT_TABLE_ENTRIES, FrameMatcher::DEFAULT_MAX_FLOWS);
+}
+
+class DigestSink : public PacketSink
+{
+public:
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override
+    {
+        digests_.push_back(FrameMatcher::digest(header, data));
+    }
+
+    const std::vector<FrameDigest>& digests() const {return digests_;}
+
+private:
+    std::vector<FrameDigest> digests_;
+};
+
+void printLatency(const char* label, const LatencyHistogram& histogram)
+{
+    std::printf(" %s %" PRIu64 " matched, p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us;", label, histogram.count(),
+                histogram.percentile(50) * 1e-3, histogram.percentile(99) * 1e-3, histogram.percentile(99.9) * 1e-3,
+                histogram.max() * 1e-3);
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    double windowMs = FrameMatcher::DEFAULT_WINDOW_NS * 1e-6;
+    uint16_t interfaces[2] = {0, 1};
+    size_t tableEntries = FrameMatcher::DEFAULT_TABLE_ENTRIES;
+    size_t maxFlows = FrameMatcher::DEFAULT_MAX_FLOWS;
+    const char* jsonFileName = nullptr;
+    size_t numThreads = 0;
+
+    int argIndex = 1;
+    for (; (argIndex < argc) && (std::strncmp(argv[argIndex], "--", 2) == 0); ++argIndex)
+    {
+        if ((std::strcmp(argv[argIndex], "--window") == 0) && (argIndex + 1 < argc))
+        {
+            windowMs = std::atof(argv[++argIndex]);
+        }
+        else if ((std::strcmp(argv[argIndex], "--interfaces") == 0) && (argIndex + 2 < argc))
+        {
+            interfaces[0] = static_cast<uint16_t>(std::strtoul(argv[++argIndex], nullptr, 10));
+            interfaces[1] = static_cast<uint16_t>(std::strtoul(argv[++argIndex], nullptr, 10));
+        }
+        else if ((std::strcmp(argv[argIndex], "--table-entries") == 0) && (argIndex + 1 < argc))
+        {
+            tableEntries = std::strtoul(argv[++argIndex], nullptr, 10);
+        }
+        else if ((std::strcmp(argv[argIndex], "--max-flows") == 0) && (argIndex + 1 < argc))
+        {
+            maxFlows = std::strtoul(argv[++argIndex], nullptr, 10);
+        }
+        else if ((std::strcmp(argv[argIndex], "--json") == 0) && (argIndex + 1 < argc))
+        {
+            jsonFileName = argv[++argIndex];
+        }
+        else if ((std::strcmp(argv[argIndex], "--threads") == 0) && (argIndex + 1 < argc))
+        {
+            numThreads = std::strtoul(argv[++argIndex], nullptr, 10);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((argc - argIndex != 1) || (windowMs <= 0) || (interfaces[0] == interfaces[1]))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* fileName = argv[argIndex];
+
+    CaptureScanner scanner(numThreads, CHUNK_BYTES);
+    if (!scanner.open(fileName))
+    {
+        std::fprintf(stderr, "Cannot open %s\n", fileName);
+        return 1;
+    }
+
+    FrameMatcher matcher(static_cast<uint64_t>(windowMs * 1e6), tableEntries, maxFlows, interfaces[0], interfaces[1]);
+    const auto scanStats = scanner.scan([](){return std::make_unique<DigestSink>();},
+                                        [&matcher](PacketSink& chunkSink){
+        for (const auto& digest : static_cast<DigestSink&>(chunkSink).digests())
+        {
+            matcher.addFrame(digest);
+        }
+    });
+    matcher.flush();
+
+    std::printf("%s: %" PRIu64 " packet(s), %" PRIu64 " matched, %" PRIu64 " unmatched on eth%u, %" PRIu64 " unmatched on eth%u, "
+                "%" PRIu64 " evicted before the window (table full), %zu thread(s)\n",
+                fileName, scanStats.receivedPackets, matcher.matchedFrames(), matcher.unmatchedFrames(0), interfaces[0],
+                matcher.unmatchedFrames(1), interfaces[1], matcher.evictedEarly(), scanner.numThreads());
+
+    char labels[2][32];
+    std::snprintf(labels[0], sizeof(labels[0]), "eth%u > eth%u:", interfaces[0], interfaces[1]);
+    std::snprintf(labels[1], sizeof(labels[1]), "eth%u > eth%u:", interfaces[1], interfaces[0]);
+    std::printf("all flows:");
+    printLatency(labels[0], matcher.latency(0));
+    printLatency(labels[1], matcher.latency(1));
+    std::printf("\n");
+
+    // The busiest flows
+    const auto& flows = matcher.flows();
+    std::vector<size_t> order(flows.size());
+    std::iota(order.begin(), order.end(), 0);
+    auto numFrames = [&flows](size_t index){return flows[index].frames[0] + flows[index].frames[1];};
+    std::stable_sort(order.begin(), order.end(), [&numFrames](size_t a, size_t b){return numFrames(a) > numFrames(b);});
+    for (size_t k = 0; k < std::min(order.size(), MAX_PRINTED_FLOWS); ++k)
+    {
+        const auto& flow = flows[order[k]];
+        std::printf("%s: %" PRIu64 "/%" PRIu64 " frame(s), %" PRIu64 "/%" PRIu64 " unmatched;",
+                    flow.isOther? "other" : flow.key.toString().c_str(), flow.frames[0], flow.frames[1],
+                    flow.unmatchedFrames[0], flow.unmatchedFrames[1]);
+        for (size_t direction = 0; direction < 2; ++direction)
+        {
+            if (flow.latency[direction])
+            {
+                printLatency(labels[direction], *flow.latency[direction]);
+            }
+        }
+        std::printf("\n");
+    }
+    if (flows.size() > MAX_PRINTED_FLOWS)
+    {
+        std::printf("... %zu more flow(s)%s\n", flows.size() - MAX_PRINTED_FLOWS, (jsonFileName != nullptr)? ", see the JSON file" : "");
+    }
+
+    if ((jsonFileName != nullptr) && !matcher.writeJson(jsonFileName))
+    {
+        std::fprintf(stderr, "Cannot write %s\n", jsonFileName);
+        return 1;
+    }
+
+    return 0;
+}
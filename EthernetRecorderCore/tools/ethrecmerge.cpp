@@ -0,0 +1,209 @@
+// Merge raw stream dumps (eth-rec-cli --output), e.g. of the two USB data channels of a device or of several
+// recorders, into one time-ordered pcapng with a sidecar index. The inputs are parsed side by side, always reading
+// from the one that is furthest behind in time, so only the reorder windows are held in memory.
+
+#include "framemerger.h"
+#include "mappedfile.h"
+#include "packetparser.h"
+#include "pcapngwriter.h"
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+constexpr size_t CHUNK_BYTES = 256 * 1024;
+
+void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options] <pcapng output> <raw input>[@<max skew ms>]...\n"
+                 "  --max-skew <ms>       Reorder window of the inputs without their own (default 0: each input in time order)\n"
+                 "  --separate-devices    Inputs from different recorders: the interfaces of input k become\n"
+                 "                        k * %u + networkInterface (default: the USB data channels of one device)\n"
+                 "  --max-queue-mb <MB>   Waiting frames beyond this are written out of order (default 64)\n",
+                 program, ETH_REC_MAX_NETWORK_INTERFACES);
+}
+
+/// One raw stream dump, parsed chunk by chunk
+struct MergeInput : public PacketSink
+{
+    std::string fileName;
+    double maxSkewMs{-1};               ///< -1: --max-skew
+    MappedFile file;
+    uint64_t offset{0};
+    PacketParser parser;
+    PacketSink* mergerInput = nullptr;
+    bool hasTimestamp{false};
+    uint64_t lastTimestamp{0};
+
+    bool isDone() const {return offset >= file.size();}
+
+    void processPacket(const EthRecHeader& header, const uint8_t* data) override
+    {
+        hasTimestamp = true;
+        lastTimestamp = header.timestamp;
+        mergerInput->processPacket(header, data);
+    }
+};
+
+/// "<file>@<ms>" sets the skew of one input
+void parseInput(const char* argument, MergeInput& input)
+{
+    input.fileName = argument;
+    const auto separator = input.fileName.rfind('@');
+    if (separator != std::string::npos)
+    {
+        char* end = nullptr;
+        const double skewMs = std::strtod(input.fileName.c_str() + separator + 1, &end);
+        if ((end != input.fileName.c_str() + separator + 1) && (*end == '\0') && (skewMs >= 0))
+        {
+            input.maxSkewMs = skewMs;
+            input.fileName.resize(separator);
+        }
+    }
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    double maxSkewMs = 0;
+    bool isSeparateDevices = false;
+    size_t maxQueuedBytes = FrameMerger::DEFAULT_MAX_QUEUED_BYTES;
+
+    int argIndex = 1;
+    for (; (argIndex < argc) && (std::strncmp(argv[argIndex], "--", 2) == 0); ++argIndex)
+    {
+        if ((std::strcmp(argv[argIndex], "--max-skew") == 0) && (argIndex + 1 < argc))
+        {
+            maxSkewMs = std::atof(argv[++argIndex]);
+        }
+        else if (std::strcmp(argv[argIndex], "--separate-devices") == 0)
+        {
+            isSeparateDevices = true;
+        }
+        else if ((std::strcmp(argv[argIndex], "--max-queue-mb") == 0) && (argIndex + 1 < argc))
+        {
+            maxQueuedBytes = static_cast<size_t>(std::atof(argv[++argIndex]) * 1024 * 1024);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((argc - argIndex < 2) || (maxSkewMs < 0))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* outputFileName = argv[argIndex++];
+
+    const size_t numInputs = static_cast<size_t>(argc - argIndex);
+    std::vector<std::unique_ptr<MergeInput>> inputs;
+    FrameMerger merger(numInputs, maxQueuedBytes);
+    for (size_t k = 0; k < numInputs; ++k)
+    {
+        inputs.push_back(std::make_unique<MergeInput>());
+        auto& input = *inputs.back();
+        parseInput(argv[argIndex + static_cast<int>(k)], input);
+        if (!input.file.open(input.fileName))
+        {
+            std::fprintf(stderr, "Cannot open %s\n", input.fileName.c_str());
+            return 1;
+        }
+
+        input.mergerInput = merger.input(k);
+        input.parser.setSink(&input);
+        // The rest of the mapped file is the lookahead of every chunk, so no record is held back
+        input.parser.setEndOfStream(true);
+        merger.setInputSource(k, &input.parser);
+        merger.setInputMaxSkew(k, static_cast<uint64_t>(((input.maxSkewMs >= 0)? input.maxSkewMs : maxSkewMs) * 1e6));
+        if (isSeparateDevices)
+        {
+            merger.setInputInterfaceOffset(k, static_cast<uint16_t>(k * ETH_REC_MAX_NETWORK_INTERFACES));
+        }
+        if (input.isDone())
+        {
+            merger.setInputIdle(k, true);
+        }
+    }
+
+    PcapngWriter writer;
+    if (!writer.open(outputFileName))
+    {
+        std::fprintf(stderr, "Cannot open %s\n", outputFileName);
+        return 1;
+    }
+    writer.setPacketSource(&merger);
+    merger.setSink(&writer);
+
+    CaptureIndexWriter indexWriter;
+    if (indexWriter.open(CaptureIndexWriter::indexFileName(outputFileName)))
+    {
+        writer.setIndexWriter(&indexWriter);
+    }
+
+    while (true)
+    {
+        // The input furthest behind in time, so that the others wait as briefly as possible
+        size_t next = numInputs;
+        for (size_t k = 0; k < numInputs; ++k)
+        {
+            const auto& input = *inputs[k];
+            if (!input.isDone()
+                && ((next == numInputs) || !input.hasTimestamp || (inputs[next]->hasTimestamp && (input.lastTimestamp < inputs[next]->lastTimestamp))))
+            {
+                next = k;
+            }
+        }
+        if (next == numInputs)
+        {
+            break;
+        }
+
+        auto& input = *inputs[next];
+        const size_t numBytes = static_cast<size_t>(std::min<uint64_t>(CHUNK_BYTES, input.file.size() - input.offset));
+        const auto lookaheadBytes = static_cast<size_t>(input.file.size() - input.offset - numBytes);
+        input.parser.parseRawStream(input.file.data() + input.offset, numBytes, lookaheadBytes);
+        input.offset += numBytes;
+        if (input.isDone())
+        {
+            input.parser.finish();
+            merger.setInputIdle(next, true);
+        }
+    }
+    merger.flush();
+
+    writer.close();
+    indexWriter.close();
+
+    for (size_t k = 0; k < numInputs; ++k)
+    {
+        const auto& input = inputs[k];
+        std::printf("%s: %" PRIu64 " byte(s), %zu packet(s), %zu error byte(s), %zu rejected header(s), %" PRIu64 " late, "
+                    "%" PRIu64 " restart(s)\n",
+                    input->fileName.c_str(), input->file.size(), input->parser.receivedPackets(), input->parser.errorBytes(),
+                    input->parser.rejectedHeaders(), merger.latePackets(k), merger.restarts(k));
+    }
+    std::printf("%zu packet(s) written, %" PRIu64 " late, %" PRIu64 " written early (queue full)\n",
+                writer.writtenPackets(), merger.latePackets(), merger.forcedPackets());
+
+    if (writer.hasError() || indexWriter.hasError())
+    {
+        std::fprintf(stderr, "I/O error\n");
+        return 1;
+    }
+
+    return 0;
+}
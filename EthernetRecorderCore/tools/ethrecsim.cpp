@@ -0,0 +1,325 @@
+// Device simulator: emits the recorder stream (header plus frame, both interfaces) through a pseudo-terminal
+// that EthernetRecorderQt and eth-rec-cli open like the real COM port, or into a pipe or file.
+
+#include "streamgenerator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <termios.h>
+#include <unistd.h>
+
+
+namespace {
+
+volatile std::sig_atomic_t isStopRequested = 0;
+
+void handleSignal(int /*signal*/)
+{
+    isStopRequested = 1;
+}
+
+struct SimulatorConfig
+{
+    std::string outputFileName;         ///< Empty: pseudo-terminal
+    std::string linkName;               ///< Symlink to the pseudo-terminal
+    double packetsPerSecond{10000};
+    double bytesPerSecond{0};           ///< 0: limited by packetsPerSecond only
+    std::string mix{"imix"};
+    double corruptionRate{0};
+    double deviceDropRate{0};
+    uint8_t protocolVersion{2};
+    size_t batchBytes{0};               ///< 0: one record per frame
+    size_t burstPackets{1};
+    double telemetrySeconds{0};         ///< 0: no telemetry records
+    int networkInterface{-1};           ///< -1: both
+    double durationSeconds{0};          ///< 0: until interrupted
+    bool dropWhenBlocked{false};
+    uint32_t seed{1};
+};
+
+void usage(const char* program)
+{
+    std::fprintf(stderr,
+                 "Usage: %s [options]\n"
+                 "  -o, --output <file>           Write to a file, FIFO or '-' (stdout) instead of a pseudo-terminal\n"
+                 "  -l, --link <path>             Create a symlink to the pseudo-terminal\n"
+                 "  -r, --packets-per-second <n>  Average packet rate (default 10000)\n"
+                 "  -b, --bytes-per-second <n>    Limit the stream rate, headers included (default: unlimited)\n"
+                 "  -m, --mix <64|imix|1514>      Packet sizes (default imix)\n"
+                 "  -c, --corruption <rate>       Probability per frame of garbage or a cut-short frame (default 0)\n"
+                 "  -x, --device-drop <rate>      Probability per frame of a drop on the device, a sequence gap (default 0)\n"
+                 "  -p, --protocol <1|2>          Stream protocol version (default 2)\n"
+                 "  -a, --batch <bytes>           v2: pack each burst into batch records of up to this size (default: off)\n"
+                 "  -B, --burst <n>               Packets written back to back; the average rate is kept (default 1)\n"
+                 "  -t, --telemetry <seconds>     v2: device telemetry record interval in device time (default: off)\n"
+                 "  -i, --interface <0|1>         Frames of this network interface only, like one USB data channel (default: both)\n"
+                 "  -d, --duration <seconds>      Stop after this time (default: until interrupted)\n"
+                 "  -D, --drop                    Drop frames while the reader does not keep up, like the device\n"
+                 "  -s, --seed <n>                Random seed (default 1)\n",
+                 program);
+}
+
+bool parseArguments(int argc, char *argv[], SimulatorConfig& config)
+{
+    const option options[] = {
+        {"output", required_argument, nullptr, 'o'},
+        {"link", required_argument, nullptr, 'l'},
+        {"packets-per-second", required_argument, nullptr, 'r'},
+        {"bytes-per-second", required_argument, nullptr, 'b'},
+        {"mix", required_argument, nullptr, 'm'},
+        {"corruption", required_argument, nullptr, 'c'},
+        {"device-drop", required_argument, nullptr, 'x'},
+        {"protocol", required_argument, nullptr, 'p'},
+        {"batch", required_argument, nullptr, 'a'},
+        {"burst", required_argument, nullptr, 'B'},
+        {"telemetry", required_argument, nullptr, 't'},
+        {"interface", required_argument, nullptr, 'i'},
+        {"duration", required_argument, nullptr, 'd'},
+        {"drop", no_argument, nullptr, 'D'},
+        {"seed", required_argument, nullptr, 's'},
+        {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "o:l:r:b:m:c:x:p:a:B:t:i:d:Ds:", options, nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case 'o': config.outputFileName = optarg; break;
+        case 'l': config.linkName = optarg; break;
+        case 'r': config.packetsPerSecond = std::atof(optarg); break;
+        case 'b': config.bytesPerSecond = std::atof(optarg); break;
+        case 'm': config.mix = optarg; break;
+        case 'c': config.corruptionRate = std::atof(optarg); break;
+        case 'x': config.deviceDropRate = std::atof(optarg); break;
+        case 'p': config.protocolVersion = static_cast<uint8_t>(std::atoi(optarg)); break;
+        case 'a': config.batchBytes = std::strtoul(optarg, nullptr, 10); break;
+        case 'B': config.burstPackets = std::max(1UL, std::strtoul(optarg, nullptr, 10)); break;
+        case 't': config.telemetrySeconds = std::atof(optarg); break;
+        case 'i': config.networkInterface = std::atoi(optarg); break;
+        case 'd': config.durationSeconds = std::atof(optarg); break;
+        case 'D': config.dropWhenBlocked = true; break;
+        case 's': config.seed = static_cast<uint32_t>(std::strtoul(optarg, nullptr, 10)); break;
+        default: return false;
+        }
+    }
+
+    if ((optind != argc) || (config.packetsPerSecond <= 0) || (config.protocolVersion < 1) || (config.protocolVersion > 2) || (config.networkInterface >= static_cast<int>(ETH_REC_MAX_NETWORK_INTERFACES)) || ((config.mix != "64") && (config.mix != "imix") && (config.mix != "1514")))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/// Master side of a new pseudo-terminal in raw mode. The slave stays open as well, so that writes do not fail
+/// while no reader is connected.
+int openPseudoTerminal(std::string& slaveName, int& slaveFd)
+{
+    const int masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((masterFd < 0) || (grantpt(masterFd) != 0) || (unlockpt(masterFd) != 0) || (ptsname(masterFd) == nullptr))
+    {
+        return -1;
+    }
+    slaveName = ptsname(masterFd);
+
+    slaveFd = open(slaveName.c_str(), O_RDWR | O_NOCTTY);
+    if (slaveFd < 0)
+    {
+        close(masterFd);
+        return -1;
+    }
+
+    termios attributes;
+    if (tcgetattr(slaveFd, &attributes) == 0)
+    {
+        cfmakeraw(&attributes);
+        tcsetattr(slaveFd, TCSANOW, &attributes);
+    }
+
+    return masterFd;
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    SimulatorConfig config;
+    if (!parseArguments(argc, argv, config))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = -1;
+    int slaveFd = -1;
+    if (config.outputFileName.empty())
+    {
+        std::string slaveName;
+        fd = openPseudoTerminal(slaveName, slaveFd);
+        if (fd < 0)
+        {
+            std::fprintf(stderr, "Cannot open a pseudo-terminal: %s\n", strerror(errno));
+            return 1;
+        }
+
+        if (!config.linkName.empty())
+        {
+            unlink(config.linkName.c_str());
+            if (symlink(slaveName.c_str(), config.linkName.c_str()) != 0)
+            {
+                std::fprintf(stderr, "Cannot create %s: %s\n", config.linkName.c_str(), strerror(errno));
+                return 1;
+            }
+        }
+
+        std::printf("Port: %s\n", config.linkName.empty()? slaveName.c_str() : config.linkName.c_str());
+        std::fflush(stdout);
+    }
+    else if (config.outputFileName == "-")
+    {
+        fd = STDOUT_FILENO;
+    }
+    else
+    {
+        fd = open(config.outputFileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            std::fprintf(stderr, "Cannot open %s: %s\n", config.outputFileName.c_str(), strerror(errno));
+            return 1;
+        }
+    }
+
+    if (config.dropWhenBlocked)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    std::signal(SIGINT, handleSignal);
+    std::signal(SIGTERM, handleSignal);
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<StreamGenerator::PacketSize> sizes = StreamGenerator::imix();
+    if (config.mix == "64")
+    {
+        sizes = {{64, 1}};
+    }
+    else if (config.mix == "1514")
+    {
+        sizes = {{1514, 1}};
+    }
+
+    StreamGenerator generator(sizes, config.seed);
+    generator.setCorruptionRate(config.corruptionRate);
+    generator.setDropRate(config.deviceDropRate);
+    generator.setProtocolVersion(config.protocolVersion);
+    generator.setBatchBytes(config.batchBytes);
+    generator.setPacketIntervalNs(static_cast<uint64_t>(1e9 / config.packetsPerSecond));
+    generator.setTelemetryIntervalNs(static_cast<uint64_t>(1e9 * config.telemetrySeconds));
+    generator.setNetworkInterface(config.networkInterface);
+
+    using Clock = std::chrono::steady_clock;
+    const auto startTime = Clock::now();
+    auto statTime = startTime;
+
+    uint64_t bytesGenerated = 0;
+    uint64_t bytesWritten = 0;
+    uint64_t droppedBursts = 0;
+    std::vector<uint8_t> buffer;
+    bool isOk = true;
+
+    while (!isStopRequested)
+    {
+        // Pace by whichever of the two rates is the tighter one
+        double dueSeconds = generator.generatedFrames() / config.packetsPerSecond;
+        if (config.bytesPerSecond > 0)
+        {
+            dueSeconds = std::max(dueSeconds, bytesGenerated / config.bytesPerSecond);
+        }
+        if ((config.durationSeconds > 0) && (dueSeconds >= config.durationSeconds))
+        {
+            break;
+        }
+        std::this_thread::sleep_until(startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(dueSeconds)));
+
+        buffer.clear();
+        for (size_t k = 0; k < config.burstPackets; ++k)
+        {
+            generator.appendFrame(buffer);
+        }
+        generator.flush(buffer);
+        bytesGenerated += buffer.size();
+
+        size_t offset = 0;
+        while (offset < buffer.size())
+        {
+            const ssize_t numBytes = write(fd, buffer.data() + offset, buffer.size() - offset);
+            if (numBytes > 0)
+            {
+                offset += static_cast<size_t>(numBytes);
+            }
+            else if ((numBytes < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) && config.dropWhenBlocked)
+            {
+                // The rest of the burst is lost, as in the device when the USB FIFO is full
+                ++droppedBursts;
+                break;
+            }
+            else if ((numBytes < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+            else
+            {
+                std::fprintf(stderr, "Write error: %s\n", strerror(errno));
+                isOk = false;
+                break;
+            }
+        }
+        bytesWritten += offset;
+        if (!isOk)
+        {
+            break;
+        }
+
+        const auto now = Clock::now();
+        if (now - statTime >= std::chrono::seconds(1))
+        {
+            statTime = now;
+            const double duration = std::chrono::duration<double>(now - startTime).count();
+            std::fprintf(stderr, "%.1f s: %zu packet(s), %zu corrupted, %zu dropped on the device, %llu byte(s) written (%.1f KB/s), %llu byte(s) dropped in %llu burst(s)\n",
+                         duration, generator.generatedFrames(), generator.corruptedFrames(), generator.droppedFrames(),
+                         static_cast<unsigned long long>(bytesWritten), bytesWritten / (duration * 1024),
+                         static_cast<unsigned long long>(bytesGenerated - bytesWritten), static_cast<unsigned long long>(droppedBursts));
+        }
+    }
+
+    std::fprintf(stderr, "%zu packet(s), %zu corrupted, %zu dropped on the device, %llu byte(s) written, %llu byte(s) dropped\n",
+                 generator.generatedFrames(), generator.corruptedFrames(), generator.droppedFrames(),
+                 static_cast<unsigned long long>(bytesWritten), static_cast<unsigned long long>(bytesGenerated - bytesWritten));
+
+    if (slaveFd >= 0)
+    {
+        close(slaveFd);
+    }
+    if (fd != STDOUT_FILENO)
+    {
+        close(fd);
+    }
+    if (!config.linkName.empty())
+    {
+        unlink(config.linkName.c_str());
+    }
+
+    return isOk? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// Per-interface statistics of a raw stream or pcapng capture, computed on all cores
+
+#include "capturescanner.h"
+#include "devicetelemetry.h"
+
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+namespace {
+
+struct InterfaceStats
+{
+    uint64_t packets{0};
+    uint64_t bytes{0};
+    uint64_t minTimestamp{UINT64_MAX};
+    uint64_t maxTimestamp{0};
+    uint16_t minPacketBytes{UINT16_MAX};
+    uint16_t maxPacketBytes{0};
+
+    void merge(const InterfaceStats& other)
+    {
+        packets += other.packets;
+        bytes += other.bytes;
+        minTimestamp = std::min(minTimestamp, other.minTimestamp);
+        maxTimestamp = std::max(maxTimestamp, other.maxTimestamp);
+        minPacketBytes = std::min(minPacketBytes, other.minPacketBytes);
+        maxPacketBytes = std::max(maxPacketBytes, other.maxPacketBytes);
+    }
+
+    bool operator==(const InterfaceStats& other) const
+    {
+        return (packets == other.packets) && (bytes == other.bytes) && (minTimestamp == other.minTimestamp) &&
+               (maxTimestamp == other.maxTimestamp) && (minPacketBytes == other.minPacketBytes) &&
+               (maxPacketBytes == other.maxPacketBytes);
+    }
+};
+
+/// Interfaces beyond the device ones are summed up in the last entry
+using CaptureStats = std::array<InterfaceStats, ETH_REC_MAX_NETWORK_INTERFACES + 1>;
+
+class StatsSink : public PacketSink
+{
+public:
+    void processPacket(const EthRecHeader& header, const uint8_t* /*data*/) override
+    {
+        auto& stats = stats_[std::min<size_t>(header.networkInterface, ETH_REC_MAX_NETWORK_INTERFACES)];
+        ++stats.packets;
+        stats.bytes += header.numBytes;
+        stats.minTimestamp = std::min(stats.minTimestamp, header.timestamp);
+        stats.maxTimestamp = std::max(stats.maxTimestamp, header.timestamp);
+        stats.minPacketBytes = std::min(stats.minPacketBytes, header.numBytes);
+        stats.maxPacketBytes = std::max(stats.maxPacketBytes, header.numBytes);
+    }
+
+    const CaptureStats& stats() const {return stats_;}
+
+private:
+    CaptureStats stats_;
+};
+
+CaptureScanStats scanFile(CaptureScanner& scanner, CaptureStats& totals)
+{
+    return scanner.scan([](){return std::make_unique<StatsSink>();},
+                        [&totals](PacketSink& chunkSink){
+        const auto& chunkStats = static_cast<StatsSink&>(chunkSink).stats();
+        for (size_t k = 0; k < totals.size(); ++k)
+        {
+            totals[k].merge(chunkStats[k]);
+        }
+    });
+}
+
+/// The results must not depend on where the chunks start; small odd sizes put many boundaries into records
+bool checkChunkSizes(const char* fileName, size_t numThreads, const CaptureScanStats& scanStats, const CaptureStats& totals)
+{
+    const size_t chunkSizes[] = {1024 * 1024, 200000, 65536 + 4096 + 1};
+    bool isEqual = true;
+    for (const size_t chunkBytes : chunkSizes)
+    {
+        CaptureScanner scanner(numThreads, chunkBytes);
+        if (!scanner.open(fileName))
+        {
+            return false;
+        }
+
+        CaptureStats chunkTotals;
+        const auto chunkStats = scanFile(scanner, chunkTotals);
+        if ((chunkStats.receivedPackets != scanStats.receivedPackets) || (chunkStats.errorBytes != scanStats.errorBytes) ||
+            (chunkStats.rejectedHeaders != scanStats.rejectedHeaders) || (chunkStats.lostFrames != scanStats.lostFrames) ||
+            (chunkStats.telemetry.size() != scanStats.telemetry.size()) || (chunkTotals != totals))
+        {
+            std::printf("%zu byte chunks: %" PRIu64 " packet(s), %" PRIu64 " error byte(s), %" PRIu64 " rejected header(s), "
+                        "%" PRIu64 " lost frame(s) - MISMATCH\n",
+                        chunkBytes, chunkStats.receivedPackets, chunkStats.errorBytes, chunkStats.rejectedHeaders,
+                        chunkStats.lostFrames);
+            isEqual = false;
+        }
+    }
+    return isEqual;
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    const char* program = argv[0];
+    const bool checkChunks = (argc > 1) && (std::strcmp(argv[1], "--check-chunks") == 0);
+    if (checkChunks)
+    {
+        --argc;
+        ++argv;
+    }
+    if ((argc < 2) || (argc > 3))
+    {
+        std::fprintf(stderr, "Usage: %s [--check-chunks] <capture> [threads]\n"
+                             "  --check-chunks  Scan again in small chunks; exit with 1 if the results differ\n",
+                     program);
+        return 1;
+    }
+
+    const size_t numThreads = (argc == 3)? std::strtoul(argv[2], nullptr, 10) : 0;
+    CaptureScanner scanner(numThreads);
+    if (!scanner.open(argv[1]))
+    {
+        std::fprintf(stderr, "Cannot open %s\n", argv[1]);
+        return 1;
+    }
+
+    CaptureStats totals;
+    const auto scanStats = scanFile(scanner, totals);
+
+    std::printf("%s: %s, %" PRIu64 " byte(s), %" PRIu64 " packet(s), %" PRIu64 " error byte(s), %" PRIu64 " rejected header(s), "
+                "%" PRIu64 " lost frame(s), %zu thread(s)\n",
+                argv[1], (scanner.format() == CaptureScanner::FORMAT_PCAPNG)? "pcapng" : "raw stream", scanner.fileBytes(),
+                scanStats.receivedPackets, scanStats.errorBytes, scanStats.rejectedHeaders, scanStats.lostFrames, scanner.numThreads());
+
+    for (size_t k = 0; k < totals.size(); ++k)
+    {
+        const auto& stats = totals[k];
+        if (stats.packets == 0)
+        {
+            continue;
+        }
+
+        const double duration = (stats.maxTimestamp - stats.minTimestamp) * 1e-9;
+        std::printf("%s%zu: %" PRIu64 " packet(s), %" PRIu64 " byte(s), %u..%u byte(s) per packet, %.6f s",
+                    (k < ETH_REC_MAX_NETWORK_INTERFACES)? "eth" : "other >= eth", k, stats.packets, stats.bytes,
+                    stats.minPacketBytes, stats.maxPacketBytes, duration);
+        if (duration > 0)
+        {
+            std::printf(" (%.1f packet(s)/s, %.1f KB/s)", stats.packets / duration, stats.bytes / (duration * 1024));
+        }
+        std::printf("\n");
+    }
+
+    // Device telemetry (raw streams only): which of the lost frames the device dropped itself
+    TelemetryTracker tracker;
+    for (const auto& telemetry : scanStats.telemetry)
+    {
+        tracker.addRecord(telemetry);
+    }
+    if (tracker.hasTelemetry())
+    {
+        const auto& totals = tracker.totals();
+        const auto& last = tracker.lastRecord().counters;
+        const uint64_t deviceDrops = totals.deviceDroppedFrames();
+        std::printf("device: %zu telemetry record(s), %" PRIu64 " dropped frame(s) (ring full %" PRIu64 ", USB %" PRIu64 "), "
+                    "%" PRIu64 " lost after the device, %" PRIu64 " USB stall(s) (%" PRIu64 " ms), %" PRIu64 " restart(s)\n",
+                    tracker.numRecords(), deviceDrops, totals.ringFullDrops, totals.usbDroppedFrames,
+                    (scanStats.lostFrames > deviceDrops)? scanStats.lostFrames - deviceDrops : 0,
+                    totals.usbStalls, totals.usbStallUs / 1000, totals.deviceRestarts);
+        std::printf("device, last record: CPU %.2f %%, ring %u byte(s) with at least %u free, %u pbuf(s) held at most, "
+                    "%u cut, %u filtered, %u zero-copy fallback(s)\n",
+                    last.cpuLoad * 0.01, last.ringBytes, last.ringMinFreeBytes, last.maxHeldPbufs,
+                    last.cutFrames, last.filteredFrames, last.zeroCopyFallbacks);
+    }
+
+    if (checkChunks && !checkChunkSizes(argv[1], numThreads, scanStats, totals))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,429 @@
+#include "captureengine.h"
+
+#include <algorithm>
+
+
+namespace {
+
+constexpr size_t RING_BYTES = 16 * 1024 * 1024;
+constexpr auto IDLE_WAIT = std::chrono::milliseconds(1);
+constexpr size_t MAX_PENDING_SEQUENCE_GAPS = 1000;
+
+/// A port without data for this long does not hold back the packets of the other one
+constexpr auto IDLE_CHANNEL_TIME = std::chrono::milliseconds(200);
+
+constexpr auto LATENCY_PUBLISH_INTERVAL = std::chrono::milliseconds(250);
+
+int64_t utcTimeNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void addTotals(TelemetryTotals& totals, const TelemetryTotals& channelTotals)
+{
+    totals.ringFullDrops += channelTotals.ringFullDrops;
+    totals.usbDroppedFrames += channelTotals.usbDroppedFrames;
+    totals.usbDiscardedBytes += channelTotals.usbDiscardedBytes;
+    totals.usbStalls += channelTotals.usbStalls;
+    totals.usbStallUs += channelTotals.usbStallUs;
+    totals.cutFrames += channelTotals.cutFrames;
+    totals.filteredFrames += channelTotals.filteredFrames;
+    totals.zeroCopyFallbacks += channelTotals.zeroCopyFallbacks;
+    totals.deviceRestarts = std::max(totals.deviceRestarts, channelTotals.deviceRestarts);
+}
+
+/// The channels of one device send their telemetry at the same interval, so samples are paired from the newest.
+/// The CPU load is the device's, the rest is per channel.
+void addSample(TelemetrySample& sample, const TelemetrySample& channelSample)
+{
+    sample.usbBytesPerSecond += channelSample.usbBytesPerSecond;
+    sample.droppedFramesPerSecond += channelSample.droppedFramesPerSecond;
+    sample.cpuLoad = std::max(sample.cpuLoad, channelSample.cpuLoad);
+    sample.ringPeakUsage = std::max(sample.ringPeakUsage, channelSample.ringPeakUsage);
+    sample.maxHeldPbufs += channelSample.maxHeldPbufs;
+}
+
+}   // anonymous namespace
+
+
+CaptureEngine::CaptureEngine(QObject *parent)
+    : QObject(parent)
+{
+    createChannel(0);
+}
+
+CaptureEngine::~CaptureEngine()
+{
+    stop();
+
+    for (auto& channel : channels_)
+    {
+        if (channel)
+        {
+            channel->readerThread.quit();
+            channel->readerThread.wait();
+        }
+    }
+}
+
+void CaptureEngine::createChannel(size_t index)
+{
+    channels_[index] = std::make_unique<Channel>(RING_BYTES, clockCorrelator_);
+    auto& channel = *channels_[index];
+
+    channel.serialReader = new SerialReader(channel.ring, channel.readerCounters);
+    channel.serialReader->moveToThread(&channel.readerThread);
+    connect(&channel.readerThread, &QThread::finished, channel.serialReader, &QObject::deleteLater);
+    connect(channel.serialReader, &SerialReader::errorOccurred, this, &CaptureEngine::errorOccurred);
+
+    channel.parser.setSequenceGapCallback([this](const SequenceGap& gap){
+        std::lock_guard<std::mutex> lock(sequenceGapMutex_);
+        if (sequenceGaps_.size() < MAX_PENDING_SEQUENCE_GAPS)
+        {
+            sequenceGaps_.push_back(gap);
+        }
+    });
+
+    channel.parser.setTelemetryCallback([this, &channel](const DeviceTelemetry& telemetry){
+        // Stamped when the record was sent, so its delay is the shortest in the stream
+        clockCorrelator_.addSample(telemetry.timestamp, channel.clockSampler.arrivalTime());
+
+        std::lock_guard<std::mutex> lock(telemetryMutex_);
+        channel.telemetryTracker.addRecord(telemetry);
+    });
+
+    channel.readerThread.setObjectName((index == 0)? QString("SerialReader") : QString("SerialReader%1").arg(index + 1));
+    channel.readerThread.start(QThread::TimeCriticalPriority);
+}
+
+void CaptureEngine::start(const QString& portName, const QString& portName2)
+{
+    if (isRunning())
+    {
+        return;
+    }
+
+    numChannels_ = portName2.isEmpty()? 1 : 2;
+    if ((numChannels_ > 1) && !channels_[1])
+    {
+        createChannel(1);
+    }
+
+    // With one port, the packets go straight from the parser to the sink
+    frameMerger_.reset();
+    frameMerger_.setSink(packetSink_);
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        auto& channel = *channels_[k];
+        channel.parser.reset();
+        channel.parser.setSink(&channel.clockSampler);
+        channel.clockSampler.setSink((numChannels_ > 1)? frameMerger_.input(k) : packetSink_);
+        channel.clockSampler.setLatencyTracker(latencyTracker());
+        frameMerger_.setInputSource(k, &channel.parser);
+        channel.ring.resetHighWaterMark();
+        resetTelemetry(k);
+    }
+    clockCorrelator_.reset();
+    latencyTracker_.reset();
+    publishParserCounters();
+    publishLatency(true);
+    takeSequenceGaps();
+
+    stopRequested_ = false;
+    parserThread_ = std::thread(&CaptureEngine::parserLoop, this);
+
+    const QString portNames[MAX_CHANNELS] = {portName, portName2};
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        auto serialReader = channels_[k]->serialReader;
+        const QByteArray commands = (k == 0)? deviceCommands_ : QByteArray();
+        QMetaObject::invokeMethod(serialReader, [serialReader, portName = portNames[k], commands](){serialReader->start(portName, commands);}, Qt::QueuedConnection);
+    }
+}
+
+void CaptureEngine::stop()
+{
+    if (!isRunning())
+    {
+        return;
+    }
+
+    // Close the ports first, then let the parser thread drain the rings
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        auto serialReader = channels_[k]->serialReader;
+        QMetaObject::invokeMethod(serialReader, [serialReader](){serialReader->stop();}, Qt::BlockingQueuedConnection);
+    }
+
+    stopRequested_ = true;
+    parserThread_.join();
+}
+
+uint16_t CaptureEngine::originalBytes() const
+{
+    return (numChannels_ > 1)? frameMerger_.originalBytes() : channels_[0]->parser.originalBytes();
+}
+
+CaptureStats CaptureEngine::stats() const
+{
+    CaptureStats stats;
+    stats.isConnected = true;
+    int64_t firstRxTimeNs = 0;
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        const auto& channel = *channels_[k];
+        const auto& counters = channel.readerCounters;
+        stats.isConnected = stats.isConnected && counters.isConnected.load(std::memory_order_acquire);
+
+        const size_t bytesReceived = counters.bytesReceived.load(std::memory_order_relaxed);
+        stats.bytesReceived += bytesReceived;
+        stats.overflowBytes += counters.overflowBytes.load(std::memory_order_relaxed);
+        if (bytesReceived > 0)
+        {
+            const int64_t channelFirstRxTimeNs = counters.firstRxTimeNs.load(std::memory_order_relaxed);
+            firstRxTimeNs = (firstRxTimeNs == 0)? channelFirstRxTimeNs : std::min(firstRxTimeNs, channelFirstRxTimeNs);
+        }
+
+        stats.ringCapacity += channel.ring.capacity();
+        stats.ringUsedBytes += channel.ring.usedBytes();
+        stats.ringHighWaterMark += channel.ring.highWaterMark();
+    }
+    if (stats.bytesReceived > 0)
+    {
+        const auto firstRxTime = std::chrono::nanoseconds(firstRxTimeNs);
+        const auto now = std::chrono::steady_clock::now().time_since_epoch();
+        stats.duration = std::chrono::duration_cast<std::chrono::duration<double>>(now - firstRxTime).count();
+    }
+
+    stats.receivedPackets = receivedPackets_.load(std::memory_order_relaxed);
+    stats.errorBytes = errorBytes_.load(std::memory_order_relaxed);
+    stats.rejectedHeaders = rejectedHeaders_.load(std::memory_order_relaxed);
+    stats.lostFrames = lostFrames_.load(std::memory_order_relaxed);
+    stats.lateFrames = lateFrames_.load(std::memory_order_relaxed);
+    stats.mergeRestarts = mergeRestarts_.load(std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(clockMutex_);
+        stats.clock = clockEstimate_;
+    }
+
+    std::lock_guard<std::mutex> lock(telemetryMutex_);
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        const auto& tracker = channels_[k]->telemetryTracker;
+        stats.telemetryRecords += tracker.numRecords();
+        addTotals(stats.deviceTotals, tracker.totals());
+        if (!tracker.samples().empty())
+        {
+            if (stats.hasTelemetrySample)
+            {
+                addSample(stats.lastTelemetrySample, tracker.samples().back());
+            }
+            else
+            {
+                stats.hasTelemetrySample = true;
+                stats.lastTelemetrySample = tracker.samples().back();
+            }
+        }
+    }
+    return stats;
+}
+
+void CaptureEngine::resetRingHighWaterMark()
+{
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        channels_[k]->ring.resetHighWaterMark();
+    }
+}
+
+void CaptureEngine::parserLoop()
+{
+    const auto startTime = std::chrono::steady_clock::now();
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        auto& channel = *channels_[k];
+        channel.connectionId = channel.readerCounters.connectionId.load(std::memory_order_acquire);
+        channel.lastDataTime = startTime;
+        channel.isIdle = false;
+    }
+
+    while (true)
+    {
+        const bool isStopping = stopRequested_.load(std::memory_order_acquire);
+
+        bool hasData = false;
+        for (size_t k = 0; k < numChannels_; ++k)
+        {
+            hasData = parseChannel(k) || hasData;
+        }
+
+        if (!hasData)
+        {
+            if (isStopping)
+            {
+                break;
+            }
+
+            // A port without data must not hold back the packets of the other one for long
+            const auto now = std::chrono::steady_clock::now();
+            for (size_t k = 0; k < numChannels_; ++k)
+            {
+                auto& channel = *channels_[k];
+                if ((numChannels_ > 1) && !channel.isIdle && (now - channel.lastDataTime >= IDLE_CHANNEL_TIME))
+                {
+                    channel.isIdle = true;
+                    frameMerger_.setInputIdle(k, true);
+                }
+            }
+
+            std::this_thread::sleep_for(IDLE_WAIT);
+            continue;
+        }
+
+        publishParserCounters();
+        publishLatency(false);
+    }
+
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        channels_[k]->parser.finish();
+    }
+    frameMerger_.flush();
+    publishParserCounters();
+    publishLatency(true);
+}
+
+bool CaptureEngine::parseChannel(size_t index)
+{
+    auto& channel = *channels_[index];
+
+    size_t numBytes = 0;
+    auto data = channel.ring.readPointer(numBytes);
+    if (numBytes == 0)
+    {
+        return false;
+    }
+
+    // Stored before the bytes were committed, so every byte of the chunk had arrived by then
+    channel.clockSampler.setArrivalTime(channel.readerCounters.lastRxUtcNs.load(std::memory_order_relaxed));
+
+    const auto newConnectionId = channel.readerCounters.connectionId.load(std::memory_order_acquire);
+    if (newConnectionId != channel.connectionId)
+    {
+        // Reconnected: start over with fresh statistics. The device may have restarted with new timestamps, so the
+        // packets waiting for the other port go out first and the merge forgets the old timestamps.
+        channel.connectionId = newConnectionId;
+        channel.parser.finish();
+        frameMerger_.restart();
+        channel.parser.restart();
+        resetTelemetry(index);
+    }
+
+    if (channel.isIdle)
+    {
+        channel.isIdle = false;
+        frameMerger_.setInputIdle(index, false);
+    }
+    channel.lastDataTime = std::chrono::steady_clock::now();
+
+    if ((streamSink_ != nullptr) && (numChannels_ == 1))
+    {
+        streamSink_->processStream(data, numBytes);
+    }
+    channel.parser.parseRawStream(data, numBytes);
+    channel.ring.commitRead(numBytes);
+
+    if (isLatencyTracking_)
+    {
+        latencyTracker_.record(LatencyTracker::STAGE_READ_TO_PARSED, utcTimeNs() - channel.clockSampler.arrivalTime());
+    }
+    return true;
+}
+
+void CaptureEngine::publishParserCounters()
+{
+    size_t receivedPackets = 0;
+    size_t errorBytes = 0;
+    size_t rejectedHeaders = 0;
+    uint64_t lostFrames = 0;
+    for (size_t k = 0; k < numChannels_; ++k)
+    {
+        const auto& parser = channels_[k]->parser;
+        receivedPackets += parser.receivedPackets();
+        errorBytes += parser.errorBytes();
+        rejectedHeaders += parser.rejectedHeaders();
+        lostFrames += parser.lostFrames();
+    }
+
+    receivedPackets_.store(receivedPackets, std::memory_order_relaxed);
+    errorBytes_.store(errorBytes, std::memory_order_relaxed);
+    rejectedHeaders_.store(rejectedHeaders, std::memory_order_relaxed);
+    lostFrames_.store(lostFrames, std::memory_order_relaxed);
+    lateFrames_.store(frameMerger_.latePackets(), std::memory_order_relaxed);
+    mergeRestarts_.store(frameMerger_.restarts(), std::memory_order_relaxed);
+
+    if ((clockCorrelator_.numFits() != publishedClockFits_) || (clockCorrelator_.isValid() != isClockValidPublished_))
+    {
+        publishedClockFits_ = clockCorrelator_.numFits();
+        isClockValidPublished_ = clockCorrelator_.isValid();
+        std::lock_guard<std::mutex> lock(clockMutex_);
+        clockEstimate_ = clockCorrelator_.estimate();
+    }
+}
+
+void CaptureEngine::publishLatency(bool isForced)
+{
+    const auto now = std::chrono::steady_clock::now();
+    if (!isForced && (!isLatencyTracking_ || (now - lastLatencyPublish_ < LATENCY_PUBLISH_INTERVAL)))
+    {
+        return;
+    }
+
+    lastLatencyPublish_ = now;
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    latencySnapshot_ = latencyTracker_;
+}
+
+LatencyTracker CaptureEngine::latencySnapshot() const
+{
+    // Stopped: the writers may have recorded their last block since the parser thread ended
+    if (!isRunning())
+    {
+        return latencyTracker_;
+    }
+
+    std::lock_guard<std::mutex> lock(latencyMutex_);
+    return latencySnapshot_;
+}
+
+std::vector<SequenceGap> CaptureEngine::takeSequenceGaps()
+{
+    std::vector<SequenceGap> gaps;
+    std::lock_guard<std::mutex> lock(sequenceGapMutex_);
+    gaps.swap(sequenceGaps_);
+    return gaps;
+}
+
+std::vector<TelemetrySample> CaptureEngine::telemetrySamples() const
+{
+    std::lock_guard<std::mutex> lock(telemetryMutex_);
+    const auto& samples = channels_[0]->telemetryTracker.samples();
+    std::vector<TelemetrySample> combinedSamples(samples.begin(), samples.end());
+    for (size_t k = 1; k < numChannels_; ++k)
+    {
+        const auto& channelSamples = channels_[k]->telemetryTracker.samples();
+        const size_t numSamples = std::min(combinedSamples.size(), channelSamples.size());
+        combinedSamples.erase(combinedSamples.begin(), combinedSamples.end() - static_cast<std::ptrdiff_t>(numSamples));
+        for (size_t n = 0; n < numSamples; ++n)
+        {
+            addSample(combinedSamples[n], channelSamples[channelSamples.size() - numSamples + n]);
+        }
+    }
+    return combinedSamples;
+}
+
+void CaptureEngine::resetTelemetry(size_t index)
+{
+    std::lock_guard<std::mutex> lock(telemetryMutex_);
+    channels_[index]->telemetryTracker.reset();
+}
@@ -0,0 +1,186 @@
+#ifndef CAPTUREENGINE_H
+#define CAPTUREENGINE_H
+
+#include "serialreader.h"
+#include "clockcorrelator.h"
+#include "devicetelemetry.h"
+#include "framemerger.h"
+#include "latencytracker.h"
+#include "packetparser.h"
+#include "streamsink.h"
+#include "spscring.h"
+
+#include <QObject>
+#include <QThread>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// Snapshot of the capture counters, safe to take from any thread. With two ports, the counters are summed.
+struct CaptureStats
+{
+    bool isConnected{false};
+    double duration{0};                 ///< Seconds since the first received byte
+    size_t bytesReceived{0};
+    size_t overflowBytes{0};
+    size_t receivedPackets{0};
+    size_t errorBytes{0};
+    size_t rejectedHeaders{0};
+    uint64_t lostFrames{0};             ///< Sequence gaps reported by protocol v2
+    uint64_t lateFrames{0};             ///< Two ports: frames that came after newer ones of the other port were written
+    uint64_t mergeRestarts{0};          ///< Two ports: reconnects and device restarts, after which the merge started over
+    size_t ringCapacity{0};
+    size_t ringUsedBytes{0};
+    size_t ringHighWaterMark{0};
+
+    size_t telemetryRecords{0};         ///< Device telemetry, the rest is only valid if there were records
+    TelemetryTotals deviceTotals;
+    bool hasTelemetrySample{false};
+    TelemetrySample lastTelemetrySample{};
+
+    ClockEstimate clock;                ///< Device clock against the host clock
+};
+
+
+/// Capture pipeline: a reader thread owns the COM port and fills a lock-free ring, a parser thread drains the
+/// ring into the stream sink and the PacketParser. The sinks are called on the parser thread.
+/// With a second port (the second USB data channel of the device, see USB_DATA_CHANNELS in the firmware), each port
+/// gets its own reader thread, ring and parser; the parser thread merges the packets of both by timestamp.
+class CaptureEngine : public QObject, public PacketSource
+{
+    Q_OBJECT
+
+public:
+    explicit CaptureEngine(QObject *parent = nullptr);
+    ~CaptureEngine();
+
+    static constexpr size_t MAX_CHANNELS = 2;
+
+    /// Gets the stream as received, with one port only: with two ports it gets nothing, since a raw stream is that of
+    /// one port. Must be called while stopped.
+    void setStreamSink(StreamSink* sink) {streamSink_ = sink;}
+
+    /// Must be called while stopped
+    void setPacketSink(PacketSink* sink) {packetSink_ = sink;}
+
+    /// Written to the device on every connection, see devicecommand.h. Must be called while stopped.
+    void setDeviceCommands(const std::vector<uint8_t>& commands) {deviceCommands_ = QByteArray(reinterpret_cast<const char*>(commands.data()), static_cast<int>(commands.size()));}
+
+    /// For sinks that need the parser state of the first port, e.g. RawStreamIndexer
+    const PacketParser& packetParser() const {return channels_[0]->parser;}
+
+    /// Maps the device timestamps to UTC, fed with the arrival times of the data of all ports. For a HostTimestampSink
+    /// in front of the packet sink: to be used on the parser thread only.
+    const ClockCorrelator& clockCorrelator() const {return clockCorrelator_;}
+
+    /// Record the latency of the pipeline stages, see LatencyTracker. Must be called while stopped.
+    void setLatencyTracking(bool isEnabled) {isLatencyTracking_ = isEnabled;}
+
+    /// For the writers, see BlockFileWriter::setLatencyTracker(); nullptr unless latency tracking is enabled.
+    /// To be used on the parser thread only.
+    LatencyTracker* latencyTracker() {return isLatencyTracking_? &latencyTracker_ : nullptr;}
+
+    /// Copy of the latency histograms of the current or last capture, at most 250 ms old while running
+    LatencyTracker latencySnapshot() const;
+
+    /// Original length of the packet being delivered to the packet sink, see PcapngWriter::setPacketSource()
+    uint16_t originalBytes() const override;
+
+    /// \p portName2 (may be empty) carries the second USB data channel. The device commands go to the first port.
+    void start(const QString& portName, const QString& portName2 = QString());
+
+    void stop();
+
+    bool isRunning() const {return parserThread_.joinable();}
+
+    CaptureStats stats() const;
+
+    void resetRingHighWaterMark();
+
+    /// Sequence gaps since the last call, oldest first. Safe to call from any thread.
+    /// At most 1000 gaps are kept between two calls; CaptureStats::lostFrames counts all of them.
+    std::vector<SequenceGap> takeSequenceGaps();
+
+    /// History of the device telemetry rates, oldest first, with two ports those of both channels combined.
+    /// Safe to call from any thread.
+    std::vector<TelemetrySample> telemetrySamples() const;
+
+signals:
+    void errorOccurred(const QString& msg);
+
+private:
+    /// One COM port with its reader thread, ring and parser
+    struct Channel
+    {
+        Channel(size_t ringBytes, ClockCorrelator& clockCorrelator) : ring(ringBytes), clockSampler(clockCorrelator) {}
+
+        SpscByteRing ring;
+        ReaderCounters readerCounters;
+        QThread readerThread;
+        SerialReader* serialReader = nullptr;
+        PacketParser parser;
+        ClockSampler clockSampler;              ///< Between the parser and the merger or packet sink
+        TelemetryTracker telemetryTracker;      ///< Guarded by telemetryMutex_
+
+        // Parser thread
+        uint32_t connectionId{0};
+        std::chrono::steady_clock::time_point lastDataTime;
+        bool isIdle{false};
+    };
+
+    void createChannel(size_t index);
+
+    void parserLoop();
+
+    /// Parse the next chunk of the ring of channel \p index, false if there was none
+    bool parseChannel(size_t index);
+
+    void publishParserCounters();
+
+    /// At most every 250 ms unless \p isForced
+    void publishLatency(bool isForced);
+
+    void resetTelemetry(size_t index);
+
+    std::array<std::unique_ptr<Channel>, MAX_CHANNELS> channels_;
+    size_t numChannels_{1};                     ///< Of the current capture
+    QByteArray deviceCommands_;
+
+    std::thread parserThread_;
+    std::atomic<bool> stopRequested_{false};
+    FrameMerger frameMerger_{MAX_CHANNELS};     ///< Only with two ports
+    PacketSink* packetSink_ = nullptr;
+    StreamSink* streamSink_ = nullptr;
+
+    std::atomic<size_t> receivedPackets_{0};
+    std::atomic<size_t> errorBytes_{0};
+    std::atomic<size_t> rejectedHeaders_{0};
+    std::atomic<uint64_t> lostFrames_{0};
+    std::atomic<uint64_t> lateFrames_{0};
+    std::atomic<uint64_t> mergeRestarts_{0};
+
+    ClockCorrelator clockCorrelator_;           ///< Parser thread
+    uint64_t publishedClockFits_{0};
+    bool isClockValidPublished_{false};
+    mutable std::mutex clockMutex_;
+    ClockEstimate clockEstimate_;               ///< Guarded by clockMutex_
+
+    bool isLatencyTracking_{false};
+    LatencyTracker latencyTracker_;             ///< Parser thread
+    std::chrono::steady_clock::time_point lastLatencyPublish_;
+    mutable std::mutex latencyMutex_;
+    LatencyTracker latencySnapshot_;            ///< Guarded by latencyMutex_
+
+    std::mutex sequenceGapMutex_;
+    std::vector<SequenceGap> sequenceGaps_;
+
+    mutable std::mutex telemetryMutex_;
+};
+
+#endif // CAPTUREENGINE_H
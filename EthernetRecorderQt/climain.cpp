@@ -0,0 +1,216 @@
+#include "clirecorder.h"
+#include "devicecommand.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+
+#include <csignal>
+
+
+namespace {
+
+volatile std::sig_atomic_t stopRequested = 0;
+volatile std::sig_atomic_t triggerRequested = 0;
+
+void handleStopSignal(int)
+{
+    stopRequested = 1;
+}
+
+#ifdef SIGUSR1
+void handleTriggerSignal(int)
+{
+    triggerRequested = 1;
+}
+#endif
+
+double toDouble(const QCommandLineParser& parser, const QCommandLineOption& option)
+{
+    bool ok = false;
+    const double value = parser.value(option).toDouble(&ok);
+    if (!ok || (value < 0))
+    {
+        parser.showHelp(1);
+    }
+    return value;
+}
+
+uint64_t toNanoseconds(const QCommandLineParser& parser, const QCommandLineOption& option)
+{
+    return static_cast<uint64_t>(toDouble(parser, option) * 1e9);
+}
+
+uint64_t toBytes(const QCommandLineParser& parser, const QCommandLineOption& option)
+{
+    return static_cast<uint64_t>(toDouble(parser, option) * 1024 * 1024);
+}
+
+}   // anonymous namespace
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("eth-rec-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless Ethernet recorder");
+    parser.addHelpOption();
+
+    QCommandLineOption optionPort(QStringList() << "p" << "port", "COM port of the recorder.", "port");
+    QCommandLineOption optionPort2(QStringList() << "port2", "COM port of the second USB data channel, merged by timestamp (firmware built with USB_DATA_CHANNELS 2).", "port");
+    QCommandLineOption optionInterval(QStringList() << "i" << "interval", "Statistics interval in seconds (default: 1).", "seconds", "1");
+    QCommandLineOption optionOutput(QStringList() << "o" << "output", "Write the received stream as is, to be converted with eth-rec-convert later.", "file");
+    QCommandLineOption optionPreallocate(QStringList() << "preallocate", "Disk space to reserve for --output in MB (Linux only).", "MB", "0");
+    QCommandLineOption optionPcapng(QStringList() << "w" << "pcapng", "Write parsed packets to a pcapng file.", "file");
+    QCommandLineOption optionDeviceTime(QStringList() << "device-time", "Keep the device timestamps (since the device started) in the pcapng outputs instead of UTC.");
+    QCommandLineOption optionFileRing(QStringList() << "file-ring", "Write parsed packets to a ring of pcapng files <prefix>.<n>.pcapng.", "prefix");
+    QCommandLineOption optionFileRingSize(QStringList() << "file-ring-mb", "Size of each file in the file ring in MB (default: 1024).", "MB", "1024");
+    QCommandLineOption optionFileRingCount(QStringList() << "file-ring-count", "Number of files in the file ring (default: 8).", "count", "8");
+    QCommandLineOption optionRingSize(QStringList() << "ring-mb", "Keep the most recent packets in a memory ring of this size and dump them on trigger.", "MB");
+    QCommandLineOption optionRingAge(QStringList() << "ring-seconds", "Maximum age of the packets in the memory ring (default: unlimited).", "seconds", "0");
+    QCommandLineOption optionPreTrigger(QStringList() << "pre-trigger", "Seconds before the trigger to dump (default: 10).", "seconds", "10");
+    QCommandLineOption optionPostTrigger(QStringList() << "post-trigger", "Seconds after the trigger to dump (default: 5).", "seconds", "5");
+    QCommandLineOption optionDumpPrefix(QStringList() << "dump-prefix", "Trigger dumps are written to <prefix>-<n>.pcapng (default: trigger).", "prefix", "trigger");
+    QCommandLineOption optionTriggerEtherType(QStringList() << "trigger-ethertype", "Trigger on packets with this EtherType, e.g. 0x88f7. SIGUSR1 also triggers.", "type");
+    QCommandLineOption optionSnapLength(QStringList() << "snaplen", "Record at most this many bytes per frame on the device (default: whole frames).", "bytes", "0");
+    QCommandLineOption optionFilter(QStringList() << "filter", "Record only frames matching a rule on the device: ethertype=<type>, vlan=<id>, src=<mac>, dst=<mac> or mac=<mac>. "
+                                                               "May be repeated; a frame matching any rule is recorded.", "rule");
+    QCommandLineOption optionLatency(QStringList() << "latency", "Record the latency from the capture on the device to the disk write per stage and write the histograms to a JSON file on exit.", "file");
+    QCommandLineOption optionMatchLatency(QStringList() << "match-latency", "Match the frames of eth0 and eth1 (a tap around a device under test) and write the one-way latency per flow to a JSON file on exit.", "file");
+    parser.addOption(optionPort);
+    parser.addOption(optionPort2);
+    parser.addOption(optionInterval);
+    parser.addOption(optionOutput);
+    parser.addOption(optionPreallocate);
+    parser.addOption(optionPcapng);
+    parser.addOption(optionDeviceTime);
+    parser.addOption(optionFileRing);
+    parser.addOption(optionFileRingSize);
+    parser.addOption(optionFileRingCount);
+    parser.addOption(optionRingSize);
+    parser.addOption(optionRingAge);
+    parser.addOption(optionPreTrigger);
+    parser.addOption(optionPostTrigger);
+    parser.addOption(optionDumpPrefix);
+    parser.addOption(optionTriggerEtherType);
+    parser.addOption(optionSnapLength);
+    parser.addOption(optionFilter);
+    parser.addOption(optionLatency);
+    parser.addOption(optionMatchLatency);
+    parser.process(a);
+
+    if (!parser.isSet(optionPort))
+    {
+        parser.showHelp(1);
+    }
+
+    CliRecorderConfig config;
+    config.portName = parser.value(optionPort);
+    config.portName2 = parser.value(optionPort2);
+
+    const double interval = toDouble(parser, optionInterval);
+    if (interval <= 0)
+    {
+        parser.showHelp(1);
+    }
+    config.statIntervalMs = static_cast<int>(interval * 1000);
+
+    config.rawFileName = parser.value(optionOutput);
+    if (!config.rawFileName.isEmpty() && !config.portName2.isEmpty())
+    {
+        // The raw stream is the stream of one port
+        parser.showHelp(1);
+    }
+    config.preallocateBytes = toBytes(parser, optionPreallocate);
+    config.pcapngFileName = parser.value(optionPcapng);
+    config.isDeviceTime = parser.isSet(optionDeviceTime);
+    config.latencyFileName = parser.value(optionLatency);
+    config.matchLatencyFileName = parser.value(optionMatchLatency);
+
+    config.fileRingPrefix = parser.value(optionFileRing);
+    config.fileRingFileBytes = toBytes(parser, optionFileRingSize);
+    config.fileRingNumFiles = static_cast<size_t>(toDouble(parser, optionFileRingCount));
+    if (!config.fileRingPrefix.isEmpty() && ((config.fileRingFileBytes == 0) || (config.fileRingNumFiles == 0)))
+    {
+        parser.showHelp(1);
+    }
+
+    if (parser.isSet(optionRingSize))
+    {
+        config.captureRingBytes = static_cast<size_t>(toBytes(parser, optionRingSize));
+        config.captureRingMaxAgeNs = toNanoseconds(parser, optionRingAge);
+        config.preTriggerNs = toNanoseconds(parser, optionPreTrigger);
+        config.postTriggerNs = toNanoseconds(parser, optionPostTrigger);
+        config.dumpFilePrefix = parser.value(optionDumpPrefix);
+        if (config.captureRingBytes < 1024 * 1024)
+        {
+            parser.showHelp(1);
+        }
+
+        if (parser.isSet(optionTriggerEtherType))
+        {
+            bool ok = false;
+            const auto etherType = parser.value(optionTriggerEtherType).toUInt(&ok, 0);
+            if (!ok || (etherType > 0xFFFF))
+            {
+                parser.showHelp(1);
+            }
+            config.triggerEtherType = static_cast<int>(etherType);
+        }
+    }
+
+    bool ok = false;
+    const auto snapLength = parser.value(optionSnapLength).toUInt(&ok, 0);
+    if (!ok || (snapLength > 0xFFFF))
+    {
+        parser.showHelp(1);
+    }
+    config.snapLength = static_cast<uint16_t>(snapLength);
+
+    const auto filters = parser.values(optionFilter);
+    if (filters.size() > static_cast<int>(ETH_REC_MAX_CAPTURE_RULES))
+    {
+        parser.showHelp(1);
+    }
+    for (const auto& filter : filters)
+    {
+        EthRecCaptureRule rule;
+        if (!devicecommand::parseCaptureRule(filter.toStdString(), rule))
+        {
+            parser.showHelp(1);
+        }
+        config.captureRules.push_back(rule);
+    }
+
+    CliRecorder recorder(config);
+    if (!recorder.start())
+    {
+        return 1;
+    }
+
+    // Stop cleanly on Ctrl+C / service stop
+    std::signal(SIGINT, handleStopSignal);
+    std::signal(SIGTERM, handleStopSignal);
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, handleTriggerSignal);
+#endif
+    QTimer signalTimer;
+    QObject::connect(&signalTimer, &QTimer::timeout, &a, [&recorder](){
+        if (triggerRequested)
+        {
+            triggerRequested = 0;
+            recorder.trigger();
+        }
+
+        if (stopRequested)
+        {
+            recorder.stop();
+            QCoreApplication::quit();
+        }
+    });
+    signalTimer.start(100);
+
+    return a.exec();
+}
@@ -0,0 +1,347 @@
+#include "clirecorder.h"
+#include "devicecommand.h"
+
+#include <QTextStream>
+
+
+namespace {
+
+QTextStream& out()
+{
+    static QTextStream stream(stdout);
+    return stream;
+}
+
+QTextStream& err()
+{
+    static QTextStream stream(stderr);
+    return stream;
+}
+
+}   // anonymous namespace
+
+
+CliRecorder::CliRecorder(const CliRecorderConfig& config, QObject *parent)
+    : QObject(parent)
+    , config_(config)
+    , rawStreamIndexer_(captureEngine_.packetParser(), rawIndexWriter_)
+    , hostTimestampSink_(captureEngine_.clockCorrelator())
+{
+    connect(&statTimer_, &QTimer::timeout, this, &CliRecorder::printStat);
+    statTimer_.setInterval(config_.statIntervalMs);
+
+    connect(&captureEngine_, &CaptureEngine::errorOccurred, this, [](const QString& msg){
+        err() << msg << Qt::endl;
+    });
+}
+
+CliRecorder::~CliRecorder()
+{
+    stop();
+}
+
+bool CliRecorder::start()
+{
+    packetSinks_.clear();
+    hostTimeSinks_.clear();
+
+    captureEngine_.setLatencyTracking(!config_.latencyFileName.isEmpty());
+    rawStreamWriter_.setLatencyTracker(captureEngine_.latencyTracker());
+    pcapngWriter_.setLatencyTracker(captureEngine_.latencyTracker());
+
+    if (!config_.rawFileName.isEmpty())
+    {
+        if (!rawStreamWriter_.open(config_.rawFileName.toStdString(), config_.preallocateBytes))
+        {
+            err() << tr("Cannot open output file %1").arg(config_.rawFileName) << Qt::endl;
+            return false;
+        }
+        captureEngine_.setStreamSink(&rawStreamWriter_);
+
+        if (!rawIndexWriter_.open(CaptureIndexWriter::indexFileName(config_.rawFileName.toStdString())))
+        {
+            err() << tr("Cannot open index file for %1").arg(config_.rawFileName) << Qt::endl;
+            return false;
+        }
+        packetSinks_.addSink(&rawStreamIndexer_);
+    }
+
+    if (!config_.pcapngFileName.isEmpty())
+    {
+        if (!pcapngWriter_.open(config_.pcapngFileName.toStdString()))
+        {
+            err() << tr("Cannot open pcapng file %1").arg(config_.pcapngFileName) << Qt::endl;
+            return false;
+        }
+        if (!pcapngIndexWriter_.open(CaptureIndexWriter::indexFileName(config_.pcapngFileName.toStdString())))
+        {
+            err() << tr("Cannot open index file for %1").arg(config_.pcapngFileName) << Qt::endl;
+            return false;
+        }
+        pcapngWriter_.setIndexWriter(&pcapngIndexWriter_);
+        pcapngWriter_.setPacketSource(&captureEngine_);
+        hostTimeSinks_.addSink(&pcapngWriter_);
+    }
+
+    if (!config_.fileRingPrefix.isEmpty())
+    {
+        fileRing_ = std::make_unique<PcapngFileRing>(config_.fileRingPrefix.toStdString(), config_.fileRingFileBytes, config_.fileRingNumFiles);
+        if (!fileRing_->open())
+        {
+            err() << tr("Cannot open file ring %1").arg(config_.fileRingPrefix) << Qt::endl;
+            return false;
+        }
+        fileRing_->setPacketSource(&captureEngine_);
+        fileRing_->setLatencyTracker(captureEngine_.latencyTracker());
+        hostTimeSinks_.addSink(fileRing_.get());
+    }
+
+    if (config_.captureRingBytes > 0)
+    {
+        captureRing_ = std::make_unique<CaptureRing>(config_.captureRingBytes, config_.captureRingMaxAgeNs);
+        captureRing_->setDumpFilePrefix(config_.dumpFilePrefix.toStdString());
+        captureRing_->setTriggerWindow(config_.preTriggerNs, config_.postTriggerNs);
+        captureRing_->setPacketSource(&captureEngine_);
+        if (config_.triggerEtherType >= 0)
+        {
+            const auto etherType = static_cast<uint16_t>(config_.triggerEtherType);
+            captureRing_->setTriggerFilter([etherType](const EthRecHeader& header, const uint8_t* data){
+                constexpr size_t etherTypeOffset = 12;
+                constexpr uint16_t vlanTag = 0x8100;
+                size_t offset = etherTypeOffset;
+                while (offset + 2 <= header.numBytes)
+                {
+                    const uint16_t value = static_cast<uint16_t>((data[offset] << 8) | data[offset + 1]);
+                    if (value != vlanTag)
+                    {
+                        return value == etherType;
+                    }
+                    offset += 4;    // Skip the VLAN tag
+                }
+                return false;
+            });
+        }
+        hostTimeSinks_.addSink(captureRing_.get());
+    }
+
+    frameMatcher_.reset();
+    if (!config_.matchLatencyFileName.isEmpty())
+    {
+        frameMatcher_ = std::make_unique<FrameMatcher>();
+        packetSinks_.addSink(frameMatcher_.get());
+    }
+
+    // The raw stream index stays in device time, like the stream itself
+    if (!hostTimeSinks_.isEmpty())
+    {
+        if (config_.isDeviceTime)
+        {
+            packetSinks_.addSink(&hostTimeSinks_);
+        }
+        else
+        {
+            hostTimestampSink_.reset();
+            hostTimestampSink_.setSink(&hostTimeSinks_);
+            packetSinks_.addSink(&hostTimestampSink_);
+        }
+    }
+
+    // Always sent, so that the device drops the configuration of an earlier session
+    std::vector<uint8_t> deviceCommands;
+    devicecommand::appendClearRules(deviceCommands, ETH_REC_ALL_INTERFACES);
+    devicecommand::appendSnapLength(deviceCommands, ETH_REC_ALL_INTERFACES, config_.snapLength);
+    for (const auto& rule : config_.captureRules)
+    {
+        devicecommand::appendCaptureRule(deviceCommands, ETH_REC_ALL_INTERFACES, rule);
+    }
+    captureEngine_.setDeviceCommands(deviceCommands);
+
+    captureEngine_.setPacketSink(packetSinks_.isEmpty()? nullptr : &packetSinks_);
+    captureEngine_.start(config_.portName, config_.portName2);
+    statTimer_.start();
+
+    return true;
+}
+
+void CliRecorder::stop()
+{
+    statTimer_.stop();
+    captureEngine_.stop();
+
+    if (rawStreamWriter_.isOpen())
+    {
+        rawStreamWriter_.close();
+        rawIndexWriter_.close();
+        if (rawStreamWriter_.hasError() || rawIndexWriter_.hasError())
+        {
+            err() << tr("Writing %1 failed").arg(config_.rawFileName) << Qt::endl;
+        }
+    }
+
+    if (pcapngWriter_.isOpen())
+    {
+        pcapngWriter_.close();
+        pcapngIndexWriter_.close();
+        if (pcapngWriter_.hasError() || pcapngIndexWriter_.hasError())
+        {
+            err() << tr("Writing %1 failed").arg(config_.pcapngFileName) << Qt::endl;
+        }
+    }
+
+    if (fileRing_ && fileRing_->isOpen())
+    {
+        fileRing_->close();
+        if (fileRing_->hasError())
+        {
+            err() << tr("Writing file ring %1 failed").arg(config_.fileRingPrefix) << Qt::endl;
+        }
+    }
+
+    if (captureRing_)
+    {
+        captureRing_->finishDump();
+        if (captureRing_->hasDumpError())
+        {
+            err() << tr("Writing trigger dumps %1 failed").arg(config_.dumpFilePrefix) << Qt::endl;
+        }
+    }
+
+    if (frameMatcher_)
+    {
+        frameMatcher_->flush();
+        out() << tr("eth0/eth1: %1 frame(s) matched, %2/%3 unmatched")
+                 .arg(frameMatcher_->matchedFrames())
+                 .arg(frameMatcher_->unmatchedFrames(0))
+                 .arg(frameMatcher_->unmatchedFrames(1));
+        for (size_t direction = 0; direction < 2; ++direction)
+        {
+            const auto& histogram = frameMatcher_->latency(direction);
+            out() << tr(", %1 latency p50/p99/max %2/%3/%4 us")
+                     .arg((direction == 0)? "eth0 > eth1" : "eth1 > eth0")
+                     .arg(histogram.percentile(50) / 1000.0, 0, 'f', 1)
+                     .arg(histogram.percentile(99) / 1000.0, 0, 'f', 1)
+                     .arg(histogram.max() / 1000.0, 0, 'f', 1);
+        }
+        out() << Qt::endl;
+        if (!frameMatcher_->writeJson(config_.matchLatencyFileName.toStdString()))
+        {
+            err() << tr("Writing %1 failed").arg(config_.matchLatencyFileName) << Qt::endl;
+        }
+        frameMatcher_.reset();
+    }
+
+    // After the writers are closed, so that their last blocks count
+    if (!config_.latencyFileName.isEmpty() && !captureEngine_.latencySnapshot().writeJson(config_.latencyFileName.toStdString()))
+    {
+        err() << tr("Writing %1 failed").arg(config_.latencyFileName) << Qt::endl;
+    }
+}
+
+void CliRecorder::trigger()
+{
+    if (captureRing_)
+    {
+        captureRing_->trigger();
+        out() << tr("Trigger") << Qt::endl;
+    }
+}
+
+void CliRecorder::printStat()
+{
+    const auto stats = captureEngine_.stats();
+    if (!stats.isConnected)
+    {
+        out() << tr("%1: disconnected").arg(portLabel()) << Qt::endl;
+        return;
+    }
+
+    const double speed = (stats.duration > 0)? stats.bytesReceived / (stats.duration * 1024) : 0;
+
+    for (const auto& gap : captureEngine_.takeSequenceGaps())
+    {
+        out() << tr("eth%1: %2 frame(s) lost before sequence %3 (timestamp %4 ns, stream offset %5)")
+                 .arg(gap.networkInterface)
+                 .arg(gap.lostFrames)
+                 .arg(gap.receivedSequence)
+                 .arg(gap.timestamp)
+                 .arg(gap.streamOffset)
+              << Qt::endl;
+    }
+
+    out() << tr("%1: duration %2 s, %3 byte(s) received (%4 KB/s), %5 packet(s), %6 error byte(s), %7 rejected header(s), "
+                "%8 lost frame(s), ring high-water %9 KB, %10 overflow byte(s), %11 byte(s) written")
+             .arg(portLabel())
+             .arg(stats.duration, 0, 'f', 1)
+             .arg(stats.bytesReceived)
+             .arg(speed, 0, 'f', 1)
+             .arg(stats.receivedPackets)
+             .arg(stats.errorBytes)
+             .arg(stats.rejectedHeaders)
+             .arg(stats.lostFrames)
+             .arg(stats.ringHighWaterMark / 1024)
+             .arg(stats.overflowBytes)
+             .arg(rawStreamWriter_.bytesWritten());
+    if (captureRing_)
+    {
+        out() << tr(", %1 trigger dump(s)").arg(captureRing_->writtenDumps());
+    }
+    if (!config_.portName2.isEmpty())
+    {
+        out() << tr(", %1 late frame(s) in the merge, %2 restart(s)").arg(stats.lateFrames).arg(stats.mergeRestarts);
+    }
+    if (stats.clock.numWindows > 0)
+    {
+        out() << tr(", device clock %1 ppm, UTC error %2 us").arg(stats.clock.driftPpm, 0, 'f', 2).arg(stats.clock.errorNs / 1000, 0, 'f', 1);
+    }
+    out() << Qt::endl;
+
+    if (stats.telemetryRecords > 0)
+    {
+        // Sequence gaps the device does not account for were lost on USB or in the host
+        const auto& totals = stats.deviceTotals;
+        const uint64_t deviceDrops = totals.deviceDroppedFrames();
+        out() << tr("%1: device dropped %2 frame(s) (ring full %3, USB %4), %5 lost after the device, %6 USB stall(s) (%7 ms), "
+                    "%8 cut, %9 filtered")
+                 .arg(portLabel())
+                 .arg(deviceDrops)
+                 .arg(totals.ringFullDrops)
+                 .arg(totals.usbDroppedFrames)
+                 .arg((stats.lostFrames > deviceDrops)? stats.lostFrames - deviceDrops : 0)
+                 .arg(totals.usbStalls)
+                 .arg(totals.usbStallUs / 1000)
+                 .arg(totals.cutFrames)
+                 .arg(totals.filteredFrames);
+        if (stats.hasTelemetrySample)
+        {
+            const auto& sample = stats.lastTelemetrySample;
+            out() << tr(", CPU %1 %, ring peak %2 %, USB %3 KB/s")
+                     .arg(sample.cpuLoad, 0, 'f', 1)
+                     .arg(100 * sample.ringPeakUsage, 0, 'f', 1)
+                     .arg(sample.usbBytesPerSecond / 1024, 0, 'f', 1);
+        }
+        out() << Qt::endl;
+    }
+
+    if (!config_.latencyFileName.isEmpty())
+    {
+        const auto latency = captureEngine_.latencySnapshot();
+        out() << tr("%1: latency p50/p99/p99.9/max (us)").arg(portLabel());
+        for (int stage = 0; stage < LatencyTracker::NUM_STAGES; ++stage)
+        {
+            const auto& histogram = latency.histogram(static_cast<LatencyTracker::Stage>(stage));
+            out() << tr("%1 %2 %3/%4/%5/%6")
+                     .arg((stage == 0)? ":" : ",")
+                     .arg(LatencyTracker::stageName(static_cast<LatencyTracker::Stage>(stage)))
+                     .arg(histogram.percentile(50) / 1000)
+                     .arg(histogram.percentile(99) / 1000)
+                     .arg(histogram.percentile(99.9) / 1000)
+                     .arg(histogram.max() / 1000);
+        }
+        out() << Qt::endl;
+    }
+}
+
+QString CliRecorder::portLabel() const
+{
+    return config_.portName2.isEmpty()? config_.portName : config_.portName + "+" + config_.portName2;
+}
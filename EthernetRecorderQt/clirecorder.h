@@ -0,0 +1,89 @@
+#ifndef CLIRECORDER_H
+#define CLIRECORDER_H
+
+#include "captureengine.h"
+#include "captureindex.h"
+#include "clockcorrelator.h"
+#include "capturering.h"
+#include "framematcher.h"
+#include "pcapngfilering.h"
+#include "pcapngwriter.h"
+#include "rawstreamwriter.h"
+
+#include <QObject>
+#include <QTimer>
+
+#include <memory>
+#include <vector>
+
+
+struct CliRecorderConfig
+{
+    QString portName;
+    QString portName2;                  ///< Second USB data channel (may be empty)
+    int statIntervalMs{1000};
+
+    QString rawFileName;                ///< Write the stream as received
+    uint64_t preallocateBytes{0};
+
+    QString pcapngFileName;             ///< Write all parsed packets
+    bool isDeviceTime{false};           ///< Keep the device timestamps in the pcapng outputs instead of UTC
+
+    QString fileRingPrefix;             ///< On-disk ring of pcapng files
+    uint64_t fileRingFileBytes{0};
+    size_t fileRingNumFiles{0};
+
+    size_t captureRingBytes{0};         ///< In-memory rolling capture, dumped on trigger (0: disabled)
+    uint64_t captureRingMaxAgeNs{0};
+    uint64_t preTriggerNs{0};
+    uint64_t postTriggerNs{0};
+    QString dumpFilePrefix;
+    int triggerEtherType{-1};           ///< Trigger on packets with this EtherType (-1: disabled)
+
+    uint16_t snapLength{0};             ///< Bytes recorded per frame on the device (0: whole frames)
+    std::vector<EthRecCaptureRule> captureRules;    ///< Frames recorded on the device (none: all)
+
+    QString latencyFileName;            ///< Record the pipeline latencies and write them here as JSON on stop
+    QString matchLatencyFileName;       ///< Match frames across eth0 and eth1 and write the latencies per flow here on stop
+};
+
+
+class CliRecorder : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit CliRecorder(const CliRecorderConfig& config, QObject *parent = nullptr);
+    ~CliRecorder();
+
+    bool start();
+
+    void stop();
+
+    /// Dump the rolling capture around the most recent packet
+    void trigger();
+
+private:
+    void printStat();
+
+    QString portLabel() const;
+
+    CliRecorderConfig config_;
+
+    CaptureEngine captureEngine_;
+    RawStreamWriter rawStreamWriter_;
+    CaptureIndexWriter rawIndexWriter_;
+    RawStreamIndexer rawStreamIndexer_;
+    PcapngWriter pcapngWriter_;
+    CaptureIndexWriter pcapngIndexWriter_;
+    std::unique_ptr<PcapngFileRing> fileRing_;
+    std::unique_ptr<CaptureRing> captureRing_;
+    std::unique_ptr<FrameMatcher> frameMatcher_;   ///< In device time, which both interfaces share
+    PacketSinkGroup packetSinks_;
+    HostTimestampSink hostTimestampSink_;       ///< In front of hostTimeSinks_
+    PacketSinkGroup hostTimeSinks_;             ///< The pcapng outputs
+
+    QTimer statTimer_;
+};
+
+#endif // CLIRECORDER_H
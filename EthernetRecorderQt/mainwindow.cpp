@@ -1,6 +1,8 @@
 #include "mainwindow.h"
+#include "devicecommand.h"
 
 #include <QBoxLayout>
+#include <QFileDialog>
 #include <QGridLayout>
 #include <QToolBar>
 #include <QGroupBox>
@@ -11,6 +13,19 @@
 
 namespace {
 
+enum OutputFormat
+{
+    OUTPUT_PCAPNG = 0,
+    OUTPUT_RAW_STREAM,
+    OUTPUT_TRIGGER_DUMPS,
+};
+
+// Rolling capture for OUTPUT_TRIGGER_DUMPS
+constexpr size_t CAPTURE_RING_BYTES = 256 * 1024 * 1024;
+constexpr uint64_t CAPTURE_RING_MAX_AGE_NS = 60000000000ULL;
+constexpr uint64_t PRE_TRIGGER_NS = 10000000000ULL;
+constexpr uint64_t POST_TRIGGER_NS = 5000000000ULL;
+
 void addListItem(QGridLayout* layout, const QString& label, QWidget* widget)
 {
     auto rowIdx = layout->rowCount();
@@ -28,6 +43,8 @@ void addListItem(QGridLayout* layout, const QString& label, QWidget* widget)
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
+    , rawStreamIndexer_(captureEngine_.packetParser(), indexWriter_)
+    , hostTimestampSink_(captureEngine_.clockCorrelator())
 {
     // Main widget
     auto mainWidget = new QWidget();
@@ -50,6 +67,27 @@ MainWindow::MainWindow(QWidget *parent)
     addListItem(layoutConfig, "COM port:", editComPort_);
     widgetsEnabledAtConfig_.push_back(editComPort_);
 
+    editComPort2_ = new QLineEdit();
+    editComPort2_->setPlaceholderText(tr("Second USB data channel, merged by timestamp (leave empty for one port)"));
+    addListItem(layoutConfig, "COM port 2:", editComPort2_);
+    widgetsEnabledAtConfig_.push_back(editComPort2_);
+
+    editOutputFile_ = new QLineEdit();
+    editOutputFile_->setPlaceholderText(tr("capture.pcapng (leave empty to only show statistics)"));
+    addListItem(layoutConfig, "Output file:", editOutputFile_);
+    widgetsEnabledAtConfig_.push_back(editOutputFile_);
+
+    comboOutputFormat_ = new QComboBox();
+    comboOutputFormat_->addItem(tr("pcapng"));
+    comboOutputFormat_->addItem(tr("Raw stream (convert later with eth-rec-convert)"));
+    comboOutputFormat_->addItem(tr("Last 60 s in memory, dump -10/+5 s on trigger to <file>-<n>.pcapng"));
+    addListItem(layoutConfig, "Output format:", comboOutputFormat_);
+    widgetsEnabledAtConfig_.push_back(comboOutputFormat_);
+
+    checkLatency_ = new QCheckBox(tr("Per stage, from the capture on the device to the disk write"));
+    addListItem(layoutConfig, "Record latency:", checkLatency_);
+    widgetsEnabledAtConfig_.push_back(checkLatency_);
+
     // Stat items
     auto groupStat = new QGroupBox(tr("Statistics"));
     mainLayout->addWidget(groupStat);
@@ -73,16 +111,96 @@ MainWindow::MainWindow(QWidget *parent)
     labelErrorBytes_ = new QLabel();
     addListItem(layoutStat, tr("Error bytes:"), labelErrorBytes_);
 
+    labelRejectedHeaders_ = new QLabel();
+    addListItem(layoutStat, tr("Rejected headers:"), labelRejectedHeaders_);
+
+    labelLostFrames_ = new QLabel();
+    addListItem(layoutStat, tr("Lost frames:"), labelLostFrames_);
+
+    labelLateFrames_ = new QLabel();
+    addListItem(layoutStat, tr("Late frames (two ports):"), labelLateFrames_);
+
+    labelDeviceClock_ = new QLabel();
+    addListItem(layoutStat, tr("Device clock (drift / UTC error):"), labelDeviceClock_);
+
+    labelRingHighWater_ = new QLabel();
+    addListItem(layoutStat, tr("Ring high-water (KB):"), labelRingHighWater_);
+
+    labelOverflowBytes_ = new QLabel();
+    addListItem(layoutStat, tr("Overflow bytes:"), labelOverflowBytes_);
+
+    labelTriggerDumps_ = new QLabel();
+    addListItem(layoutStat, tr("Trigger dumps:"), labelTriggerDumps_);
+
+    const QString latencyLabels[LatencyTracker::NUM_STAGES] = {
+        tr("Device to host read, excess (us):"),
+        tr("Host read to parsed (us):"),
+        tr("Buffered to disk write (us):"),
+        tr("Disk write (us):"),
+    };
+    for (size_t stage = 0; stage < LatencyTracker::NUM_STAGES; ++stage)
+    {
+        labelLatency_[stage] = new QLabel();
+        labelLatency_[stage]->setToolTip(tr("p50 / p99 / p99.9 / max"));
+        addListItem(layoutStat, latencyLabels[stage], labelLatency_[stage]);
+    }
+
+    // Device telemetry items
+    auto groupDevice = new QGroupBox(tr("Device"));
+    mainLayout->addWidget(groupDevice);
+    auto layoutDevice = new QGridLayout(groupDevice);
+
+    labelDeviceDrops_ = new QLabel();
+    addListItem(layoutDevice, tr("Dropped frames:"), labelDeviceDrops_);
+
+    labelLinkLosses_ = new QLabel();
+    addListItem(layoutDevice, tr("Lost after the device:"), labelLinkLosses_);
+
+    labelUsbStalls_ = new QLabel();
+    addListItem(layoutDevice, tr("USB stalls:"), labelUsbStalls_);
+
+    labelDeviceLoad_ = new QLabel();
+    addListItem(layoutDevice, tr("CPU load / ring peak:"), labelDeviceLoad_);
+
+    telemetryGraph_ = new TelemetryGraph();
+    layoutDevice->addWidget(telemetryGraph_, layoutDevice->rowCount(), 0, 1, 2);
+
     // Start button
     buttonStart_ = new QPushButton(tr("Start"));
     mainLayout->addWidget(buttonStart_);
     connect(buttonStart_, &QPushButton::clicked, this, &MainWindow::buttonStartClicked);
 
+    // Trigger button
+    buttonTrigger_ = new QPushButton(tr("Trigger"));
+    buttonTrigger_->setEnabled(false);
+    mainLayout->addWidget(buttonTrigger_);
+    connect(buttonTrigger_, &QPushButton::clicked, this, [this](){
+        if (captureRing_)
+        {
+            captureRing_->trigger();
+            statusBar_->showMessage(tr("Triggered"));
+        }
+    });
+
+    // Latency export
+    buttonSaveLatency_ = new QPushButton(tr("Save latency histograms (JSON)..."));
+    buttonSaveLatency_->setEnabled(false);
+    mainLayout->addWidget(buttonSaveLatency_);
+    connect(buttonSaveLatency_, &QPushButton::clicked, this, [this](){
+        const auto fileName = QFileDialog::getSaveFileName(this, tr("Save latency histograms"), QString(), tr("JSON (*.json)"));
+        if (!fileName.isEmpty() && !captureEngine_.latencySnapshot().writeJson(fileName.toStdString()))
+        {
+            error(tr("Cannot write %1").arg(fileName));
+        }
+    });
+
     // Padding widget
     auto paddingWidget = new QWidget();
     paddingWidget->setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Expanding);
     mainLayout->addWidget(paddingWidget);
 
+    connect(&captureEngine_, &CaptureEngine::errorOccurred, this, &MainWindow::error);
+
     // Status timer
     auto timer = new QTimer(this);
     connect(timer, &QTimer::timeout, this, &MainWindow::statusCheck);
@@ -104,48 +222,93 @@ MainWindow::~MainWindow()
 
 void MainWindow::statusCheck()
 {
-    if (isRunning_)
+    // Only atomic counter snapshots here, the capture runs on its own threads
+    const auto stats = captureEngine_.stats();
+
+    if (!stats.isConnected)
+    {
+        labelComPortStatus_->setText(tr("Disconnected"));
+    }
+    else
     {
-        if (comPort_ == nullptr)
+        const double speed = (stats.duration > 0)? stats.bytesReceived / (stats.duration * 1024) : 0;
+        const double ringUsage = 100.0 * stats.ringHighWaterMark / stats.ringCapacity;
+
+        labelComPortStatus_->setText(tr("Connected"));
+        labelDuration_->setText(tr("%1").arg(stats.duration, 0, 'f', 1));
+        labelBytesReceived_->setText(QString::number(stats.bytesReceived));
+        labelDataSpeed_->setText(tr("%1").arg(speed, 0, 'f', 1));
+        labelPacketsReceived_->setText(QString::number(stats.receivedPackets));
+        labelErrorBytes_->setText(QString::number(stats.errorBytes));
+        labelRejectedHeaders_->setText(QString::number(stats.rejectedHeaders));
+        labelLostFrames_->setText(QString::number(stats.lostFrames));
+        labelLateFrames_->setText(tr("%1 (%2 restart(s))").arg(stats.lateFrames).arg(stats.mergeRestarts));
+        if (stats.clock.numWindows > 0)
         {
-            tryOpeningComPort();
+            labelDeviceClock_->setText(tr("%1 ppm / %2 us").arg(stats.clock.driftPpm, 0, 'f', 2).arg(stats.clock.errorNs / 1000, 0, 'f', 1));
         }
         else
         {
-            // Check if the port is still open
-            if (!comPort_->isOpen())
-            {
-                closeComPort();
-            }
+            labelDeviceClock_->setText(tr("-"));
         }
+        labelRingHighWater_->setText(tr("%1 / %2 (%3 %)").arg(stats.ringHighWaterMark / 1024).arg(stats.ringCapacity / 1024).arg(ringUsage, 0, 'f', 1));
+        labelOverflowBytes_->setText(QString::number(stats.overflowBytes));
+        labelTriggerDumps_->setText(captureRing_? QString::number(captureRing_->writtenDumps()) : QString("-"));
     }
 
-    if (comPort_ == nullptr)
+    if (buttonSaveLatency_->isEnabled())
     {
-        labelComPortStatus_->setText(tr("Disconnected"));
+        const auto latency = captureEngine_.latencySnapshot();
+        for (size_t stage = 0; stage < LatencyTracker::NUM_STAGES; ++stage)
+        {
+            const auto& histogram = latency.histogram(static_cast<LatencyTracker::Stage>(stage));
+            labelLatency_[stage]->setText((histogram.count() == 0)? tr("-") : tr("%1 / %2 / %3 / %4")
+                                          .arg(histogram.percentile(50) / 1000)
+                                          .arg(histogram.percentile(99) / 1000)
+                                          .arg(histogram.percentile(99.9) / 1000)
+                                          .arg(histogram.max() / 1000));
+        }
+    }
+
+    if (stats.telemetryRecords == 0)
+    {
+        for (auto label : {labelDeviceDrops_, labelLinkLosses_, labelUsbStalls_, labelDeviceLoad_})
+        {
+            label->setText(tr("-"));
+        }
     }
     else
     {
-        double speed = 0;
-        double duration = 0;
-        if (bytesReceived_ > 0)
+        // Sequence gaps the device does not account for were lost on USB or in the host
+        const auto& totals = stats.deviceTotals;
+        const uint64_t deviceDrops = totals.deviceDroppedFrames();
+        labelDeviceDrops_->setText(tr("%1 (ring full %2, USB %3)").arg(deviceDrops).arg(totals.ringFullDrops).arg(totals.usbDroppedFrames));
+        labelLinkLosses_->setText(QString::number((stats.lostFrames > deviceDrops)? stats.lostFrames - deviceDrops : 0));
+        labelUsbStalls_->setText(tr("%1 (%2 ms)").arg(totals.usbStalls).arg(totals.usbStallUs / 1000));
+        if (stats.hasTelemetrySample)
         {
-            duration = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - firstRxTime_).count();
-            speed = bytesReceived_ / (duration * 1024);
+            const auto& sample = stats.lastTelemetrySample;
+            labelDeviceLoad_->setText(tr("%1 % / %2 %").arg(sample.cpuLoad, 0, 'f', 1).arg(100 * sample.ringPeakUsage, 0, 'f', 1));
         }
+    }
+    telemetryGraph_->setSamples(captureEngine_.telemetrySamples());
 
-        //statusBarComPort_->showMessage(tr("COM port connected: %1 byte(s) received (%2 KB/s)").arg(bytesReceived_).arg(speed, 0, 'f', 1));
-        labelComPortStatus_->setText(tr("Connected"));
-        labelDuration_->setText(tr("%1").arg(duration, 0, 'f', 1));
-        labelBytesReceived_->setText(QString::number(bytesReceived_));
-        labelDataSpeed_->setText(tr("%1").arg(speed, 0, 'f', 1));
-        labelPacketsReceived_->setText(QString::number(packetParser_.receivedPackets()));
-        labelErrorBytes_->setText(QString::number(packetParser_.errorBytes()));
+    const auto gaps = captureEngine_.takeSequenceGaps();
+    if (!gaps.empty())
+    {
+        const auto& gap = gaps.back();
+        statusBar_->showMessage(tr("eth%1: %2 frame(s) lost before sequence %3 (timestamp %4 ns)")
+                                .arg(gap.networkInterface).arg(gap.lostFrames).arg(gap.receivedSequence).arg(gap.timestamp));
     }
 }
 
 void MainWindow::buttonStartClicked()
 {
+    if (!isRunning_ && !openOutputFile())
+    {
+        return;
+    }
+
     for (auto widget : widgetsEnabledAtConfig_)
     {
         widget->setEnabled(isRunning_);
@@ -154,6 +317,14 @@ void MainWindow::buttonStartClicked()
     if (!isRunning_)
     {
         buttonStart_->setText(tr("Stop"));
+        buttonTrigger_->setEnabled(captureRing_ != nullptr);
+
+        // The GUI records whole, unfiltered frames: drop the configuration of an earlier eth-rec-cli session
+        std::vector<uint8_t> deviceCommands;
+        devicecommand::appendClearRules(deviceCommands, ETH_REC_ALL_INTERFACES);
+        devicecommand::appendSnapLength(deviceCommands, ETH_REC_ALL_INTERFACES, 0);
+        captureEngine_.setDeviceCommands(deviceCommands);
+        captureEngine_.start(editComPort_->text(), editComPort2_->text());
         isRunning_ = true;
 
         statusBar_->showMessage("Recording started");
@@ -161,92 +332,118 @@ void MainWindow::buttonStartClicked()
     else
     {
         buttonStart_->setText(tr("Start"));
-        closeComPort();
+        buttonTrigger_->setEnabled(false);
+        captureEngine_.stop();
         isRunning_ = false;
+        closeOutputFile();
 
         statusBar_->showMessage("Recording stopped");
     }
 }
 
-void MainWindow::resetStat()
+bool MainWindow::openOutputFile()
 {
-    packetParser_.reset();
-    bytesReceived_ = 0;
-}
+    captureEngine_.setPacketSink(nullptr);
+    captureEngine_.setStreamSink(nullptr);
+    captureRing_.reset();
 
-void MainWindow::tryOpeningComPort()
-{
-    if (comPort_ != nullptr)
-    {
-        return;
-    }
+    captureEngine_.setLatencyTracking(checkLatency_->isChecked());
+    rawStreamWriter_.setLatencyTracker(captureEngine_.latencyTracker());
+    pcapngWriter_.setLatencyTracker(captureEngine_.latencyTracker());
+    buttonSaveLatency_->setEnabled(checkLatency_->isChecked());
 
-    comPort_ = new QSerialPort(this);
-    comPort_->setPortName(editComPort_->text());
-#if 0
-    comPort_->setBaudRate(115200);
-    comPort_->setDataBits(QSerialPort::Data8);
-    comPort_->setStopBits(QSerialPort::OneStop);
-    comPort_->setParity(QSerialPort::NoParity);
-    comPort_->setFlowControl(QSerialPort::SoftwareControl);
-#endif
-    if (comPort_->open(QIODevice::ReadWrite))
+    const auto outputFile = editOutputFile_->text();
+    if (outputFile.isEmpty())
     {
-        connect(comPort_, &QSerialPort::readyRead, this, &MainWindow::comPortReadyRead);
-        connect(comPort_, &QSerialPort::errorOccurred, this, [this](QSerialPort::SerialPortError err){
-            if (err && comPort_)
-            {
-                error(tr("COM port error #%1: %2").arg(err).arg(comPort_->errorString()));
-                closeComPort();
-            }
-        });
-        comPort_->setDataTerminalReady(true);
-
-        resetStat();
+        return true;
     }
-    else
+
+    switch (comboOutputFormat_->currentIndex())
     {
-        comPort_->deleteLater();
-        comPort_ = nullptr;
+    case OUTPUT_RAW_STREAM:
+        if (!editComPort2_->text().isEmpty())
+        {
+            error(tr("The raw stream output takes one COM port only"));
+            return false;
+        }
+        if (!rawStreamWriter_.open(outputFile.toStdString()))
+        {
+            error(tr("Cannot open output file %1").arg(outputFile));
+            return false;
+        }
+
+        if (!indexWriter_.open(CaptureIndexWriter::indexFileName(outputFile.toStdString())))
+        {
+            rawStreamWriter_.close();
+            error(tr("Cannot open index file for %1").arg(outputFile));
+            return false;
+        }
+
+        // Write first, parse later: the parser only counts and indexes packets
+        captureEngine_.setStreamSink(&rawStreamWriter_);
+        captureEngine_.setPacketSink(&rawStreamIndexer_);
+        break;
+
+    case OUTPUT_TRIGGER_DUMPS:
+        captureRing_ = std::make_unique<CaptureRing>(CAPTURE_RING_BYTES, CAPTURE_RING_MAX_AGE_NS);
+        captureRing_->setDumpFilePrefix(outputFile.toStdString());
+        captureRing_->setTriggerWindow(PRE_TRIGGER_NS, POST_TRIGGER_NS);
+        captureRing_->setPacketSource(&captureEngine_);
+        hostTimestampSink_.reset();
+        hostTimestampSink_.setSink(captureRing_.get());
+        captureEngine_.setPacketSink(&hostTimestampSink_);
+        break;
+
+    default:
+        if (!pcapngWriter_.open(outputFile.toStdString()))
+        {
+            error(tr("Cannot open output file %1").arg(outputFile));
+            return false;
+        }
+        if (!indexWriter_.open(CaptureIndexWriter::indexFileName(outputFile.toStdString())))
+        {
+            pcapngWriter_.close();
+            error(tr("Cannot open index file for %1").arg(outputFile));
+            return false;
+        }
+        pcapngWriter_.setIndexWriter(&indexWriter_);
+        pcapngWriter_.setPacketSource(&captureEngine_);
+        hostTimestampSink_.reset();
+        hostTimestampSink_.setSink(&pcapngWriter_);
+        captureEngine_.setPacketSink(&hostTimestampSink_);
+        break;
     }
+
+    return true;
 }
 
-void MainWindow::closeComPort()
+void MainWindow::closeOutputFile()
 {
-    if (comPort_ != nullptr)
+    bool hasError = false;
+    if (pcapngWriter_.isOpen())
     {
-        comPort_->deleteLater();
-        comPort_ = nullptr;
+        pcapngWriter_.close();
+        hasError = pcapngWriter_.hasError();
     }
-}
-
-void MainWindow::comPortReadyRead()
-{
-    if (comPort_ == nullptr)
+    if (rawStreamWriter_.isOpen())
     {
-        return;
+        rawStreamWriter_.close();
+        hasError = hasError || rawStreamWriter_.hasError();
     }
-
-    while (comPort_->bytesAvailable() > 0)
+    if (indexWriter_.isOpen())
     {
-        auto data = comPort_->readAll();
-        if (data.isEmpty())
-        {
-            return;
-        }
-
-#if 0
-        qDebug() << "Receive " << data.size() << " bytes";
-        qDebug() << QString::fromUtf8(data);
-#endif
-
-        if (bytesReceived_ == 0)
-        {
-            firstRxTime_ = std::chrono::steady_clock::now();
-        }
-        bytesReceived_ += data.size();
+        indexWriter_.close();
+        hasError = hasError || indexWriter_.hasError();
+    }
+    if (captureRing_)
+    {
+        captureRing_->finishDump();
+        hasError = hasError || captureRing_->hasDumpError();
+    }
 
-        packetParser_.parseRawStream(data);
+    if (hasError)
+    {
+        error(tr("Writing the output file failed"));
     }
 }
 
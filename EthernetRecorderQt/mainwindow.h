@@ -1,16 +1,24 @@
 #ifndef MAINWINDOW_H
 #define MAINWINDOW_H
 
-#include "packetparser.h"
+#include "captureengine.h"
+#include "captureindex.h"
+#include "capturering.h"
+#include "clockcorrelator.h"
+#include "pcapngwriter.h"
+#include "rawstreamwriter.h"
+#include "telemetrygraph.h"
 
 #include <QMainWindow>
 #include <QStatusBar>
 #include <QLineEdit>
+#include <QCheckBox>
+#include <QComboBox>
 #include <QPushButton>
-#include <QSerialPort>
 #include <QLabel>
 
-#include <chrono>
+#include <array>
+#include <memory>
 
 
 class MainWindow : public QMainWindow
@@ -26,20 +34,26 @@ private:
 
     void buttonStartClicked();
 
-    void resetStat();
+    bool openOutputFile();
 
-    void tryOpeningComPort();
-
-    void closeComPort();
-
-    void comPortReadyRead();
+    void closeOutputFile();
 
     void error(const QString& msg);
 
-    PacketParser packetParser_;
+    CaptureEngine captureEngine_;
+    PcapngWriter pcapngWriter_;
+    RawStreamWriter rawStreamWriter_;
+    CaptureIndexWriter indexWriter_;            ///< Sidecar index of the pcapng or raw stream output
+    RawStreamIndexer rawStreamIndexer_;
+    std::unique_ptr<CaptureRing> captureRing_;
+    HostTimestampSink hostTimestampSink_;       ///< UTC timestamps for the pcapng outputs
 
     QStatusBar* statusBar_ = nullptr;
     QLineEdit* editComPort_ = nullptr;
+    QLineEdit* editComPort2_ = nullptr;
+    QLineEdit* editOutputFile_ = nullptr;
+    QComboBox* comboOutputFormat_ = nullptr;
+    QCheckBox* checkLatency_ = nullptr;
 
     QLabel* labelComPortStatus_ = nullptr;
     QLabel* labelDuration_ = nullptr;
@@ -47,14 +61,26 @@ private:
     QLabel* labelDataSpeed_ = nullptr;
     QLabel* labelPacketsReceived_ = nullptr;
     QLabel* labelErrorBytes_ = nullptr;
+    QLabel* labelRejectedHeaders_ = nullptr;
+    QLabel* labelLostFrames_ = nullptr;
+    QLabel* labelLateFrames_ = nullptr;
+    QLabel* labelDeviceClock_ = nullptr;
+    QLabel* labelRingHighWater_ = nullptr;
+    QLabel* labelOverflowBytes_ = nullptr;
+    QLabel* labelTriggerDumps_ = nullptr;
+    std::array<QLabel*, LatencyTracker::NUM_STAGES> labelLatency_{};
+
+    QLabel* labelDeviceDrops_ = nullptr;
+    QLabel* labelLinkLosses_ = nullptr;
+    QLabel* labelUsbStalls_ = nullptr;
+    QLabel* labelDeviceLoad_ = nullptr;
+    TelemetryGraph* telemetryGraph_ = nullptr;
 
     QPushButton* buttonStart_ = nullptr;
+    QPushButton* buttonTrigger_ = nullptr;
+    QPushButton* buttonSaveLatency_ = nullptr;
     std::vector<QWidget*> widgetsEnabledAtConfig_;
 
     bool isRunning_{false};
-    QSerialPort* comPort_ = nullptr;
-
-    size_t bytesReceived_{0};
-    std::chrono::steady_clock::time_point firstRxTime_;
 };
 #endif // MAINWINDOW_H
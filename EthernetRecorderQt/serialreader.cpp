@@ -0,0 +1,155 @@
+#include "serialreader.h"
+
+#include <chrono>
+
+
+namespace {
+
+constexpr int RECONNECT_INTERVAL_MS = 1000;
+constexpr qint64 DISCARD_BUFFER_BYTES = 64 * 1024;
+
+}   // anonymous namespace
+
+
+SerialReader::SerialReader(SpscByteRing& ring, ReaderCounters& counters)
+    : ring_(ring)
+    , counters_(counters)
+{
+}
+
+void SerialReader::start(const QString& portName, const QByteArray& deviceCommands)
+{
+    portName_ = portName;
+    deviceCommands_ = deviceCommands;
+
+    if (reconnectTimer_ == nullptr)
+    {
+        reconnectTimer_ = new QTimer(this);
+        connect(reconnectTimer_, &QTimer::timeout, this, [this](){
+            if (comPort_ == nullptr)
+            {
+                tryOpeningComPort();
+            }
+            else if (!comPort_->isOpen())
+            {
+                closeComPort();
+            }
+        });
+    }
+    reconnectTimer_->start(RECONNECT_INTERVAL_MS);
+
+    tryOpeningComPort();
+}
+
+void SerialReader::stop()
+{
+    if (reconnectTimer_ != nullptr)
+    {
+        reconnectTimer_->stop();
+    }
+
+    closeComPort();
+}
+
+void SerialReader::tryOpeningComPort()
+{
+    if (comPort_ != nullptr)
+    {
+        return;
+    }
+
+    comPort_ = new QSerialPort(this);
+    comPort_->setPortName(portName_);
+    if (comPort_->open(QIODevice::ReadWrite))
+    {
+        // Pseudo-terminals (eth-rec-sim) have no modem lines, so a failure here is not an error
+        if (!comPort_->setDataTerminalReady(true))
+        {
+            comPort_->clearError();
+        }
+
+        connect(comPort_, &QSerialPort::readyRead, this, &SerialReader::comPortReadyRead);
+        connect(comPort_, &QSerialPort::errorOccurred, this, [this](QSerialPort::SerialPortError err){
+            if (err && comPort_)
+            {
+                emit errorOccurred(tr("COM port error #%1: %2").arg(err).arg(comPort_->errorString()));
+                closeComPort();
+            }
+        });
+
+        if (!deviceCommands_.isEmpty() && (comPort_->write(deviceCommands_) != deviceCommands_.size()))
+        {
+            emit errorOccurred(tr("Cannot send the capture configuration: %1").arg(comPort_->errorString()));
+        }
+
+        counters_.bytesReceived.store(0, std::memory_order_relaxed);
+        counters_.overflowBytes.store(0, std::memory_order_relaxed);
+        counters_.connectionId.fetch_add(1, std::memory_order_release);
+        counters_.isConnected.store(true, std::memory_order_release);
+    }
+    else
+    {
+        comPort_->deleteLater();
+        comPort_ = nullptr;
+    }
+}
+
+void SerialReader::closeComPort()
+{
+    if (comPort_ != nullptr)
+    {
+        comPort_->disconnect(this);
+        comPort_->deleteLater();
+        comPort_ = nullptr;
+    }
+
+    counters_.isConnected.store(false, std::memory_order_release);
+}
+
+void SerialReader::comPortReadyRead()
+{
+    if (comPort_ == nullptr)
+    {
+        return;
+    }
+
+    while (comPort_->bytesAvailable() > 0)
+    {
+        size_t freeBytes = 0;
+        auto writePtr = ring_.writePointer(freeBytes);
+
+        qint64 numBytes = 0;
+        if (freeBytes > 0)
+        {
+            numBytes = comPort_->read(reinterpret_cast<char*>(writePtr), static_cast<qint64>(freeBytes));
+            if (numBytes > 0)
+            {
+                const auto now = std::chrono::system_clock::now().time_since_epoch();
+                counters_.lastRxUtcNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+                ring_.commitWrite(static_cast<size_t>(numBytes));
+            }
+        }
+        else
+        {
+            // The parser thread is falling behind: drop data rather than letting the port buffer grow
+            discardBuffer_.resize(DISCARD_BUFFER_BYTES);
+            numBytes = comPort_->read(discardBuffer_.data(), discardBuffer_.size());
+            if (numBytes > 0)
+            {
+                counters_.overflowBytes.fetch_add(static_cast<uint64_t>(numBytes), std::memory_order_relaxed);
+            }
+        }
+
+        if (numBytes <= 0)
+        {
+            return;
+        }
+
+        if (counters_.bytesReceived.load(std::memory_order_relaxed) == 0)
+        {
+            const auto now = std::chrono::steady_clock::now().time_since_epoch();
+            counters_.firstRxTimeNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count(), std::memory_order_relaxed);
+        }
+        counters_.bytesReceived.fetch_add(static_cast<uint64_t>(numBytes), std::memory_order_relaxed);
+    }
+}
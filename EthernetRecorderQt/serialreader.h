@@ -0,0 +1,62 @@
+#ifndef SERIALREADER_H
+#define SERIALREADER_H
+
+#include "spscring.h"
+
+#include <QObject>
+#include <QSerialPort>
+#include <QTimer>
+
+#include <atomic>
+
+
+/// Counters published by the reader thread
+struct ReaderCounters
+{
+    std::atomic<bool> isConnected{false};
+    std::atomic<uint32_t> connectionId{0};      ///< Incremented on every successful connection
+    std::atomic<uint64_t> bytesReceived{0};
+    std::atomic<uint64_t> overflowBytes{0};     ///< Bytes discarded because the ring was full
+    std::atomic<int64_t> firstRxTimeNs{0};      ///< steady_clock time of the first byte of the connection
+    std::atomic<int64_t> lastRxUtcNs{0};        ///< system_clock time of the latest read, stored before its bytes are
+                                                ///< committed to the ring: all committed bytes had arrived by then
+};
+
+
+/// Owns the COM port on a dedicated thread and pulls everything it receives into the ring.
+/// Reconnects automatically while started.
+class SerialReader : public QObject
+{
+    Q_OBJECT
+
+public:
+    SerialReader(SpscByteRing& ring, ReaderCounters& counters);
+
+    /// To be invoked on the reader thread. \p deviceCommands (see devicecommand.h) are written after every
+    /// successful open, so that a reconnected device gets the same configuration.
+    void start(const QString& portName, const QByteArray& deviceCommands = QByteArray());
+
+    /// To be invoked on the reader thread
+    void stop();
+
+signals:
+    void errorOccurred(const QString& msg);
+
+private:
+    void tryOpeningComPort();
+
+    void closeComPort();
+
+    void comPortReadyRead();
+
+    SpscByteRing& ring_;
+    ReaderCounters& counters_;
+
+    QString portName_;
+    QByteArray deviceCommands_;
+    QSerialPort* comPort_ = nullptr;
+    QTimer* reconnectTimer_ = nullptr;
+    QByteArray discardBuffer_;
+};
+
+#endif // SERIALREADER_H
@@ -0,0 +1,93 @@
+#include "telemetrygraph.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+#include <algorithm>
+#include <functional>
+
+
+namespace {
+
+constexpr int MARGIN = 4;
+
+const QColor USB_COLOR(0x1F, 0x77, 0xB4);
+const QColor DROP_COLOR(0xD6, 0x27, 0x28);
+
+/// One curve scaled to its own maximum over the plot rectangle
+QPainterPath makeCurve(const std::vector<TelemetrySample>& samples, const QRectF& rect, double maxValue,
+                       const std::function<double(const TelemetrySample&)>& value)
+{
+    const double startTime = samples.front().time;
+    const double timeSpan = std::max(samples.back().time - startTime, 1e-9);
+
+    QPainterPath path;
+    for (size_t k = 0; k < samples.size(); k++)
+    {
+        const double x = rect.left() + rect.width() * (samples[k].time - startTime) / timeSpan;
+        const double y = rect.bottom() - rect.height() * value(samples[k]) / maxValue;
+        if (k == 0)
+        {
+            path.moveTo(x, y);
+        }
+        else
+        {
+            path.lineTo(x, y);
+        }
+    }
+    return path;
+}
+
+}   // anonymous namespace
+
+
+TelemetryGraph::TelemetryGraph(QWidget *parent)
+    : QWidget(parent)
+{
+    setMinimumHeight(100);
+    setSizePolicy(QSizePolicy::Expanding, QSizePolicy::Preferred);
+}
+
+void TelemetryGraph::setSamples(std::vector<TelemetrySample> samples)
+{
+    samples_ = std::move(samples);
+    update();
+}
+
+void TelemetryGraph::paintEvent(QPaintEvent* /*event*/)
+{
+    QPainter painter(this);
+    painter.fillRect(rect(), palette().base());
+    painter.setPen(palette().mid().color());
+    painter.drawRect(rect().adjusted(0, 0, -1, -1));
+
+    const int textHeight = fontMetrics().height();
+    const QRectF plotRect = QRectF(rect()).adjusted(MARGIN, MARGIN + textHeight, -MARGIN, -MARGIN);
+    if (samples_.size() < 2)
+    {
+        painter.setPen(palette().text().color());
+        painter.drawText(rect(), Qt::AlignCenter, tr("No device telemetry"));
+        return;
+    }
+
+    double maxUsbBytes = 1;
+    double maxDrops = 1;
+    for (const auto& sample : samples_)
+    {
+        maxUsbBytes = std::max(maxUsbBytes, sample.usbBytesPerSecond);
+        maxDrops = std::max(maxDrops, sample.droppedFramesPerSecond);
+    }
+
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QPen(USB_COLOR, 1.5));
+    painter.drawPath(makeCurve(samples_, plotRect, maxUsbBytes, [](const TelemetrySample& sample){return sample.usbBytesPerSecond;}));
+    painter.setPen(QPen(DROP_COLOR, 1.5));
+    painter.drawPath(makeCurve(samples_, plotRect, maxDrops, [](const TelemetrySample& sample){return sample.droppedFramesPerSecond;}));
+
+    // Legend with the scale of each curve
+    const QRect legendRect(MARGIN, MARGIN, width() - 2 * MARGIN, textHeight);
+    painter.setPen(USB_COLOR);
+    painter.drawText(legendRect, Qt::AlignLeft, tr("USB, max %1 KB/s").arg(maxUsbBytes / 1024, 0, 'f', 0));
+    painter.setPen(DROP_COLOR);
+    painter.drawText(legendRect, Qt::AlignRight, tr("Device drops, max %1 /s").arg(maxDrops, 0, 'f', 0));
+}
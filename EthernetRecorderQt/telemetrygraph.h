@@ -0,0 +1,30 @@
+#ifndef TELEMETRYGRAPH_H
+#define TELEMETRYGRAPH_H
+
+#include "devicetelemetry.h"
+
+#include <QWidget>
+
+#include <vector>
+
+
+/// Plot of the device telemetry history: USB throughput and device-side drops over time
+class TelemetryGraph : public QWidget
+{
+    Q_OBJECT
+
+public:
+    explicit TelemetryGraph(QWidget *parent = nullptr);
+
+    void setSamples(std::vector<TelemetrySample> samples);
+
+    QSize sizeHint() const override {return QSize(400, 140);}
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+
+private:
+    std::vector<TelemetrySample> samples_;
+};
+
+#endif // TELEMETRYGRAPH_H
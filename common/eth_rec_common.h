@@ -8,8 +8,12 @@
 #endif
 
 
-#define ETH_REC_SYNC_WORD (0x23490967U)
+#define ETH_REC_SYNC_WORD (0x23490967U)           ///< Protocol v1, EthRecHeader
+#define ETH_REC_SYNC_WORD_V2 (0x24490967U)        ///< Protocol v2, EthRecHeaderV2. Differs from v1 in the last byte only.
 #define ETH_REC_HEADER_BYTES (16U)
+#define ETH_REC_HEADER_V2_BYTES (24U)
+#define ETH_REC_MAX_PACKET_BYTES (1600U)        ///< Larger layer-2 frames are not recorded
+#define ETH_REC_MAX_NETWORK_INTERFACES (2U)
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,9 +24,126 @@ typedef struct
     uint32_t syncWord;          ///< Unique sync word
     uint16_t networkInterface;  ///< 0 or 1
     uint16_t numBytes;          ///< Number of bytes in the layer-2 Ethernet diagram
-    uint64_t timestamp;         ///< Nanoseconds since the start of the MCU program
+    uint64_t timestamp;         ///< Nanoseconds since the start of the MCU program (microsecond resolution on the
+                                ///< AM243); the host maps it to UTC, see ClockCorrelator
 } EthRecHeader;
 
+/// Record types of protocol v2
+#define ETH_REC_RECORD_PACKET (0U)      ///< Layer-2 frame
+#define ETH_REC_RECORD_BATCH (1U)       ///< Layer-2 frames, each an EthRecBatchEntry followed by the frame
+#define ETH_REC_RECORD_TELEMETRY (2U)   ///< EthRecTelemetry, sent periodically
+
+typedef struct
+{
+    uint32_t syncWord;          ///< ETH_REC_SYNC_WORD_V2
+    uint8_t recordType;         ///< ETH_REC_RECORD_*; the host skips unknown types
+    uint8_t networkInterface;
+    uint16_t numBytes;          ///< Number of bytes following the header
+    uint64_t timestamp;         ///< Nanoseconds since the start of the MCU program
+    uint32_t sequence;          ///< Per interface, counts every received frame that passed the capture filter,
+                                ///< including the ones that were not recorded
+    uint16_t originalBytes;     ///< Frame length on the wire if the device cut the frame to its snap length, else 0
+    uint16_t headerCrc;         ///< ethRecCrc16() over the preceding header bytes
+} EthRecHeaderV2;
+
+/// CRC-16/CCITT-FALSE (polynomial 0x1021, initial value 0xFFFF), nibble table
+static inline uint16_t ethRecCrc16(const uint8_t* data, uint32_t numBytes)
+{
+    static const uint16_t table[16] = {
+        0x0000U, 0x1021U, 0x2042U, 0x3063U, 0x4084U, 0x50A5U, 0x60C6U, 0x70E7U,
+        0x8108U, 0x9129U, 0xA14AU, 0xB16BU, 0xC18CU, 0xD1ADU, 0xE1CEU, 0xF1EFU,
+    };
+
+    uint16_t crc = 0xFFFFU;
+    for (uint32_t k = 0U; k < numBytes; k++)
+    {
+        crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ (data[k] >> 4)) & 0x0FU]);
+        crc = (uint16_t)((crc << 4) ^ table[((crc >> 12) ^ (data[k] & 0x0FU)) & 0x0FU]);
+    }
+    return crc;
+}
+
+#define ETH_REC_HEADER_V2_CRC_BYTES (ETH_REC_HEADER_V2_BYTES - 2U)
+
+/// Packet record within an ETH_REC_RECORD_BATCH record. The batch header carries networkInterface 0,
+/// the timestamp of its first frame and a batch counter as sequence.
+#define ETH_REC_BATCH_ENTRY_BYTES (16U)
+
+typedef struct
+{
+    uint8_t networkInterface;
+    uint8_t reserved;           ///< 0
+    uint16_t numBytes;          ///< Number of bytes in the layer-2 Ethernet diagram following the entry
+    uint32_t sequence;          ///< As EthRecHeaderV2::sequence
+    uint32_t timeOffset;        ///< Nanoseconds after the timestamp of the batch header
+    uint16_t originalBytes;     ///< As EthRecHeaderV2::originalBytes
+    uint16_t entryCrc;          ///< ethRecCrc16() over the preceding entry bytes
+} EthRecBatchEntry;
+
+#define ETH_REC_BATCH_ENTRY_CRC_BYTES (ETH_REC_BATCH_ENTRY_BYTES - 2U)
+
+/// Device counters of an ETH_REC_RECORD_TELEMETRY record. The header carries the device time, a telemetry record
+/// counter of its USB data channel as sequence, and the index of that channel (the CDC interface, 0 with one channel)
+/// as networkInterface. Counters are per channel and cumulative since the device started, unless noted. Host tools
+/// attribute a record to the stream it arrived in, not to networkInterface, which is informational.
+#define ETH_REC_TELEMETRY_BYTES (56U)
+
+typedef struct
+{
+    uint64_t usbBytes;          ///< Written to the CDC Tx FIFO
+    uint32_t ringFullDrops;     ///< Frames dropped because the record ring was full
+    uint32_t usbDroppedFrames;  ///< Frames in batches that could not be written to USB, e.g. without a host
+    uint32_t usbDiscardedBytes; ///< Bytes that could not be written to USB
+    uint32_t usbStalls;         ///< Waits for space in the CDC Tx FIFO
+    uint32_t usbStallUs;        ///< Time spent in these waits
+    uint32_t cutFrames;         ///< Frames cut to the snap length or to ETH_REC_MAX_PACKET_BYTES
+    uint32_t filteredFrames;    ///< Frames not matching the capture filter, not counted in sequence numbers
+    uint32_t zeroCopyFallbacks; ///< Frames copied because too many pbufs were held
+    uint32_t ringBytes;         ///< Record ring size
+    uint32_t ringMinFreeBytes;  ///< Lowest free space in the record ring since the previous telemetry record
+    uint16_t maxHeldPbufs;      ///< Most pbufs held at once since the previous telemetry record
+    uint16_t cpuLoad;           ///< Total CPU load in 1/100 %
+    uint16_t reserved;          ///< 0
+    uint16_t telemetryCrc;      ///< ethRecCrc16() over the preceding bytes
+} EthRecTelemetry;
+
+#define ETH_REC_TELEMETRY_CRC_BYTES (ETH_REC_TELEMETRY_BYTES - 2U)
+
+/// Host to device commands: an EthRecCommandHeader, numBytes of payload, then ethRecCrc16() over both (2 bytes)
+#define ETH_REC_COMMAND_SYNC_WORD (0x43490967U)
+#define ETH_REC_COMMAND_HEADER_BYTES (8U)
+#define ETH_REC_COMMAND_MAX_PAYLOAD_BYTES (32U)
+#define ETH_REC_ALL_INTERFACES (0xFFU)          ///< networkInterface of a command for every interface
+
+#define ETH_REC_COMMAND_SET_SNAP_LENGTH (1U)    ///< Payload: uint16_t bytes recorded per frame, 0: whole frames
+#define ETH_REC_COMMAND_ADD_RULE (2U)           ///< Payload: EthRecCaptureRule
+#define ETH_REC_COMMAND_CLEAR_RULES (3U)        ///< No payload
+
+typedef struct
+{
+    uint32_t syncWord;          ///< ETH_REC_COMMAND_SYNC_WORD
+    uint8_t command;            ///< ETH_REC_COMMAND_*
+    uint8_t networkInterface;   ///< Or ETH_REC_ALL_INTERFACES
+    uint16_t numBytes;          ///< Payload bytes
+} EthRecCommandHeader;
+
+/// Capture filter: an interface without rules records every frame, otherwise the frames matching any rule
+#define ETH_REC_MAX_CAPTURE_RULES (8U)
+#define ETH_REC_RULE_ETHERTYPE (1U)     ///< value: EtherType after the VLAN tags
+#define ETH_REC_RULE_VLAN_ID (2U)       ///< value: VLAN ID of any tag
+#define ETH_REC_RULE_SRC_MAC (3U)       ///< mac
+#define ETH_REC_RULE_DST_MAC (4U)       ///< mac
+#define ETH_REC_RULE_ANY_MAC (5U)       ///< mac as source or destination
+#define ETH_REC_CAPTURE_RULE_BYTES (10U)
+
+typedef struct
+{
+    uint8_t field;              ///< ETH_REC_RULE_*
+    uint8_t reserved;           ///< 0
+    uint16_t value;
+    uint8_t mac[6];
+} EthRecCaptureRule;
+
 #ifdef __cplusplus
 }   // extern "C"
 #endif
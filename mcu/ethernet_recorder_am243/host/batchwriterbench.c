@@ -0,0 +1,222 @@
+// Batch writer on the host: writeUsb() calls and bytes per frame for minimum-size frames at line rate,
+// one record per frame against batch records. A second pass checks every written batch against the stream format,
+// a third one as well, with the frames added in two parts like from a pbuf chain.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "batch_writer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define NUM_FRAMES (2000000U)
+#define FRAME_BYTES (60U)
+#define FRAME_INTERVAL_NS (672U)            // 1 Gbit/s line rate for 60-byte frames
+#define MAX_AGE_US (1000U)
+
+
+typedef struct
+{
+    uint32_t numCalls;
+    uint64_t numBytes;
+    uint32_t touchedBytes;          // Keeps the compiler from dropping the record contents
+    bool isChecked;
+    uint32_t numFrames;
+    uint32_t nextSequences[ETH_REC_MAX_NETWORK_INTERFACES];
+    uint64_t lastTimestamp;
+    bool isValid;
+} UsbStub;
+
+static UsbStub usbStub;
+
+
+static void checkBatch(const uint8_t* data, uint32_t numBytes)
+{
+    EthRecHeaderV2 header;
+    if (numBytes < sizeof(header))
+    {
+        usbStub.isValid = false;
+        return;
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((header.syncWord != ETH_REC_SYNC_WORD_V2) || (header.recordType != ETH_REC_RECORD_BATCH)
+        || (header.headerCrc != ethRecCrc16(data, ETH_REC_HEADER_V2_CRC_BYTES)) || (header.numBytes + sizeof(header) != numBytes))
+    {
+        usbStub.isValid = false;
+        return;
+    }
+
+    uint32_t offset = sizeof(header);
+    while (offset < numBytes)
+    {
+        EthRecBatchEntry entry;
+        memcpy(&entry, data + offset, sizeof(entry));
+        const uint64_t timestamp = header.timestamp + entry.timeOffset;
+        if ((entry.entryCrc != ethRecCrc16(data + offset, ETH_REC_BATCH_ENTRY_CRC_BYTES))
+            || (entry.networkInterface >= ETH_REC_MAX_NETWORK_INTERFACES)
+            || (entry.sequence != usbStub.nextSequences[entry.networkInterface])
+            || (timestamp < usbStub.lastTimestamp)
+            || (offset + sizeof(entry) + entry.numBytes > numBytes))
+        {
+            usbStub.isValid = false;
+            return;
+        }
+
+        // Frame byte k is k
+        for (uint32_t k = 0U; k < entry.numBytes; k++)
+        {
+            if (data[offset + sizeof(entry) + k] != (uint8_t)k)
+            {
+                usbStub.isValid = false;
+                return;
+            }
+        }
+
+        ++usbStub.nextSequences[entry.networkInterface];
+        usbStub.lastTimestamp = timestamp;
+        ++usbStub.numFrames;
+        offset += sizeof(entry) + entry.numBytes;
+    }
+}
+
+static uint32_t writeUsbStub(const void* data, uint32_t numBytes)
+{
+    const uint8_t* bytes = (const uint8_t*)data;
+    ++usbStub.numCalls;
+    usbStub.numBytes += numBytes;
+    usbStub.touchedBytes += bytes[ETH_REC_HEADER_V2_CRC_BYTES] + bytes[numBytes - 1U];
+    if (usbStub.isChecked)
+    {
+        checkBatch(bytes, numBytes);
+    }
+    return numBytes;
+}
+
+static double nowSeconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static void resetStub(bool isChecked)
+{
+    memset(&usbStub, 0, sizeof(usbStub));
+    usbStub.isChecked = isChecked;
+    usbStub.isValid = true;
+}
+
+static void printResult(const char* label, double seconds)
+{
+    printf("%-24s %9u writeUsb() calls, %6.1f frames per call, %5.1f bytes per frame, %6.1f ns per frame\n",
+           label, usbStub.numCalls, (double)NUM_FRAMES / usbStub.numCalls, (double)usbStub.numBytes / NUM_FRAMES,
+           seconds * 1e9 / NUM_FRAMES);
+}
+
+static void benchmarkRecordPerFrame(const uint8_t* frame)
+{
+    uint8_t record[ETH_REC_HEADER_V2_BYTES + FRAME_BYTES];
+    uint32_t sequences[ETH_REC_MAX_NETWORK_INTERFACES] = {0};
+
+    resetStub(false);
+    const double startTime = nowSeconds();
+    for (uint32_t k = 0U; k < NUM_FRAMES; k++)
+    {
+        const uint8_t networkInterface = (uint8_t)(k % ETH_REC_MAX_NETWORK_INTERFACES);
+
+        EthRecHeaderV2 header;
+        header.syncWord = ETH_REC_SYNC_WORD_V2;
+        header.recordType = ETH_REC_RECORD_PACKET;
+        header.networkInterface = networkInterface;
+        header.numBytes = FRAME_BYTES;
+        header.timestamp = (uint64_t)k * FRAME_INTERVAL_NS;
+        header.sequence = sequences[networkInterface]++;
+        header.originalBytes = 0;
+        header.headerCrc = ethRecCrc16((const uint8_t*)&header, ETH_REC_HEADER_V2_CRC_BYTES);
+
+        memcpy(record, &header, sizeof(header));
+        memcpy(record + sizeof(header), frame, FRAME_BYTES);
+        writeUsbStub(record, sizeof(record));
+    }
+    printResult("one record per frame", nowSeconds() - startTime);
+}
+
+static double runBatches(const uint8_t* frame, uint8_t* buffer, uint32_t bufferBytes, bool isChecked, bool isSplit)
+{
+    BatchWriter writer;
+    if (!initBatchWriter(&writer, buffer, bufferBytes, MAX_AGE_US, writeUsbStub))
+    {
+        return -1.0;
+    }
+
+    uint32_t sequences[ETH_REC_MAX_NETWORK_INTERFACES] = {0};
+
+    resetStub(isChecked);
+    const double startTime = nowSeconds();
+    for (uint32_t k = 0U; k < NUM_FRAMES; k++)
+    {
+        const uint8_t networkInterface = (uint8_t)(k % ETH_REC_MAX_NETWORK_INTERFACES);
+        const uint64_t timestamp = (uint64_t)k * FRAME_INTERVAL_NS;
+        if (isSplit)
+        {
+            const uint32_t firstPartBytes = k % FRAME_BYTES;
+            uint8_t* frameData = beginBatchFrame(&writer, networkInterface, sequences[networkInterface]++, timestamp, FRAME_BYTES, 0, timestamp / 1000U);
+            memcpy(frameData, frame, firstPartBytes);
+            memcpy(frameData + firstPartBytes, frame + firstPartBytes, FRAME_BYTES - firstPartBytes);
+            endBatchFrame(&writer, timestamp / 1000U);
+        }
+        else
+        {
+            addBatchFrame(&writer, networkInterface, sequences[networkInterface]++, timestamp, frame, FRAME_BYTES, 0, timestamp / 1000U);
+        }
+    }
+    flushBatchWriter(&writer);
+    return nowSeconds() - startTime;
+}
+
+static bool benchmarkBatches(const uint8_t* frame, uint32_t bufferBytes)
+{
+    uint8_t* buffer = malloc(bufferBytes);
+    if (buffer == NULL)
+    {
+        return false;
+    }
+
+    const double seconds = runBatches(frame, buffer, bufferBytes, false, false);
+    char label[32];
+    snprintf(label, sizeof(label), "batches of %u bytes", bufferBytes);
+    printResult(label, seconds);
+
+    bool isValid = (runBatches(frame, buffer, bufferBytes, true, false) >= 0.0) && usbStub.isValid && (usbStub.numFrames == NUM_FRAMES);
+    isValid = (runBatches(frame, buffer, bufferBytes, true, true) >= 0.0) && usbStub.isValid && (usbStub.numFrames == NUM_FRAMES) && isValid;
+    free(buffer);
+    return (seconds >= 0.0) && isValid;
+}
+
+
+int main(void)
+{
+    uint8_t frame[FRAME_BYTES];
+    for (uint32_t k = 0U; k < FRAME_BYTES; k++)
+    {
+        frame[k] = (uint8_t)k;
+    }
+
+    printf("%u frames of %u bytes, %u ns apart, batch age limit %u us\n", NUM_FRAMES, FRAME_BYTES, FRAME_INTERVAL_NS, MAX_AGE_US);
+    benchmarkRecordPerFrame(frame);
+
+    const uint32_t bufferSizes[] = {BATCH_WRITER_MIN_BUFFER_BYTES, 4096U, 16384U, BATCH_WRITER_MAX_BUFFER_BYTES};
+    for (uint32_t k = 0U; k < sizeof(bufferSizes) / sizeof(bufferSizes[0]); k++)
+    {
+        if (!benchmarkBatches(frame, bufferSizes[k]))
+        {
+            fprintf(stderr, "Invalid batch stream for %u bytes\n", bufferSizes[k]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,211 @@
+// Host commands and capture filter on the host: a command stream with garbage and a corrupted command is fed in
+// small chunks and the resulting filters are checked, then the filter cost per frame is measured on a frame mix.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "capture_filter.h"
+#include "device_command.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+
+#define NUM_FRAMES (4000000U)
+#define NUM_FRAME_KINDS (4U)
+#define FRAME_BYTES (128U)
+
+
+typedef struct
+{
+    uint8_t data[1024];
+    uint32_t numBytes;
+} ByteStream;
+
+static const uint8_t PTP_MAC[6] = {0x01, 0x1B, 0x19, 0x00, 0x00, 0x00};
+
+
+static void appendBytes(ByteStream* stream, const void* data, uint32_t numBytes)
+{
+    memcpy(&stream->data[stream->numBytes], data, numBytes);
+    stream->numBytes += numBytes;
+}
+
+static void appendCommand(ByteStream* stream, uint8_t command, uint8_t networkInterface, const void* payload, uint16_t numBytes)
+{
+    const uint32_t start = stream->numBytes;
+    EthRecCommandHeader header;
+    header.syncWord = ETH_REC_COMMAND_SYNC_WORD;
+    header.command = command;
+    header.networkInterface = networkInterface;
+    header.numBytes = numBytes;
+    appendBytes(stream, &header, sizeof(header));
+    appendBytes(stream, payload, numBytes);
+
+    const uint16_t crc = ethRecCrc16(&stream->data[start], stream->numBytes - start);
+    appendBytes(stream, &crc, sizeof(crc));
+}
+
+static void appendRule(ByteStream* stream, uint8_t networkInterface, uint8_t field, uint16_t value, const uint8_t* mac)
+{
+    EthRecCaptureRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.field = field;
+    rule.value = value;
+    if (mac != NULL)
+    {
+        memcpy(rule.mac, mac, sizeof(rule.mac));
+    }
+    appendCommand(stream, ETH_REC_COMMAND_ADD_RULE, networkInterface, &rule, sizeof(rule));
+}
+
+static bool checkCommands(void)
+{
+    ByteStream stream;
+    stream.numBytes = 0U;
+
+    const uint8_t garbage[5] = {0x67, 0x09, 0x49, 0x43, 0x67};     // Starts like a sync word
+    const uint16_t snapLength = 96U;
+    appendBytes(&stream, garbage, sizeof(garbage));
+    appendCommand(&stream, ETH_REC_COMMAND_CLEAR_RULES, ETH_REC_ALL_INTERFACES, NULL, 0U);
+    appendCommand(&stream, ETH_REC_COMMAND_SET_SNAP_LENGTH, ETH_REC_ALL_INTERFACES, &snapLength, sizeof(snapLength));
+    appendRule(&stream, ETH_REC_ALL_INTERFACES, ETH_REC_RULE_ETHERTYPE, 0x88F7U, NULL);
+    appendRule(&stream, 1U, ETH_REC_RULE_VLAN_ID, 100U, NULL);
+
+    // Corrupted CRC: skipped
+    const uint32_t corruptedStart = stream.numBytes;
+    appendRule(&stream, 0U, ETH_REC_RULE_VLAN_ID, 200U, NULL);
+    stream.data[stream.numBytes - 1U] ^= 0xFFU;
+    const uint32_t corruptedBytes = stream.numBytes - corruptedStart;
+
+    appendRule(&stream, 0U, ETH_REC_RULE_DST_MAC, 0U, PTP_MAC);
+    appendCommand(&stream, ETH_REC_COMMAND_ADD_RULE, 5U, NULL, 0U);     // Unknown interface: rejected
+
+    CaptureFilter filters[ETH_REC_MAX_NETWORK_INTERFACES];
+    for (uint32_t k = 0U; k < ETH_REC_MAX_NETWORK_INTERFACES; k++)
+    {
+        initCaptureFilter(&filters[k]);
+    }
+
+    DeviceCommandParser parser;
+    initDeviceCommandParser(&parser);
+    uint32_t appliedCommands = 0U;
+    for (uint32_t offset = 0U, chunk = 1U; offset < stream.numBytes; offset += chunk, chunk = chunk % 7U + 1U)
+    {
+        const uint32_t numBytes = (stream.numBytes - offset < chunk)? stream.numBytes - offset : chunk;
+        appliedCommands += parseDeviceCommands(&parser, &stream.data[offset], numBytes, filters);
+    }
+
+    printf("%u command byte(s): %u applied, %u rejected, %u error byte(s)\n",
+           stream.numBytes, parser.appliedCommands, parser.rejectedCommands, parser.errorBytes);
+
+    return (appliedCommands == 5U) && (parser.appliedCommands == 5U) && (parser.rejectedCommands == 1U)
+        && (parser.errorBytes == sizeof(garbage) + corruptedBytes)
+        && (filters[0].snapLength == snapLength) && (filters[1].snapLength == snapLength)
+        && (filters[0].numRules == 2U) && (filters[1].numRules == 2U)
+        && (filters[0].rules[1].field == ETH_REC_RULE_DST_MAC) && (filters[1].rules[1].value == 100U)
+        && (captureLength(&filters[0], 1514U, ETH_REC_MAX_PACKET_BYTES) == snapLength)
+        && (captureLength(&filters[0], 64U, ETH_REC_MAX_PACKET_BYTES) == 64U);
+}
+
+static void makeFrame(uint8_t* frame, uint32_t kind)
+{
+    static const uint8_t broadcastMac[6] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+    static const uint8_t sourceMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    static const uint8_t ipv4[2] = {0x08, 0x00};
+    static const uint8_t ptp[2] = {0x88, 0xF7};
+    static const uint8_t vlan100[4] = {0x81, 0x00, 0x00, 0x64};
+    static const uint8_t qinq200[4] = {0x88, 0xA8, 0x00, 0xC8};
+
+    memset(frame, 0, FRAME_BYTES);
+    memcpy(&frame[6], sourceMac, sizeof(sourceMac));
+    switch (kind)
+    {
+    case 0:     // IPv4 broadcast
+        memcpy(&frame[0], broadcastMac, sizeof(broadcastMac));
+        memcpy(&frame[12], ipv4, sizeof(ipv4));
+        break;
+    case 1:     // PTP
+        memcpy(&frame[0], PTP_MAC, sizeof(PTP_MAC));
+        memcpy(&frame[12], ptp, sizeof(ptp));
+        break;
+    case 2:     // IPv4 in VLAN 100
+        memcpy(&frame[0], broadcastMac, sizeof(broadcastMac));
+        memcpy(&frame[12], vlan100, sizeof(vlan100));
+        memcpy(&frame[16], ipv4, sizeof(ipv4));
+        break;
+    default:    // IPv4 in VLAN 100 in service VLAN 200
+        memcpy(&frame[0], broadcastMac, sizeof(broadcastMac));
+        memcpy(&frame[12], qinq200, sizeof(qinq200));
+        memcpy(&frame[16], vlan100, sizeof(vlan100));
+        memcpy(&frame[20], ipv4, sizeof(ipv4));
+        break;
+    }
+}
+
+static double nowSeconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static bool benchmarkFilter(const char* label, const CaptureFilter* filter, uint32_t expectedMatchesPerMix)
+{
+    uint8_t frames[NUM_FRAME_KINDS][FRAME_BYTES];
+    for (uint32_t kind = 0U; kind < NUM_FRAME_KINDS; kind++)
+    {
+        makeFrame(frames[kind], kind);
+    }
+
+    uint32_t matches = 0U;
+    const double startTime = nowSeconds();
+    for (uint32_t k = 0U; k < NUM_FRAMES; k++)
+    {
+        matches += matchCaptureFilter(filter, frames[k % NUM_FRAME_KINDS], FRAME_BYTES)? 1U : 0U;
+    }
+    const double seconds = nowSeconds() - startTime;
+
+    printf("%-32s %5.1f%% of the frames recorded, %5.1f ns per frame\n", label, 100.0 * matches / NUM_FRAMES, seconds * 1e9 / NUM_FRAMES);
+    return matches == expectedMatchesPerMix * (NUM_FRAMES / NUM_FRAME_KINDS);
+}
+
+
+int main(void)
+{
+    if (!checkCommands())
+    {
+        fprintf(stderr, "Unexpected capture filter after the host commands\n");
+        return 1;
+    }
+
+    CaptureFilter filter;
+    initCaptureFilter(&filter);
+    bool isOk = benchmarkFilter("no rules", &filter, NUM_FRAME_KINDS);
+
+    EthRecCaptureRule rule;
+    memset(&rule, 0, sizeof(rule));
+    rule.field = ETH_REC_RULE_ETHERTYPE;
+    rule.value = 0x88F7U;
+    addCaptureRule(&filter, &rule);
+    isOk = benchmarkFilter("EtherType 0x88f7", &filter, 1U) && isOk;
+
+    rule.field = ETH_REC_RULE_VLAN_ID;
+    rule.value = 100U;
+    addCaptureRule(&filter, &rule);
+    isOk = benchmarkFilter("EtherType 0x88f7 or VLAN 100", &filter, 3U) && isOk;
+
+    initCaptureFilter(&filter);
+    rule.field = ETH_REC_RULE_ANY_MAC;
+    memcpy(rule.mac, PTP_MAC, sizeof(rule.mac));
+    addCaptureRule(&filter, &rule);
+    isOk = benchmarkFilter("MAC 01:1b:19:00:00:00", &filter, 1U) && isOk;
+
+    if (!isOk)
+    {
+        fprintf(stderr, "Unexpected filter result\n");
+        return 1;
+    }
+
+    return 0;
+}
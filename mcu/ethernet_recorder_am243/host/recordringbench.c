@@ -0,0 +1,336 @@
+// Record ring on the host: random record sizes are checked against a reference FIFO across many wraps, the burst
+// capacity is compared with the former fixed slots in the same memory, the receive path cost of copied and zero-copy
+// records is timed, and a producer and a consumer thread measure the throughput while the consumer checks every record.
+
+#define _POSIX_C_SOURCE 200112L
+
+#include "app_config.h"
+#include "eth_rec_common.h"
+#include "record_ring.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define NUM_CHECKED_RECORDS (2000000U)
+#define NUM_THREADED_RECORDS (20000000U)
+#define FORMER_QUEUED_PACKETS (100U)
+
+#define MAX_PENDING_RECORDS (4096U)
+
+
+// As in packet_recorder.c: the ring record, and the former fixed slot
+typedef struct
+{
+    uint64_t        timestamp;
+    uint32_t        sequence;
+    uint8_t         networkInterface;
+    uint16_t        numBytes;
+    uint16_t        originalBytes;
+    void*           pbuf;
+    void*           netif;
+} PacketRecord;
+
+typedef struct
+{
+    PacketRecord    record;
+    uint8_t         packetData[ETH_REC_MAX_PACKET_BYTES];
+} FormerPacketSlot;
+
+
+static uint64_t ringBuffer[PACKET_RING_BYTES / sizeof(uint64_t)];
+
+
+static double nowSeconds(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec * 1e-9;
+}
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    *state = *state * 1664525U + 1013904223U;
+    return *state >> 8;
+}
+
+static void fillRecord(uint8_t* data, uint32_t numBytes, uint32_t sequence)
+{
+    for (uint32_t k = 0U; k < numBytes; k++)
+    {
+        data[k] = (uint8_t)(sequence + k);
+    }
+}
+
+static bool isRecordValid(const uint8_t* data, uint32_t numBytes, uint32_t sequence)
+{
+    for (uint32_t k = 0U; k < numBytes; k++)
+    {
+        if (data[k] != (uint8_t)(sequence + k))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Single-threaded, against a FIFO of the expected sizes: every reserve must succeed exactly when the record fits
+static bool checkRing(void)
+{
+    static uint32_t pendingSizes[MAX_PENDING_RECORDS];
+    uint32_t pendingHead = 0U;
+    uint32_t pendingTail = 0U;
+    uint32_t usedBytes = 0U;        // Reference, without wrap markers
+
+    RecordRing ring;
+    if (!initRecordRing(&ring, ringBuffer, 4096U))
+    {
+        return false;
+    }
+
+    uint32_t random = 1U;
+    uint32_t producedRecords = 0U;
+    uint32_t consumedRecords = 0U;
+    uint32_t rejectedRecords = 0U;
+    while (consumedRecords < NUM_CHECKED_RECORDS)
+    {
+        // Bursts of producing and consuming, so that the fill level sweeps the whole ring
+        const bool isProducing = (nextRandom(&random) % 64U) < 33U;
+        if (isProducing && (pendingHead - pendingTail < MAX_PENDING_RECORDS))
+        {
+            const uint32_t numBytes = nextRandom(&random) % 700U;
+            uint8_t* data = (uint8_t*)reserveRecord(&ring, numBytes);
+            if (data == NULL)
+            {
+                // Must not fit, even without a wrap
+                if (usedBytes + recordRingBytes(numBytes) <= ring.capacity / 2U)
+                {
+                    printf("Record of %u bytes rejected with %u of %u bytes used\n", numBytes, usedBytes, ring.capacity);
+                    return false;
+                }
+                ++rejectedRecords;
+                continue;
+            }
+            if (((uintptr_t)data % RECORD_RING_ALIGNMENT) != 0U)
+            {
+                return false;
+            }
+
+            // Sometimes commit less than reserved
+            const uint32_t committedBytes = (numBytes > 0U)? numBytes - nextRandom(&random) % 2U : 0U;
+            fillRecord(data, committedBytes, producedRecords);
+            commitRecord(&ring, committedBytes);
+            pendingSizes[pendingHead++ % MAX_PENDING_RECORDS] = committedBytes;
+            usedBytes += recordRingBytes(committedBytes);
+            ++producedRecords;
+        }
+        else
+        {
+            uint32_t numBytes = 0U;
+            const uint8_t* data = (const uint8_t*)peekRecord(&ring, &numBytes);
+            if (data == NULL)
+            {
+                if (pendingHead != pendingTail)
+                {
+                    return false;
+                }
+                continue;
+            }
+            if ((pendingHead == pendingTail) || (numBytes != pendingSizes[pendingTail % MAX_PENDING_RECORDS])
+                || !isRecordValid(data, numBytes, consumedRecords))
+            {
+                printf("Unexpected record %u\n", consumedRecords);
+                return false;
+            }
+            releaseRecord(&ring);
+            usedBytes -= recordRingBytes(numBytes);
+            ++pendingTail;
+            ++consumedRecords;
+        }
+
+        if (usedRecordRingBytes(&ring) < usedBytes)
+        {
+            return false;
+        }
+    }
+
+    printf("%u record(s) checked, %u rejected while full, %u dropped\n", consumedRecords, rejectedRecords, ring.droppedRecords);
+    return rejectedRecords == ring.droppedRecords;
+}
+
+// Frames of frameBytes that fit into the ring at once
+static uint32_t burstCapacity(uint32_t ringBytes, uint32_t frameBytes)
+{
+    RecordRing ring;
+    if (!initRecordRing(&ring, ringBuffer, ringBytes))
+    {
+        return 0U;
+    }
+
+    uint32_t numFrames = 0U;
+    while (reserveRecord(&ring, sizeof(PacketRecord) + frameBytes) != NULL)
+    {
+        commitRecord(&ring, sizeof(PacketRecord) + frameBytes);
+        ++numFrames;
+    }
+    return numFrames;
+}
+
+// Receive path per frame: reserve, fill and commit, with the frame copied into the record or only its pbuf pointer
+static void benchmarkReceivePath(uint32_t frameBytes, bool isZeroCopy)
+{
+    static uint8_t frame[ETH_REC_MAX_PACKET_BYTES];
+    RecordRing ring;
+    initRecordRing(&ring, ringBuffer, PACKET_RING_BYTES);
+
+    const uint32_t dataBytes = isZeroCopy? 0U : frameBytes;
+    const uint32_t numRecords = NUM_CHECKED_RECORDS;
+    double seconds = 0.0;
+    uint32_t numBytes = 0U;
+    for (uint32_t k = 0U; k < numRecords; )
+    {
+        // Fill the ring, timed, then drain it, not timed
+        const double startTime = nowSeconds();
+        PacketRecord* record;
+        for (; (k < numRecords) && ((record = (PacketRecord*)reserveRecord(&ring, sizeof(PacketRecord) + dataBytes)) != NULL); k++)
+        {
+            record->sequence = k;
+            record->numBytes = (uint16_t)frameBytes;
+            record->pbuf = isZeroCopy? frame : NULL;
+            memcpy(record + 1, frame, dataBytes);
+            commitRecord(&ring, sizeof(PacketRecord) + dataBytes);
+        }
+        seconds += nowSeconds() - startTime;
+
+        while (peekRecord(&ring, &numBytes) != NULL)
+        {
+            releaseRecord(&ring);
+        }
+    }
+
+    printf("Receive path, %-9s frames of %4u bytes: %5.1f ns per frame\n", isZeroCopy? "zero-copy" : "copied", frameBytes, seconds * 1e9 / numRecords);
+}
+
+
+typedef struct
+{
+    RecordRing ring;
+    uint32_t producerWaits;
+    uint64_t consumedBytes;
+    bool isValid;
+} ThreadedRing;
+
+static void* produceRecords(void* arg)
+{
+    ThreadedRing* threadedRing = (ThreadedRing*)arg;
+    uint32_t random = 7U;
+    for (uint32_t sequence = 0U; sequence < NUM_THREADED_RECORDS; sequence++)
+    {
+        // Mostly minimum-size frames, some full-size ones
+        const uint32_t frameBytes = (nextRandom(&random) % 8U == 0U)? 1514U : 60U;
+        PacketRecord* record;
+        while ((record = (PacketRecord*)reserveRecord(&threadedRing->ring, sizeof(PacketRecord) + frameBytes)) == NULL)
+        {
+            ++threadedRing->producerWaits;
+            sched_yield();      // Lets the consumer run on a single core
+        }
+
+        record->timestamp = sequence;
+        record->sequence = sequence;
+        record->networkInterface = 0U;
+        record->numBytes = (uint16_t)frameBytes;
+        record->originalBytes = 0U;
+        uint8_t* data = (uint8_t*)(record + 1);
+        data[0] = (uint8_t)sequence;
+        data[frameBytes - 1U] = (uint8_t)(sequence >> 8);
+        commitRecord(&threadedRing->ring, sizeof(PacketRecord) + frameBytes);
+    }
+    return NULL;
+}
+
+static void* consumeRecords(void* arg)
+{
+    ThreadedRing* threadedRing = (ThreadedRing*)arg;
+    uint32_t sequence = 0U;
+    while (sequence < NUM_THREADED_RECORDS)
+    {
+        uint32_t numBytes = 0U;
+        const PacketRecord* record = (const PacketRecord*)peekRecord(&threadedRing->ring, &numBytes);
+        if (record == NULL)
+        {
+            sched_yield();
+            continue;
+        }
+
+        const uint8_t* data = (const uint8_t*)(record + 1);
+        if ((record->sequence != sequence) || (numBytes != sizeof(PacketRecord) + record->numBytes)
+            || (data[0] != (uint8_t)sequence) || (data[record->numBytes - 1U] != (uint8_t)(sequence >> 8)))
+        {
+            threadedRing->isValid = false;
+            return NULL;
+        }
+        threadedRing->consumedBytes += record->numBytes;
+        releaseRecord(&threadedRing->ring);
+        ++sequence;
+    }
+    return NULL;
+}
+
+static bool benchmarkThreads(void)
+{
+    static ThreadedRing threadedRing;
+    initRecordRing(&threadedRing.ring, ringBuffer, PACKET_RING_BYTES);
+    threadedRing.isValid = true;
+
+    pthread_t producer;
+    pthread_t consumer;
+    const double startTime = nowSeconds();
+    pthread_create(&consumer, NULL, consumeRecords, &threadedRing);
+    pthread_create(&producer, NULL, produceRecords, &threadedRing);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+    const double seconds = nowSeconds() - startTime;
+
+    printf("2 threads: %.1f M records/s, %.0f MB/s of frames, %.1f ns per record, %u producer wait(s)\n",
+           NUM_THREADED_RECORDS / seconds * 1e-6, threadedRing.consumedBytes / seconds * 1e-6, seconds * 1e9 / NUM_THREADED_RECORDS,
+           threadedRing.producerWaits);
+    return threadedRing.isValid;
+}
+
+
+int main(void)
+{
+    if (!checkRing())
+    {
+        fprintf(stderr, "Record ring check failed\n");
+        return 1;
+    }
+
+    const uint32_t formerBytes = FORMER_QUEUED_PACKETS * (uint32_t)sizeof(FormerPacketSlot);
+    printf("Former slots: %u frames of any size in %u bytes\n", FORMER_QUEUED_PACKETS, formerBytes);
+    const uint32_t frameSizes[3] = {60U, 576U, 1514U};
+    for (uint32_t k = 0U; k < 3U; k++)
+    {
+        const uint32_t numFrames = burstCapacity(PACKET_RING_BYTES, frameSizes[k]);
+        printf("Record ring: %5u frames of %4u bytes in %u bytes, %5.1fx\n",
+               numFrames, frameSizes[k], PACKET_RING_BYTES, (double)numFrames / FORMER_QUEUED_PACKETS);
+    }
+
+    for (uint32_t k = 0U; k < 3U; k++)
+    {
+        benchmarkReceivePath(frameSizes[k], false);
+        benchmarkReceivePath(frameSizes[k], true);
+    }
+
+    if (!benchmarkThreads())
+    {
+        fprintf(stderr, "Unexpected record in the threaded run\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+// USB stream writer on the host, against a fake TinyUSB CDC Tx FIFO on a simulated high-speed bus. The fake FIFO
+// behaves like TinyUSB: a write starts a transfer once a full packet is queued, a flush starts one with whatever is
+// queued, and a completed transfer starts the next one if bytes are left. Records of the recorder stream arrive at
+// different rates; the former policy (flush after every record) is compared with the coalesced one (flush when full,
+// after the deadline or when idle) by bus time, transfers and short packets. The host side checks every byte.
+
+#include "usb_stream_writer.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+#define FIFO_BYTES (4096U)                  // CFG_TUD_CDC_TX_BUFSIZE
+#define PACKET_BYTES (512U)                 // High-speed bulk, also the TinyUSB transfer size
+#define MIN_FREE_BYTES (32U)                // As MIN_FREE_TX_BYTES in usb_comm.c
+#define FLUSH_DELAY_US (250U)
+
+// Bus model: a transfer takes its setup (completion interrupt, tud_task, next transfer armed) plus the bytes on the wire
+#define TRANSFER_SETUP_NS (4000U)
+#define NS_PER_BYTE (20U)                   // About 50 MB/s of bulk data
+
+#define NUM_RECORDS (100000U)
+#define MAX_RECORD_BYTES (16408U)           // PACKET_BATCH_BYTES and some
+
+
+typedef struct
+{
+    uint8_t data[FIFO_BYTES];
+    uint32_t readIndex;
+    uint32_t count;
+
+    uint64_t timeNs;                        // Simulated time
+    bool isTransferring;
+    uint32_t transferBytes;
+    uint64_t transferEndNs;
+    bool isSpaceSignaled;                   // Binary semaphore given by the Tx completion
+
+    uint64_t busyNs;                        // Transfers, setup included
+    uint32_t transfers;
+    uint32_t shortTransfers;
+    uint32_t flushCalls;
+    uint8_t nextHostByte;                   // Expected by the host
+    uint64_t receivedBytes;
+    bool isValid;
+} FakeCdc;
+
+static FakeCdc cdc;
+
+
+static void startTransfer(void)
+{
+    if (cdc.isTransferring || (cdc.count == 0U))
+    {
+        return;
+    }
+
+    // The host receives the bytes when the transfer starts, the FIFO space is free when it ends
+    cdc.transferBytes = (cdc.count < PACKET_BYTES)? cdc.count : PACKET_BYTES;
+    for (uint32_t k = 0U; k < cdc.transferBytes; k++)
+    {
+        if (cdc.data[(cdc.readIndex + k) % FIFO_BYTES] != cdc.nextHostByte++)
+        {
+            cdc.isValid = false;
+        }
+    }
+    cdc.receivedBytes += cdc.transferBytes;
+
+    cdc.isTransferring = true;
+    cdc.transferEndNs = cdc.timeNs + TRANSFER_SETUP_NS + (uint64_t)cdc.transferBytes * NS_PER_BYTE;
+    cdc.busyNs += cdc.transferEndNs - cdc.timeNs;
+    ++cdc.transfers;
+    if (cdc.transferBytes < PACKET_BYTES)
+    {
+        ++cdc.shortTransfers;
+    }
+}
+
+// Run the bus up to timeNs
+static void advanceBus(uint64_t timeNs)
+{
+    while (cdc.isTransferring && (cdc.transferEndNs <= timeNs))
+    {
+        cdc.timeNs = cdc.transferEndNs;
+        cdc.readIndex = (cdc.readIndex + cdc.transferBytes) % FIFO_BYTES;
+        cdc.count -= cdc.transferBytes;
+        cdc.isTransferring = false;
+        cdc.isSpaceSignaled = true;
+
+        // TinyUSB flushes the rest from the completion callback
+        startTransfer();
+    }
+    if (timeNs > cdc.timeNs)
+    {
+        cdc.timeNs = timeNs;
+    }
+}
+
+static uint32_t fakeWriteAvailable(void* context)
+{
+    (void)context;
+    return FIFO_BYTES - cdc.count;
+}
+
+static uint32_t fakeWrite(void* context, const void* data, uint32_t numBytes)
+{
+    (void)context;
+    const uint32_t bytesToWrite = (numBytes < FIFO_BYTES - cdc.count)? numBytes : FIFO_BYTES - cdc.count;
+    for (uint32_t k = 0U; k < bytesToWrite; k++)
+    {
+        cdc.data[(cdc.readIndex + cdc.count + k) % FIFO_BYTES] = ((const uint8_t*)data)[k];
+    }
+    cdc.count += bytesToWrite;
+
+    if (cdc.count >= PACKET_BYTES)
+    {
+        startTransfer();
+    }
+    return bytesToWrite;
+}
+
+static void fakeFlush(void* context)
+{
+    (void)context;
+    ++cdc.flushCalls;
+    startTransfer();
+}
+
+static bool fakeIsConnected(void* context)
+{
+    (void)context;
+    return true;
+}
+
+static bool fakeWaitForSpace(void* context, uint32_t timeoutUs)
+{
+    (void)context;
+    (void)timeoutUs;
+    if (!cdc.isSpaceSignaled)
+    {
+        if (!cdc.isTransferring)
+        {
+            return false;
+        }
+        advanceBus(cdc.transferEndNs);
+    }
+    cdc.isSpaceSignaled = false;
+    return true;
+}
+
+static uint64_t fakeNowUs(void* context)
+{
+    (void)context;
+    return cdc.timeNs / 1000U;
+}
+
+
+static uint32_t nextRandom(uint32_t* state)
+{
+    *state = *state * 1664525U + 1013904223U;
+    return *state >> 8;
+}
+
+// Records of recordBytes on average, one every intervalNs (0: back to back, the writer is the bottleneck)
+static bool runWriter(const char* label, uint32_t meanRecordBytes, uint64_t intervalNs, bool isCoalesced)
+{
+    static uint8_t record[MAX_RECORD_BYTES];
+
+    memset(&cdc, 0, sizeof(cdc));
+    cdc.isValid = true;
+
+    const UsbFifo fifo = {NULL, fakeWriteAvailable, fakeWrite, fakeFlush, fakeIsConnected, fakeWaitForSpace, fakeNowUs};
+    UsbStreamWriter writer;
+    if (!initUsbStreamWriter(&writer, &fifo, MIN_FREE_BYTES, FLUSH_DELAY_US))
+    {
+        return false;
+    }
+
+    uint32_t random = 3U;
+    uint8_t nextByte = 0U;
+    uint64_t totalBytes = 0U;
+    uint64_t arrivalNs = 0U;
+    for (uint32_t k = 0U; k < NUM_RECORDS; k++)
+    {
+        // Record sizes around the mean, some telemetry-sized ones in between
+        uint32_t numBytes = (k % 16U == 15U)? 80U : meanRecordBytes / 2U + nextRandom(&random) % meanRecordBytes;
+        if (numBytes > MAX_RECORD_BYTES)
+        {
+            numBytes = MAX_RECORD_BYTES;
+        }
+        for (uint32_t n = 0U; n < numBytes; n++)
+        {
+            record[n] = nextByte++;
+        }
+        totalBytes += numBytes;
+
+        advanceBus(arrivalNs);
+
+        if (writeUsbStream(&writer, record, numBytes, USB_STREAM_WAIT_FOREVER) != numBytes)
+        {
+            return false;
+        }
+
+        // Like the recording task: flushed after every record before, now only when nothing more is queued
+        const uint64_t nextArrivalNs = arrivalNs + intervalNs;
+        if (!isCoalesced || (nextArrivalNs > cdc.timeNs + FLUSH_DELAY_US * 1000U))
+        {
+            flushUsbStreamWriter(&writer);
+        }
+        else
+        {
+            pollUsbStreamWriter(&writer, fakeNowUs(NULL));
+        }
+
+        arrivalNs = (nextArrivalNs > cdc.timeNs)? nextArrivalNs : cdc.timeNs;
+    }
+    flushUsbStreamWriter(&writer);
+    while (cdc.isTransferring)
+    {
+        advanceBus(cdc.transferEndNs);
+    }
+
+    const double busSeconds = (double)cdc.timeNs * 1e-9;
+    printf("%-26s %-9s %5.1f MB/s, bus %5.1f%% busy, %7u transfers, %5.1f%% short, %6.0f bytes per transfer, %5.2f flushes per record, "
+           "%u stall(s)\n",
+           label, isCoalesced? "coalesced" : "flushed", (double)totalBytes / busSeconds * 1e-6, 100.0 * cdc.busyNs / cdc.timeNs, cdc.transfers,
+           100.0 * cdc.shortTransfers / cdc.transfers, (double)cdc.receivedBytes / cdc.transfers,
+           (double)cdc.flushCalls / NUM_RECORDS, writer.stalls);
+
+    return cdc.isValid && (cdc.receivedBytes == totalBytes) && (writer.writtenBytes == totalBytes) && (writer.discardedBytes == 0U);
+}
+
+
+int main(void)
+{
+    bool isOk = true;
+    for (uint32_t k = 0U; k < 2U; k++)
+    {
+        const bool isCoalesced = (k == 1U);
+        isOk = runWriter("16 KB batches, saturated", 16384U, 0U, isCoalesced) && isOk;
+        isOk = runWriter("1 KB batches, saturated", 1024U, 0U, isCoalesced) && isOk;
+        isOk = runWriter("200 B batches, saturated", 200U, 0U, isCoalesced) && isOk;
+        isOk = runWriter("200 B batches every 20 us", 200U, 20000U, isCoalesced) && isOk;
+        isOk = runWriter("200 B batches every 1 ms", 200U, 1000000U, isCoalesced) && isOk;
+    }
+
+    if (!isOk)
+    {
+        fprintf(stderr, "Unexpected bytes on the fake USB bus\n");
+        return 1;
+    }
+
+    return 0;
+}
@@ -14,5 +14,16 @@
 #define TASK_BACKGROUND_PRIORITY            (1)
 #define TASK_BACKGROUND_STACK_SIZE_WORDS    (4096U)
 
+#define PACKET_RING_BYTES                   (131072U)   // Frames waiting for the recording task, power of two
+#define PACKET_ZERO_COPY                    (1)         // Record frames from their pbufs instead of copying them
+#define PACKET_ZERO_COPY_MAX_PBUFS          (16U)       // Rx pbufs held at most, well below the Enet Rx pbuf pool
+#define PACKET_BATCH_BYTES                  (16384U)    // Batch record size limit, header included
+#define PACKET_BATCH_MAX_AGE_US             (1000U)     // Batch record age limit
+#define USB_FLUSH_DELAY_US                  (250U)      // Longest wait of queued bytes for more data in the CDC Tx FIFO
+#define USB_DATA_CHANNELS                   (1U)        // 1: all interfaces on CDC #0. 2: interface k on CDC #k, one
+                                                        // recording task each. The ring and the pbufs are split.
+
+#define TELEMETRY_INTERVAL_MS               (1000U)     // Telemetry records in the USB stream
+
 
 #endif  // ETH_REC_APP_CONFIG_H
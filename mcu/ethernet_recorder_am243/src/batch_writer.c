@@ -0,0 +1,123 @@
+#include "batch_writer.h"
+
+// Standard C
+#include <string.h>
+
+
+bool initBatchWriter(BatchWriter* writer, uint8_t* buffer, uint32_t bufferBytes, uint32_t maxAgeUs, BatchWriteFunction write)
+{
+    if ((sizeof(EthRecBatchEntry) != ETH_REC_BATCH_ENTRY_BYTES) || (bufferBytes < BATCH_WRITER_MIN_BUFFER_BYTES) || (write == NULL))
+    {
+        return false;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->buffer = buffer;
+    writer->bufferBytes = (bufferBytes < BATCH_WRITER_MAX_BUFFER_BYTES)? bufferBytes : BATCH_WRITER_MAX_BUFFER_BYTES;
+    writer->maxAgeUs = maxAgeUs;
+    writer->write = write;
+    return true;
+}
+
+bool addBatchFrame(BatchWriter* writer, uint8_t networkInterface, uint32_t sequence, uint64_t timestamp,
+                   const void* data, uint16_t numBytes, uint16_t originalBytes, uint64_t nowUs)
+{
+    uint8_t* frameData = beginBatchFrame(writer, networkInterface, sequence, timestamp, numBytes, originalBytes, nowUs);
+    if (frameData == NULL)
+    {
+        return false;
+    }
+
+    memcpy(frameData, data, numBytes);
+    endBatchFrame(writer, nowUs);
+    return true;
+}
+
+uint8_t* beginBatchFrame(BatchWriter* writer, uint8_t networkInterface, uint32_t sequence, uint64_t timestamp,
+                         uint16_t numBytes, uint16_t originalBytes, uint64_t nowUs)
+{
+    const uint32_t entryBytes = ETH_REC_BATCH_ENTRY_BYTES + numBytes;
+    if (numBytes > ETH_REC_MAX_PACKET_BYTES)
+    {
+        return NULL;
+    }
+
+    // Entry timestamps are 32-bit offsets from the first frame, and must not go backwards
+    if (!isBatchWriterEmpty(writer)
+        && ((writer->numBytes + entryBytes > writer->bufferBytes) || (timestamp < writer->timestamp) || (timestamp - writer->timestamp > UINT32_MAX)))
+    {
+        flushBatchWriter(writer);
+    }
+
+    if (isBatchWriterEmpty(writer))
+    {
+        writer->numBytes = ETH_REC_HEADER_V2_BYTES;
+        writer->timestamp = timestamp;
+        writer->startTimeUs = nowUs;
+    }
+
+    EthRecBatchEntry entry;
+    entry.networkInterface = networkInterface;
+    entry.reserved = 0;
+    entry.numBytes = numBytes;
+    entry.sequence = sequence;
+    entry.timeOffset = (uint32_t)(timestamp - writer->timestamp);
+    entry.originalBytes = originalBytes;
+    entry.entryCrc = ethRecCrc16((const uint8_t*)&entry, ETH_REC_BATCH_ENTRY_CRC_BYTES);
+
+    uint8_t* entryPtr = &writer->buffer[writer->numBytes];
+    memcpy(entryPtr, &entry, sizeof(entry));
+    writer->numBytes += entryBytes;
+    ++writer->numFrames;
+    ++writer->batchedFrames;
+    return entryPtr + sizeof(entry);
+}
+
+void endBatchFrame(BatchWriter* writer, uint64_t nowUs)
+{
+    // Write right away if not even a minimum-size frame would fit any more
+    if (writer->numBytes + ETH_REC_BATCH_ENTRY_BYTES + BATCH_WRITER_MIN_FRAME_BYTES > writer->bufferBytes)
+    {
+        flushBatchWriter(writer);
+    }
+    else
+    {
+        pollBatchWriter(writer, nowUs);
+    }
+}
+
+void pollBatchWriter(BatchWriter* writer, uint64_t nowUs)
+{
+    if (!isBatchWriterEmpty(writer) && (nowUs - writer->startTimeUs >= writer->maxAgeUs))
+    {
+        flushBatchWriter(writer);
+    }
+}
+
+void flushBatchWriter(BatchWriter* writer)
+{
+    if (isBatchWriterEmpty(writer))
+    {
+        return;
+    }
+
+    EthRecHeaderV2 header;
+    header.syncWord = ETH_REC_SYNC_WORD_V2;
+    header.recordType = ETH_REC_RECORD_BATCH;
+    header.networkInterface = 0;
+    header.numBytes = (uint16_t)(writer->numBytes - ETH_REC_HEADER_V2_BYTES);
+    header.timestamp = writer->timestamp;
+    header.sequence = writer->batchSequence++;
+    header.originalBytes = 0;
+    header.headerCrc = ethRecCrc16((const uint8_t*)&header, ETH_REC_HEADER_V2_CRC_BYTES);
+    memcpy(writer->buffer, &header, sizeof(header));
+
+    if (writer->write(writer->buffer, writer->numBytes) != writer->numBytes)
+    {
+        writer->lostFrames += writer->numFrames;
+    }
+
+    writer->numBytes = 0;
+    writer->numFrames = 0;
+    ++writer->writtenBatches;
+}
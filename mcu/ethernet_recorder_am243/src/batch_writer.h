@@ -0,0 +1,68 @@
+#ifndef ETH_REC_BATCH_WRITER_H
+#define ETH_REC_BATCH_WRITER_H
+
+// Collects recorded frames into ETH_REC_RECORD_BATCH records. Portable C without RTOS calls, so that it also
+// builds on the host (see ../host).
+
+#include "eth_rec_common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define BATCH_WRITER_MIN_BUFFER_BYTES (ETH_REC_HEADER_V2_BYTES + ETH_REC_BATCH_ENTRY_BYTES + ETH_REC_MAX_PACKET_BYTES)
+#define BATCH_WRITER_MAX_BUFFER_BYTES (ETH_REC_HEADER_V2_BYTES + 0xFFFFU)
+#define BATCH_WRITER_MIN_FRAME_BYTES (60U)      // Ethernet minimum without FCS
+
+
+// Writes a complete batch record, returns the number of bytes written
+typedef uint32_t (*BatchWriteFunction)(const void* data, uint32_t numBytes);
+
+
+typedef struct
+{
+    uint8_t*            buffer;             // Batch header followed by the entries
+    uint32_t            bufferBytes;
+    uint32_t            maxAgeUs;
+    BatchWriteFunction  write;
+
+    uint32_t            numBytes;           // Header included; 0 while the batch is empty
+    uint64_t            timestamp;          // Of the first frame
+    uint64_t            startTimeUs;        // When the first frame was added
+    uint32_t            batchSequence;
+    uint32_t            numFrames;          // In the batch
+
+    uint32_t            writtenBatches;
+    uint32_t            batchedFrames;
+    uint32_t            lostFrames;         // In batches the write function did not write completely
+} BatchWriter;
+
+
+// bufferBytes: BATCH_WRITER_MIN_BUFFER_BYTES to BATCH_WRITER_MAX_BUFFER_BYTES, larger buffers are used partly
+bool initBatchWriter(BatchWriter* writer, uint8_t* buffer, uint32_t bufferBytes, uint32_t maxAgeUs, BatchWriteFunction write);
+
+// Append a frame. The batch is written before, if the frame does not fit, and after, if it is full or too old.
+// originalBytes: see EthRecBatchEntry
+bool addBatchFrame(BatchWriter* writer, uint8_t networkInterface, uint32_t sequence, uint64_t timestamp,
+                   const void* data, uint16_t numBytes, uint16_t originalBytes, uint64_t nowUs);
+
+// addBatchFrame() in two steps, for frame data that is not contiguous: beginBatchFrame() returns where numBytes of
+// frame data go, or NULL if numBytes is too large. The frame is complete with endBatchFrame().
+uint8_t* beginBatchFrame(BatchWriter* writer, uint8_t networkInterface, uint32_t sequence, uint64_t timestamp,
+                         uint16_t numBytes, uint16_t originalBytes, uint64_t nowUs);
+
+void endBatchFrame(BatchWriter* writer, uint64_t nowUs);
+
+// Write the batch if it is older than maxAgeUs
+void pollBatchWriter(BatchWriter* writer, uint64_t nowUs);
+
+// Write the batch, if it is not empty
+void flushBatchWriter(BatchWriter* writer);
+
+static inline bool isBatchWriterEmpty(const BatchWriter* writer)
+{
+    return writer->numBytes == 0U;
+}
+
+
+#endif  // ETH_REC_BATCH_WRITER_H
@@ -0,0 +1,112 @@
+#include "capture_filter.h"
+
+// Standard C
+#include <string.h>
+
+
+#define MAC_BYTES (6U)
+#define ETHERNET_HEADER_BYTES (14U)
+#define VLAN_TAG_BYTES (4U)
+#define MAX_VLAN_TAGS (2U)
+#define ETHERTYPE_VLAN (0x8100U)
+#define ETHERTYPE_QINQ (0x88A8U)
+
+
+static inline uint16_t read16be(const uint8_t* data)
+{
+    return (uint16_t)((data[0] << 8) | data[1]);
+}
+
+
+void initCaptureFilter(CaptureFilter* filter)
+{
+    memset(filter, 0, sizeof(*filter));
+}
+
+bool addCaptureRule(CaptureFilter* filter, const EthRecCaptureRule* rule)
+{
+    if ((filter->numRules >= ETH_REC_MAX_CAPTURE_RULES) || (rule->field < ETH_REC_RULE_ETHERTYPE) || (rule->field > ETH_REC_RULE_ANY_MAC))
+    {
+        return false;
+    }
+
+    filter->rules[filter->numRules++] = *rule;
+    return true;
+}
+
+bool matchCaptureFilter(const CaptureFilter* filter, const uint8_t* frame, uint32_t numBytes)
+{
+    if (filter->numRules == 0U)
+    {
+        return true;
+    }
+    if (numBytes < ETHERNET_HEADER_BYTES)
+    {
+        return false;
+    }
+
+    // Skip the VLAN tags to the EtherType of the payload
+    uint16_t vlanIds[MAX_VLAN_TAGS];
+    uint32_t numVlanTags = 0U;
+    uint32_t offset = 2U * MAC_BYTES;
+    uint16_t etherType = read16be(&frame[offset]);
+    while (((etherType == ETHERTYPE_VLAN) || (etherType == ETHERTYPE_QINQ)) && (numVlanTags < MAX_VLAN_TAGS)
+           && (offset + VLAN_TAG_BYTES + 2U <= numBytes))
+    {
+        vlanIds[numVlanTags++] = read16be(&frame[offset + 2U]) & 0x0FFFU;
+        offset += VLAN_TAG_BYTES;
+        etherType = read16be(&frame[offset]);
+    }
+
+    const uint8_t* destinationMac = &frame[0];
+    const uint8_t* sourceMac = &frame[MAC_BYTES];
+    for (uint32_t k = 0U; k < filter->numRules; k++)
+    {
+        const EthRecCaptureRule* rule = &filter->rules[k];
+        switch (rule->field)
+        {
+        case ETH_REC_RULE_ETHERTYPE:
+            if (etherType == rule->value)
+            {
+                return true;
+            }
+            break;
+
+        case ETH_REC_RULE_VLAN_ID:
+            for (uint32_t tag = 0U; tag < numVlanTags; tag++)
+            {
+                if (vlanIds[tag] == rule->value)
+                {
+                    return true;
+                }
+            }
+            break;
+
+        case ETH_REC_RULE_SRC_MAC:
+            if (memcmp(sourceMac, rule->mac, MAC_BYTES) == 0)
+            {
+                return true;
+            }
+            break;
+
+        case ETH_REC_RULE_DST_MAC:
+            if (memcmp(destinationMac, rule->mac, MAC_BYTES) == 0)
+            {
+                return true;
+            }
+            break;
+
+        case ETH_REC_RULE_ANY_MAC:
+            if ((memcmp(sourceMac, rule->mac, MAC_BYTES) == 0) || (memcmp(destinationMac, rule->mac, MAC_BYTES) == 0))
+            {
+                return true;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,43 @@
+#ifndef ETH_REC_CAPTURE_FILTER_H
+#define ETH_REC_CAPTURE_FILTER_H
+
+// Per-interface capture filter and snap length, applied before a frame is copied. Portable C, also built on the
+// host (see ../host).
+
+#include "eth_rec_common.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct
+{
+    uint16_t            snapLength;         // 0: whole frames
+    uint8_t             numRules;
+    EthRecCaptureRule   rules[ETH_REC_MAX_CAPTURE_RULES];
+} CaptureFilter;
+
+
+// No rules, whole frames
+void initCaptureFilter(CaptureFilter* filter);
+
+// False if the filter is full or the rule field is unknown
+bool addCaptureRule(CaptureFilter* filter, const EthRecCaptureRule* rule);
+
+// True if the frame is to be recorded: no rules, or any rule matches. frame holds at least the Ethernet header
+// and VLAN tags, numBytes of them.
+bool matchCaptureFilter(const CaptureFilter* filter, const uint8_t* frame, uint32_t numBytes);
+
+// Bytes to record of a frame of frameBytes that passed the filter, at most maxBytes
+static inline uint32_t captureLength(const CaptureFilter* filter, uint32_t frameBytes, uint32_t maxBytes)
+{
+    uint32_t numBytes = frameBytes;
+    if ((filter->snapLength > 0U) && (numBytes > filter->snapLength))
+    {
+        numBytes = filter->snapLength;
+    }
+    return (numBytes < maxBytes)? numBytes : maxBytes;
+}
+
+
+#endif  // ETH_REC_CAPTURE_FILTER_H
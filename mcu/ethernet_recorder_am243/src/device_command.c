@@ -0,0 +1,163 @@
+#include "device_command.h"
+
+// Standard C
+#include <stdbool.h>
+#include <string.h>
+
+
+#define CRC_BYTES (2U)
+
+typedef enum
+{
+    COMMAND_INCOMPLETE = 0,
+    COMMAND_INVALID,
+    COMMAND_COMPLETE,
+} CommandStatus;
+
+
+static CommandStatus checkBufferedCommand(const DeviceCommandParser* parser)
+{
+    static const uint32_t syncWord = ETH_REC_COMMAND_SYNC_WORD;
+
+    // Compare the sync word byte by byte, so that garbage is dropped as soon as it arrives
+    const uint32_t syncBytes = (parser->numBytes < sizeof(syncWord))? parser->numBytes : sizeof(syncWord);
+    if (memcmp(parser->buffer, &syncWord, syncBytes) != 0)
+    {
+        return COMMAND_INVALID;
+    }
+    if (parser->numBytes < ETH_REC_COMMAND_HEADER_BYTES)
+    {
+        return COMMAND_INCOMPLETE;
+    }
+
+    EthRecCommandHeader header;
+    memcpy(&header, parser->buffer, sizeof(header));
+    if (header.numBytes > ETH_REC_COMMAND_MAX_PAYLOAD_BYTES)
+    {
+        return COMMAND_INVALID;
+    }
+
+    const uint32_t commandBytes = ETH_REC_COMMAND_HEADER_BYTES + header.numBytes + CRC_BYTES;
+    if (parser->numBytes < commandBytes)
+    {
+        return COMMAND_INCOMPLETE;
+    }
+
+    uint16_t crc;
+    memcpy(&crc, &parser->buffer[commandBytes - CRC_BYTES], sizeof(crc));
+    return (ethRecCrc16(parser->buffer, commandBytes - CRC_BYTES) == crc)? COMMAND_COMPLETE : COMMAND_INVALID;
+}
+
+static bool applyCommand(const uint8_t* command, CaptureFilter* filters)
+{
+    EthRecCommandHeader header;
+    memcpy(&header, command, sizeof(header));
+    const uint8_t* payload = command + ETH_REC_COMMAND_HEADER_BYTES;
+
+    uint32_t firstInterface = header.networkInterface;
+    uint32_t endInterface = firstInterface + 1U;
+    if (header.networkInterface == ETH_REC_ALL_INTERFACES)
+    {
+        firstInterface = 0U;
+        endInterface = ETH_REC_MAX_NETWORK_INTERFACES;
+    }
+    else if (header.networkInterface >= ETH_REC_MAX_NETWORK_INTERFACES)
+    {
+        return false;
+    }
+
+    switch (header.command)
+    {
+    case ETH_REC_COMMAND_SET_SNAP_LENGTH:
+    {
+        uint16_t snapLength;
+        if (header.numBytes != sizeof(snapLength))
+        {
+            return false;
+        }
+        memcpy(&snapLength, payload, sizeof(snapLength));
+        for (uint32_t k = firstInterface; k < endInterface; k++)
+        {
+            filters[k].snapLength = snapLength;
+        }
+        return true;
+    }
+
+    case ETH_REC_COMMAND_ADD_RULE:
+    {
+        EthRecCaptureRule rule;
+        if (header.numBytes != sizeof(rule))
+        {
+            return false;
+        }
+        memcpy(&rule, payload, sizeof(rule));
+        bool isAdded = true;
+        for (uint32_t k = firstInterface; k < endInterface; k++)
+        {
+            isAdded = addCaptureRule(&filters[k], &rule) && isAdded;
+        }
+        return isAdded;
+    }
+
+    case ETH_REC_COMMAND_CLEAR_RULES:
+        if (header.numBytes != 0U)
+        {
+            return false;
+        }
+        for (uint32_t k = firstInterface; k < endInterface; k++)
+        {
+            filters[k].numRules = 0U;
+        }
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+
+void initDeviceCommandParser(DeviceCommandParser* parser)
+{
+    memset(parser, 0, sizeof(*parser));
+}
+
+uint32_t parseDeviceCommands(DeviceCommandParser* parser, const uint8_t* data, uint32_t numBytes, CaptureFilter* filters)
+{
+    uint32_t appliedCommands = 0U;
+
+    for (uint32_t k = 0U; k < numBytes; k++)
+    {
+        parser->buffer[parser->numBytes++] = data[k];
+
+        while (parser->numBytes > 0U)
+        {
+            const CommandStatus status = checkBufferedCommand(parser);
+            if (status == COMMAND_INCOMPLETE)
+            {
+                break;
+            }
+
+            if (status == COMMAND_COMPLETE)
+            {
+                if (applyCommand(parser->buffer, filters))
+                {
+                    ++parser->appliedCommands;
+                    ++appliedCommands;
+                }
+                else
+                {
+                    ++parser->rejectedCommands;
+                }
+                parser->numBytes = 0U;
+                break;
+            }
+
+            // Not a command: drop the first byte and look for a sync word in the rest
+            memmove(parser->buffer, parser->buffer + 1, parser->numBytes - 1U);
+            --parser->numBytes;
+            ++parser->errorBytes;
+        }
+    }
+
+    return appliedCommands;
+}
@@ -0,0 +1,33 @@
+#ifndef ETH_REC_DEVICE_COMMAND_H
+#define ETH_REC_DEVICE_COMMAND_H
+
+// Parser for the host to device commands (EthRecCommandHeader). Portable C, also built on the host (see ../host).
+
+#include "capture_filter.h"
+#include "eth_rec_common.h"
+
+#include <stdint.h>
+
+
+#define DEVICE_COMMAND_MAX_BYTES (ETH_REC_COMMAND_HEADER_BYTES + ETH_REC_COMMAND_MAX_PAYLOAD_BYTES + 2U)
+
+
+typedef struct
+{
+    uint8_t     buffer[DEVICE_COMMAND_MAX_BYTES];
+    uint32_t    numBytes;
+
+    uint32_t    appliedCommands;
+    uint32_t    rejectedCommands;   // Valid framing, but an unknown command, interface or payload
+    uint32_t    errorBytes;         // Skipped while looking for the next command
+} DeviceCommandParser;
+
+
+void initDeviceCommandParser(DeviceCommandParser* parser);
+
+// Parse bytes received from the host, in any chunking. Complete commands are applied to filters
+// (ETH_REC_MAX_NETWORK_INTERFACES of them). Returns the number of commands applied during this call.
+uint32_t parseDeviceCommands(DeviceCommandParser* parser, const uint8_t* data, uint32_t numBytes, CaptureFilter* filters);
+
+
+#endif  // ETH_REC_DEVICE_COMMAND_H
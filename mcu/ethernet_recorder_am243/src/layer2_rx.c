@@ -7,7 +7,10 @@
 
 static err_t  custom_tcpip_input(struct pbuf *p, struct netif *inp)
 {
-    recordPacket(p, inp);
+    if (recordPacket(p, inp))
+    {
+        return ERR_OK;      // The recording task passes the frame on to lwIP
+    }
 
     return tcpip_input(p, inp);
 }
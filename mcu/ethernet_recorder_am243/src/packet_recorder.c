@@ -1,171 +1,424 @@
 #include "packet_recorder.h"
 #include "app_config.h"
+#include "batch_writer.h"
+#include "capture_filter.h"
+#include "device_command.h"
+#include "record_ring.h"
 #include "usb_comm.h"
 #include "eth_rec_common.h"
 
 #include "ti_enet_lwipif.h"
 
+// lwIP
+#include <lwip/tcpip.h>
+
 // Kernel
 #include <kernel/dpl/ClockP.h>
+#include <kernel/dpl/TaskP.h>
 
 // FreeRTOS
 #include <FreeRTOS.h>
 #include <task.h>
-#include <queue.h>
 
 // Standard C
 #include <string.h>
 
 
-#define MAX_PACKET_SIZE (1600U)
-#define QUEUED_PACKETS (100U)
+#define MAX_PACKET_SIZE (ETH_REC_MAX_PACKET_BYTES)
 
 
+// Ring record of a frame, followed by numBytes of frame data unless the frame stays in its pbuf
 typedef struct
 {
     uint64_t        timestamp;
-    struct netif*   netIf;
-    uint32_t        numBytes;
-    uint8_t         packetData[ETH_REC_HEADER_BYTES + MAX_PACKET_SIZE];
+    uint32_t        sequence;
+    uint8_t         networkInterface;
+    uint16_t        numBytes;
+    uint16_t        originalBytes;      // 0 unless cut to the snap length
+    struct pbuf*    pbuf;               // Zero-copy: the frame, handed on to lwIP by the recording task. Else NULL.
+    struct netif*   netif;
 } PacketRecord;
 
 
-PacketRecord queuedPackets[QUEUED_PACKETS];
-EthRecHeader msgHeader;
+#if (USB_DATA_CHANNELS < 1) || (USB_DATA_CHANNELS > 2)
+#error "USB_DATA_CHANNELS must be 1 or 2"
+#endif
+
+#define CHANNEL_RING_BYTES (PACKET_RING_BYTES / USB_DATA_CHANNELS)
+#define CHANNEL_MAX_PBUFS (PACKET_ZERO_COPY_MAX_PBUFS / USB_DATA_CHANNELS)
+
+// One recording task per USB data channel, with its own ring, batch and counters. recordPacket() is the producer of
+// the ring, the recording task the consumer and the only writer of the CDC interface.
+typedef struct
+{
+    uint32_t        index;              // Also the CDC interface
+
+    // Frames from recordPacket() to the recording task, each taking only its own size: with small frames, many more
+    // of them fit than in fixed slots of MAX_PACKET_SIZE
+    RecordRing      packetRing;
+    uint64_t        packetRingBuffer[CHANNEL_RING_BYTES / sizeof(uint64_t)];
+
+    // Frames go to USB in batch records, one writeUsb() call per batch, coalesced in the CDC Tx FIFO
+    BatchWriter     batchWriter;
+    uint8_t         batchBuffer[PACKET_BATCH_BYTES];
 
-// Queue of free entries in queuedPackets
-QueueHandle_t   queueFreeEntries = NULL;
-uint32_t        queueFreeEntriesStorage[QUEUED_PACKETS];
-StaticQueue_t   queueFreeEntriesBuffer;
+    // Zero-copy pbufs: the recording task holds pbufsQueued - pbufsReleased of the driver's Rx pbufs. Beyond
+    // CHANNEL_MAX_PBUFS frames are copied, so that the driver never runs out of Rx pbufs.
+    uint32_t        pbufsQueued;
+    volatile uint32_t pbufsReleased;
+    uint32_t        zeroCopyFallbacks;
+    uint32_t        maxHeldPbufs;       // Since the previous telemetry record
 
-// Queue of entries in queuedPackets ready for recording
-QueueHandle_t   queueReadyEntries = NULL;
-uint32_t        queueReadyEntriesStorage[QUEUED_PACKETS];
-StaticQueue_t   queueReadyEntriesBuffer;
+    // Telemetry counters of recordPacket(), the others are kept by the record ring, the batch writer and usb_comm
+    uint32_t        filteredFrames;
+    uint32_t        cutFrames;
+    uint32_t        telemetrySequence;
 
-// Recording task
-TaskHandle_t    taskRecording = NULL;
-StackType_t     taskRecordingStackBuffer[TASK_RECORDING_STACK_SIZE_WORDS];
-StaticTask_t    taskRecordingBuffer;
+    TaskHandle_t    taskRecording;
+    StackType_t     taskRecordingStackBuffer[TASK_RECORDING_STACK_SIZE_WORDS];
+    StaticTask_t    taskRecordingBuffer;
+} RecordingChannel;
 
+RecordingChannel recordingChannels[USB_DATA_CHANNELS];
 
-void recordPacket(struct pbuf *p, struct netif *inp)
+// Per-interface sequence numbers, counting every frame that passes the capture filter. Dropped frames show up as
+// gaps on the host.
+uint32_t sequenceCounters[ETH_REC_MAX_NETWORK_INTERFACES];
+
+// Capture filters set by host commands. The CDC task parses the commands into pendingFilters, and once the host
+// sent no more bytes and the last command is complete, copies them into the inactive of two banks and switches banks.
+// recordPacket() marks the bank it reads in filterBankInUse (bank + 1, 0: none) and checks that it is still the
+// active one; the CDC task does not write a marked bank, but tries again in its next cycle.
+CaptureFilter captureFilters[2][ETH_REC_MAX_NETWORK_INTERFACES];
+volatile uint32_t activeFilterBank = 0;
+volatile uint32_t filterBankInUse = 0;
+CaptureFilter pendingFilters[ETH_REC_MAX_NETWORK_INTERFACES];
+bool isFilterPending = false;
+DeviceCommandParser commandParser;
+
+
+static void notifyRecordingTask(const RecordingChannel* channel)
 {
-    if (p->len > MAX_PACKET_SIZE)
+    if (channel->taskRecording != NULL)
     {
-        return;
+        xTaskNotifyGive(channel->taskRecording);
     }
+}
+
 
+bool recordPacket(struct pbuf *p, struct netif *inp)
+{
     // This function is called from a task with very small stack. Be mindful of stack overflow here.
-    msgHeader.timestamp = ClockP_getTimeUsec();
-    msgHeader.syncWord = ETH_REC_SYNC_WORD;
-    msgHeader.numBytes = p->len;
-    msgHeader.networkInterface = 0;
+    const uint64_t timestamp = ClockP_getTimeUsec() * 1000U;    // Nanoseconds, with microsecond resolution
+
+    uint8_t networkInterface = 0;
     for (uint32_t i = 0U; i < ENET_SYSCFG_NETIF_COUNT; i++)
     {
         if (inp == LwipifEnetApp_getNetifFromId(NETIF_INST_ID0 + i))
         {
-            msgHeader.networkInterface = i;
+            networkInterface = (uint8_t)i;
         }
     }
+    if (networkInterface >= ETH_REC_MAX_NETWORK_INTERFACES)
+    {
+        return false;
+    }
+
+    RecordingChannel* channel = &recordingChannels[networkInterface % USB_DATA_CHANNELS];
 
-    uint32_t entryIdx = 0;
-    if (xQueueReceive(queueFreeEntries, &entryIdx, 0) != pdTRUE)
+    // Filter on the first pbuf, which holds the Ethernet header
+    uint32_t bank;
+    do
     {
-        return;
+        bank = activeFilterBank;
+        filterBankInUse = bank + 1U;
+    } while (activeFilterBank != bank);
+    const CaptureFilter* filter = &captureFilters[bank][networkInterface];
+    if (!matchCaptureFilter(filter, (const uint8_t*)p->payload, p->len))
+    {
+        filterBankInUse = 0U;
+        ++channel->filteredFrames;
+        return false;
     }
-    PacketRecord* entry = &queuedPackets[entryIdx];
 
-    entry->netIf = inp;
-    entry->numBytes = sizeof(msgHeader) + p->len;
-    memcpy(&entry->packetData[0], &msgHeader, sizeof(msgHeader));
-    memcpy(&entry->packetData[sizeof(msgHeader)], p->payload, p->len);
+    // Frames longer than the snap length or the record buffer are cut; the host gets the original length
+    const uint16_t numBytes = (uint16_t)captureLength(filter, p->tot_len, MAX_PACKET_SIZE);
+    filterBankInUse = 0U;
+
+    // Count the frame before any drop, so that the host sees the gap
+    const uint32_t sequence = sequenceCounters[networkInterface]++;
 
-    if (xQueueSendToBack(queueReadyEntries, &entryIdx, 0) != pdTRUE)
+    const uint16_t originalBytes = (numBytes < p->tot_len)? p->tot_len : 0U;
+    if (originalBytes > 0U)
     {
-        DebugP_logError("Invalid queue size\r\n");
-        return;
+        ++channel->cutFrames;
+    }
+
+#if PACKET_ZERO_COPY
+    // Take over the pbuf instead of copying it. lwIP only gets it after the recording task is done with it,
+    // because the stack moves the payload of the first pbuf and may shorten the chain or rewrite the frame.
+    if (channel->pbufsQueued - channel->pbufsReleased < CHANNEL_MAX_PBUFS)
+    {
+        PacketRecord* entry = (PacketRecord*)reserveRecord(&channel->packetRing, sizeof(PacketRecord));
+        if (entry == NULL)
+        {
+            return false;
+        }
+
+        entry->timestamp = timestamp;
+        entry->sequence = sequence;
+        entry->networkInterface = networkInterface;
+        entry->numBytes = numBytes;
+        entry->originalBytes = originalBytes;
+        entry->pbuf = p;
+        entry->netif = inp;
+        ++channel->pbufsQueued;
+        if (channel->pbufsQueued - channel->pbufsReleased > channel->maxHeldPbufs)
+        {
+            channel->maxHeldPbufs = channel->pbufsQueued - channel->pbufsReleased;
+        }
+
+        commitRecord(&channel->packetRing, sizeof(PacketRecord));
+        notifyRecordingTask(channel);
+        return true;
     }
+    ++channel->zeroCopyFallbacks;
+#endif
+
+    PacketRecord* entry = (PacketRecord*)reserveRecord(&channel->packetRing, sizeof(PacketRecord) + numBytes);
+    if (entry == NULL)
+    {
+        return false;
+    }
+
+    entry->timestamp = timestamp;
+    entry->sequence = sequence;
+    entry->networkInterface = networkInterface;
+    entry->numBytes = numBytes;
+    entry->originalBytes = originalBytes;
+    entry->pbuf = NULL;
+    entry->netif = inp;
+    pbuf_copy_partial(p, (uint8_t*)(entry + 1), numBytes, 0);
+
+    commitRecord(&channel->packetRing, sizeof(PacketRecord) + numBytes);
+    notifyRecordingTask(channel);
+    return false;
+}
+
+
+// Batch writers have no context, so there is one function per channel
+static uint32_t writeBatch0(const void* data, uint32_t numBytes)
+{
+    return writeUsb(0, data, numBytes, portMAX_DELAY);
+}
+
+static uint32_t writeBatch1(const void* data, uint32_t numBytes)
+{
+    return writeUsb(1, data, numBytes, portMAX_DELAY);
+}
+
+static const BatchWriteFunction writeBatchFunctions[2] = {writeBatch0, writeBatch1};
+
+static void recordPbuf(RecordingChannel* channel, const PacketRecord* entry)
+{
+    // Stream straight from the pbuf chain into the batch
+    uint8_t* frameData = beginBatchFrame(&channel->batchWriter, entry->networkInterface, entry->sequence, entry->timestamp,
+                                         entry->numBytes, entry->originalBytes, ClockP_getTimeUsec());
+    if (frameData != NULL)
+    {
+        pbuf_copy_partial(entry->pbuf, frameData, entry->numBytes, 0);
+        endBatchFrame(&channel->batchWriter, ClockP_getTimeUsec());
+    }
+
+    // Now lwIP may have the frame, as it would have had it from the input hook
+    if (tcpip_input(entry->pbuf, entry->netif) != ERR_OK)
+    {
+        pbuf_free(entry->pbuf);
+    }
+    ++channel->pbufsReleased;
+}
+
+
+static void writeTelemetry(RecordingChannel* channel, uint64_t nowUs)
+{
+    UsbStats usbStats;
+    getUsbStats(channel->index, &usbStats);
+
+    EthRecTelemetry telemetry;
+    memset(&telemetry, 0, sizeof(telemetry));
+    telemetry.usbBytes = usbStats.writtenBytes;
+    telemetry.ringFullDrops = channel->packetRing.droppedRecords;
+    telemetry.usbDroppedFrames = channel->batchWriter.lostFrames;
+    telemetry.usbDiscardedBytes = usbStats.discardedBytes;
+    telemetry.usbStalls = usbStats.stalls;
+    telemetry.usbStallUs = usbStats.stallUs;
+    telemetry.cutFrames = channel->cutFrames;
+    telemetry.filteredFrames = channel->filteredFrames;
+    telemetry.zeroCopyFallbacks = channel->zeroCopyFallbacks;
+    telemetry.ringBytes = channel->packetRing.capacity;
+    telemetry.ringMinFreeBytes = takeRecordRingMinFreeBytes(&channel->packetRing);
+    telemetry.maxHeldPbufs = (uint16_t)channel->maxHeldPbufs;
+    telemetry.cpuLoad = (uint16_t)TaskP_loadGetTotalCpuLoad();
+    telemetry.telemetryCrc = ethRecCrc16((const uint8_t*)&telemetry, ETH_REC_TELEMETRY_CRC_BYTES);
+    channel->maxHeldPbufs = channel->pbufsQueued - channel->pbufsReleased;
+
+    uint8_t record[ETH_REC_HEADER_V2_BYTES + ETH_REC_TELEMETRY_BYTES];
+    EthRecHeaderV2 header;
+    header.syncWord = ETH_REC_SYNC_WORD_V2;
+    header.recordType = ETH_REC_RECORD_TELEMETRY;
+    header.networkInterface = (uint8_t)channel->index;
+    header.numBytes = ETH_REC_TELEMETRY_BYTES;
+    header.timestamp = nowUs * 1000U;
+    header.sequence = channel->telemetrySequence++;
+    header.originalBytes = 0;
+    header.headerCrc = ethRecCrc16((const uint8_t*)&header, ETH_REC_HEADER_V2_CRC_BYTES);
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), &telemetry, sizeof(telemetry));
+
+    // Between two batches, so that it never splits one
+    writeUsb(channel->index, record, sizeof(record), portMAX_DELAY);
 }
 
 
 void packetRecordingTask(void *arg)
 {
-    uint32_t entryIdx = 0;
+    RecordingChannel* channel = (RecordingChannel*)arg;
+    uint64_t telemetryTimeUs = ClockP_getTimeUsec();
     while (1)
     {
-        if (xQueueReceive(queueReadyEntries, &entryIdx, portMAX_DELAY) == pdTRUE)
-        {
-            const PacketRecord* entry = &queuedPackets[entryIdx];
-            //DebugP_log("Receive %u bytes from the interface %X\r\n", entry->numBytes, entry->netIf);
+        // While frames wait in the batch, wake up every tick to write it once it is PACKET_BATCH_MAX_AGE_US old.
+        // Otherwise wake up at least for the next telemetry record.
+        // One notification may stand for many records, so the ring is drained completely.
+        const TickType_t ticksToWait = isBatchWriterEmpty(&channel->batchWriter)? pdMS_TO_TICKS(TELEMETRY_INTERVAL_MS) : 1;
+        ulTaskNotifyTake(pdTRUE, ticksToWait);
 
-            // Write to USB
-            writeUsb(&entry->packetData[0], entry->numBytes, portMAX_DELAY);
+        uint32_t recordBytes = 0;
+        const PacketRecord* entry;
+        while ((entry = (const PacketRecord*)peekRecord(&channel->packetRing, &recordBytes)) != NULL)
+        {
+            //DebugP_log("Receive %u bytes from the interface %u\r\n", entry->numBytes, entry->networkInterface);
 
-            // Done. Return entryIdx to the free entry queue.
-            if (xQueueSendToBack(queueFreeEntries, &entryIdx, 0) != pdTRUE)
+            // Copy to the batch, which is written to USB when full or old enough
+            if (entry->pbuf != NULL)
+            {
+                recordPbuf(channel, entry);
+            }
+            else
             {
-                DebugP_logError("Invalid queue size\r\n");
-                return;
+                addBatchFrame(&channel->batchWriter, entry->networkInterface, entry->sequence, entry->timestamp,
+                              (const uint8_t*)(entry + 1), entry->numBytes, entry->originalBytes, ClockP_getTimeUsec());
             }
+
+            releaseRecord(&channel->packetRing);
+        }
+
+        const uint64_t nowUs = ClockP_getTimeUsec();
+        pollBatchWriter(&channel->batchWriter, nowUs);
+
+        if (nowUs - telemetryTimeUs >= TELEMETRY_INTERVAL_MS * 1000U)
+        {
+            writeTelemetry(channel, nowUs);
+            telemetryTimeUs = nowUs;
+        }
+
+        // Written batches wait in the CDC Tx FIFO for more, so that transfers go out in full packets. Once no more
+        // frames are coming, the rest goes out at once.
+        if (isBatchWriterEmpty(&channel->batchWriter))
+        {
+            flushUsb(channel->index);
+        }
+        else
+        {
+            pollUsb(channel->index, nowUs);
         }
     }
 }
 
 
-void initPacketRecorder()
+void processHostCommands(const uint8_t* data, uint32_t numBytes)
 {
-    if (sizeof(EthRecHeader) != ETH_REC_HEADER_BYTES)
+    const uint32_t completeCommands = commandParser.appliedCommands + commandParser.rejectedCommands;
+    parseDeviceCommands(&commandParser, data, numBytes, pendingFilters);
+    if (commandParser.appliedCommands + commandParser.rejectedCommands != completeCommands)
     {
-        DebugP_logError("Invalid message header size\r\n");
-        return;
+        isFilterPending = true;
     }
+}
+
 
-    // Create recording task
-    taskRecording = xTaskCreateStatic (
-            packetRecordingTask,
-            "taskRecording",                    // task name
-            TASK_RECORDING_STACK_SIZE_WORDS,
-            NULL,                               // pvParameters
-            TASK_RECORDING_PRIORITY,
-            taskRecordingStackBuffer,
-            &taskRecordingBuffer);
-    if (taskRecording == NULL)
+void applyHostCommands(void)
+{
+    // Not in the middle of a command, so that a configuration is applied as a whole
+    if (!isFilterPending || (commandParser.numBytes > 0U))
     {
-        DebugP_logError("Cannot create packet recording task\r\n");
         return;
     }
 
-    // Create free entry queue
-    queueFreeEntries = xQueueCreateStatic(
-            QUEUED_PACKETS,     // max items
-            sizeof(uint32_t),   // item size
-            (uint8_t *)queueFreeEntriesStorage,
-            &queueFreeEntriesBuffer);
-    if (queueFreeEntries == NULL)
+    const uint32_t nextBank = activeFilterBank ^ 1U;
+    if (filterBankInUse == nextBank + 1U)
     {
-        DebugP_logError("Cannot create free entry queue\r\n");
+        // recordPacket() still reads the old bank
         return;
     }
 
-    // Create ready entry queue
-    queueReadyEntries = xQueueCreateStatic(
-            QUEUED_PACKETS,     // max items
-            sizeof(uint32_t),   // item size
-            (uint8_t *)queueReadyEntriesStorage,
-            &queueReadyEntriesBuffer);
-    if (queueReadyEntries == NULL)
+    memcpy(captureFilters[nextBank], pendingFilters, sizeof(pendingFilters));
+    activeFilterBank = nextBank;
+    isFilterPending = false;
+    DebugP_log("Capture filter: %u command(s) applied, %u rejected\r\n", commandParser.appliedCommands, commandParser.rejectedCommands);
+}
+
+
+void initPacketRecorder()
+{
+    if ((sizeof(EthRecHeaderV2) != ETH_REC_HEADER_V2_BYTES) || (sizeof(EthRecTelemetry) != ETH_REC_TELEMETRY_BYTES))
     {
-        DebugP_logError("Cannot create ready entry queue\r\n");
+        DebugP_logError("Invalid message header size\r\n");
         return;
     }
 
-    // Initialize free entry queue
-    for (uint32_t k = 0; k < QUEUED_PACKETS; k++)
+    for (uint32_t k = 0; k < USB_DATA_CHANNELS; k++)
+    {
+        RecordingChannel* channel = &recordingChannels[k];
+        channel->index = k;
+
+        if (!initBatchWriter(&channel->batchWriter, channel->batchBuffer, sizeof(channel->batchBuffer), PACKET_BATCH_MAX_AGE_US,
+                             writeBatchFunctions[k]))
+        {
+            DebugP_logError("Invalid batch buffer\r\n");
+            return;
+        }
+
+        if (!initRecordRing(&channel->packetRing, channel->packetRingBuffer, sizeof(channel->packetRingBuffer)))
+        {
+            DebugP_logError("Invalid packet ring size\r\n");
+            return;
+        }
+    }
+
+    for (uint32_t k = 0; k < ETH_REC_MAX_NETWORK_INTERFACES; k++)
+    {
+        initCaptureFilter(&captureFilters[0][k]);
+        initCaptureFilter(&captureFilters[1][k]);
+        initCaptureFilter(&pendingFilters[k]);
+    }
+    initDeviceCommandParser(&commandParser);
+
+    // Create the recording tasks
+    static const char* taskNames[2] = {"taskRecording0", "taskRecording1"};
+    for (uint32_t k = 0; k < USB_DATA_CHANNELS; k++)
     {
-        if (xQueueSendToBack(queueFreeEntries, &k, 0) != pdTRUE)
+        RecordingChannel* channel = &recordingChannels[k];
+        channel->taskRecording = xTaskCreateStatic (
+                packetRecordingTask,
+                taskNames[k],                       // task name
+                TASK_RECORDING_STACK_SIZE_WORDS,
+                channel,                            // pvParameters
+                TASK_RECORDING_PRIORITY,
+                channel->taskRecordingStackBuffer,
+                &channel->taskRecordingBuffer);
+        if (channel->taskRecording == NULL)
         {
-            DebugP_logError("Invalid queue size\r\n");
+            DebugP_logError("Cannot create packet recording task\r\n");
             return;
         }
     }
@@ -3,8 +3,21 @@
 
 #include <lwip/netif.h>
 
+#include <stdbool.h>
 
-void recordPacket(struct pbuf *p, struct netif *inp);
+
+// Record a received frame. True if the recorder took over p (PACKET_ZERO_COPY) and passes it on to lwIP itself;
+// otherwise the frame was copied or not recorded, and the caller passes it on.
+bool recordPacket(struct pbuf *p, struct netif *inp);
+
+
+// Host to device commands received on the CDC interface, in any chunking. They take effect with applyHostCommands().
+void processHostCommands(const uint8_t* data, uint32_t numBytes);
+
+// To be called when no more host bytes are waiting: the commands received so far take effect at once, if the last
+// one is complete. A configuration the host sends in one write is applied as a whole, unless its bytes arrive with
+// a CDC task cycle between them.
+void applyHostCommands(void);
 
 
 void initPacketRecorder();
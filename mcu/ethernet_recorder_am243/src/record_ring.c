@@ -0,0 +1,123 @@
+#include "record_ring.h"
+
+// Standard C
+#include <stddef.h>
+#include <string.h>
+
+
+#define WRAP_MARKER (0xFFFFFFFFU)
+
+// GCC and clang builtins (also tiarmclang): the acquire load pairs with the other side's release store
+#define LOAD_ACQUIRE(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_RELEASE(p, value) __atomic_store_n((p), (value), __ATOMIC_RELEASE)
+
+
+static inline void updateMinFreeBytes(RecordRing* ring, uint32_t freeBytes)
+{
+    if (freeBytes < ring->minFreeBytes)
+    {
+        ring->minFreeBytes = freeBytes;
+    }
+}
+
+
+bool initRecordRing(RecordRing* ring, void* buffer, uint32_t numBytes)
+{
+    if ((buffer == NULL) || (((uintptr_t)buffer % RECORD_RING_ALIGNMENT) != 0U) || (numBytes < 64U) || ((numBytes & (numBytes - 1U)) != 0U))
+    {
+        return false;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->buffer = (uint8_t*)buffer;
+    ring->capacity = numBytes;
+    ring->minFreeBytes = numBytes;
+    return true;
+}
+
+void* reserveRecord(RecordRing* ring, uint32_t numBytes)
+{
+    const uint32_t recordBytes = recordRingBytes(numBytes);
+    const uint32_t head = ring->head;
+    const uint32_t freeBytes = ring->capacity - (head - LOAD_ACQUIRE(&ring->tail));
+    const uint32_t offset = head & (ring->capacity - 1U);
+    const uint32_t bytesToEnd = ring->capacity - offset;
+
+    if (recordBytes <= bytesToEnd)
+    {
+        if (recordBytes > freeBytes)
+        {
+            ++ring->droppedRecords;
+            return NULL;
+        }
+        updateMinFreeBytes(ring, freeBytes - recordBytes);
+        return &ring->buffer[offset + RECORD_RING_HEADER_BYTES];
+    }
+
+    // Skip to the start of the buffer, the record must fit there as well
+    if (bytesToEnd + recordBytes > freeBytes)
+    {
+        ++ring->droppedRecords;
+        return NULL;
+    }
+    updateMinFreeBytes(ring, freeBytes - bytesToEnd - recordBytes);
+    const uint32_t marker = WRAP_MARKER;
+    memcpy(&ring->buffer[offset], &marker, sizeof(marker));
+    STORE_RELEASE(&ring->head, head + bytesToEnd);
+    return &ring->buffer[RECORD_RING_HEADER_BYTES];
+}
+
+void commitRecord(RecordRing* ring, uint32_t numBytes)
+{
+    const uint32_t head = ring->head;
+    memcpy(&ring->buffer[head & (ring->capacity - 1U)], &numBytes, sizeof(numBytes));
+    STORE_RELEASE(&ring->head, head + recordRingBytes(numBytes));
+}
+
+const void* peekRecord(RecordRing* ring, uint32_t* numBytes)
+{
+    const uint32_t head = LOAD_ACQUIRE(&ring->head);
+    uint32_t tail = ring->tail;
+    if (tail == head)
+    {
+        return NULL;
+    }
+
+    uint32_t offset = tail & (ring->capacity - 1U);
+    uint32_t recordBytes;
+    memcpy(&recordBytes, &ring->buffer[offset], sizeof(recordBytes));
+    if (recordBytes == WRAP_MARKER)
+    {
+        tail += ring->capacity - offset;
+        STORE_RELEASE(&ring->tail, tail);
+        if (tail == head)
+        {
+            return NULL;
+        }
+        offset = 0U;
+        memcpy(&recordBytes, &ring->buffer[offset], sizeof(recordBytes));
+    }
+
+    *numBytes = recordBytes;
+    return &ring->buffer[offset + RECORD_RING_HEADER_BYTES];
+}
+
+void releaseRecord(RecordRing* ring)
+{
+    const uint32_t tail = ring->tail;
+    uint32_t recordBytes;
+    memcpy(&recordBytes, &ring->buffer[tail & (ring->capacity - 1U)], sizeof(recordBytes));
+    STORE_RELEASE(&ring->tail, tail + recordRingBytes(recordBytes));
+}
+
+uint32_t usedRecordRingBytes(const RecordRing* ring)
+{
+    return LOAD_ACQUIRE(&ring->head) - LOAD_ACQUIRE(&ring->tail);
+}
+
+uint32_t takeRecordRingMinFreeBytes(RecordRing* ring)
+{
+    const uint32_t minFreeBytes = ring->minFreeBytes;
+    ring->minFreeBytes = ring->capacity;
+    return minFreeBytes;
+}
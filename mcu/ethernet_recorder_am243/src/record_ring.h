@@ -0,0 +1,62 @@
+#ifndef ETH_REC_RECORD_RING_H
+#define ETH_REC_RECORD_RING_H
+
+// Single-producer single-consumer ring of variable-size records. Lock-free: the producer only writes head, the
+// consumer only writes tail, both with release stores. Neither side blocks, so the producer may also run in an ISR.
+// Portable C without RTOS calls, so that it also builds on the host (see ../host).
+//
+// Every record is a RECORD_RING_HEADER_BYTES size word followed by the payload, padded to 8 bytes, so payloads are
+// 8-byte aligned. A record never wraps: if it does not fit before the end of the buffer, the producer skips the
+// rest of the buffer with a wrap marker.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define RECORD_RING_HEADER_BYTES (8U)
+#define RECORD_RING_ALIGNMENT (8U)
+
+
+typedef struct
+{
+    uint8_t*            buffer;
+    uint32_t            capacity;           // Power of two
+    uint32_t            head;               // Free-running, written by the producer
+    uint32_t            tail;               // Free-running, written by the consumer
+
+    uint32_t            droppedRecords;     // Producer side: reserveRecord() found no space
+    uint32_t            minFreeBytes;       // Producer side: lowest free space after a reserveRecord()
+} RecordRing;
+
+
+// buffer: 8-byte aligned, numBytes a power of two of at least 64
+bool initRecordRing(RecordRing* ring, void* buffer, uint32_t numBytes);
+
+// Producer: space for a record of numBytes, or NULL if the ring is full. The record becomes visible to the consumer
+// with commitRecord(); until then, reserving again returns the same space.
+void* reserveRecord(RecordRing* ring, uint32_t numBytes);
+
+// Producer: publish the record of numBytes (at most the reserved size) returned by the last reserveRecord()
+void commitRecord(RecordRing* ring, uint32_t numBytes);
+
+// Consumer: the oldest record and its size, or NULL if the ring is empty. It stays valid until releaseRecord().
+const void* peekRecord(RecordRing* ring, uint32_t* numBytes);
+
+// Consumer: free the record returned by peekRecord()
+void releaseRecord(RecordRing* ring);
+
+// Ring bytes taken by a record of numBytes, for sizing the ring
+static inline uint32_t recordRingBytes(uint32_t numBytes)
+{
+    return (RECORD_RING_HEADER_BYTES + numBytes + RECORD_RING_ALIGNMENT - 1U) & ~(RECORD_RING_ALIGNMENT - 1U);
+}
+
+// Either side: bytes in use, wrap markers included
+uint32_t usedRecordRingBytes(const RecordRing* ring);
+
+// Consumer: the lowest free space since the previous call, then start over. A reserveRecord() racing with this call
+// may be missed, which is fine for statistics.
+uint32_t takeRecordRingMinFreeBytes(RecordRing* ring);
+
+
+#endif  // ETH_REC_RECORD_RING_H
@@ -1,11 +1,16 @@
 #include "usb_comm.h"
 #include "app_config.h"
+#include "packet_recorder.h"
+#include "usb_stream_writer.h"
 
 
 // Tiny USB
 #include <class/cdc/cdc_device.h>
 #include <device/usbd.h>
 
+// Kernel
+#include <kernel/dpl/ClockP.h>
+
 // FreeRTOS
 #include "FreeRTOS.h"
 #include "task.h"
@@ -13,7 +18,6 @@
 
 // Standard C
 #include <string.h>
-#include <ctype.h>
 
 
 #define MIN_FREE_TX_BYTES (32U)
@@ -26,37 +30,11 @@ TaskHandle_t    taskCdc = NULL;
 StackType_t     taskCdcStackBuffer[TASK_CDC_STACK_SIZE_WORDS];
 StaticTask_t    taskCdcBuffer;
 
-SemaphoreHandle_t   mutexCdc = NULL;
-StaticSemaphore_t   mutexCdcBuffer;
-
-SemaphoreHandle_t   semaphoreCdc = NULL;
-StaticSemaphore_t   semaphoreCdcBuffer;
-
+// Per data channel: a semaphore given by the Tx completion, and the Tx stream written by its recording task
+SemaphoreHandle_t   semaphoreCdc[USB_DATA_CHANNELS];
+StaticSemaphore_t   semaphoreCdcBuffer[USB_DATA_CHANNELS];
+UsbStreamWriter     usbWriters[USB_DATA_CHANNELS];
 
-/* echo to either Serial0 or Serial1
-   with Serial0 as all lower case, Serial1 as all upper case
- */
-static void echo_serial_port(uint8_t itf, uint8_t buf[], uint32_t count)
-{
-    for(uint32_t i=0; i<count; i++)
-    {
-        if (itf == 0)
-        {
-            /* echo back 1st port as lower case */
-            if (isupper(buf[i])) buf[i] += 'a' - 'A';
-        }
-        else
-        {
-            /* echo back additional ports as upper case */
-            if (islower(buf[i])) buf[i] -= 'a' - 'A';
-        }
-
-        tud_cdc_n_write_char(itf, buf[i]);
-
-        if ( buf[i] == '\r' ) tud_cdc_n_write_char(itf, '\n');
-    }
-    tud_cdc_n_write_flush(itf);
-}
 
 static void cdc_task(void)
 {
@@ -80,23 +58,25 @@ static void cdc_task(void)
 
     for (itf = 0; itf < CFG_TUD_CDC; itf++)
     {
-        /* connected() check for DTR bit
-           Most but not all terminal client set this when making connection
-         */
-        /* if ( tud_cdc_n_connected(itf) ) */
+        if (tud_cdc_n_available(itf))
         {
-            if ( tud_cdc_n_available(itf) )
-            {
-                uint8_t buf[64];
+            uint8_t buf[64];
 
-                uint32_t count = tud_cdc_n_read(itf, buf, sizeof(buf));
+            const uint32_t count = tud_cdc_n_read(itf, buf, sizeof(buf));
 
-                /* echo back to both serial ports */
-                echo_serial_port(0, buf, count);
-                echo_serial_port(1, buf, count);
+            // The first interface carries the host commands, anything sent to other interfaces is discarded
+            if (itf == 0)
+            {
+                processHostCommands(buf, count);
             }
         }
     }
+
+    // Once the host sent everything it had, e.g. a whole configuration
+    if (!tud_cdc_n_available(0))
+    {
+        applyHostCommands();
+    }
 }
 
 static void taskTudLoop(void *args)
@@ -117,6 +97,45 @@ static void taskCdcLoop(void *args)
 }
 
 
+// UsbFifo functions, context is the CDC interface number
+static uint32_t cdcWriteAvailable(void* context)
+{
+    return tud_cdc_n_write_available((uint8_t)(uintptr_t)context);
+}
+
+static uint32_t cdcWrite(void* context, const void* data, uint32_t numBytes)
+{
+    const uint32_t bytesWritten = tud_cdc_n_write((uint8_t)(uintptr_t)context, data, numBytes);
+    if (bytesWritten != numBytes)
+    {
+        DebugP_logError("tud_cdc_n_write failed\r\n");
+    }
+    return bytesWritten;
+}
+
+static void cdcFlush(void* context)
+{
+    tud_cdc_n_write_flush((uint8_t)(uintptr_t)context);
+}
+
+static bool cdcIsConnected(void* context)
+{
+    return tud_cdc_n_connected((uint8_t)(uintptr_t)context);
+}
+
+static bool cdcWaitForSpace(void* context, uint32_t timeoutUs)
+{
+    const TickType_t ticksToWait = (timeoutUs == USB_STREAM_WAIT_FOREVER)? portMAX_DELAY : pdMS_TO_TICKS((timeoutUs + 999U) / 1000U);
+    return xSemaphoreTake(semaphoreCdc[(uintptr_t)context], ticksToWait) == pdTRUE;
+}
+
+static uint64_t cdcNowUs(void* context)
+{
+    (void)context;
+    return ClockP_getTimeUsec();
+}
+
+
 void initUsbComm()
 {
     /* TUD task is to handle the USB device events */
@@ -149,85 +168,54 @@ void initUsbComm()
         return;
     }
 
-    /* CDC mutex to queue writing commands */
-    mutexCdc = xSemaphoreCreateMutexStatic(&mutexCdcBuffer);
-    if (mutexCdc == NULL)
+    for (uint32_t channel = 0; channel < USB_DATA_CHANNELS; channel++)
     {
-        DebugP_logError("Cannot create CDC mutex\r\n");
-        return;
-    }
+        /* Binary semaphore to wait for flushing CDC Tx */
+        semaphoreCdc[channel] = xSemaphoreCreateBinaryStatic(&semaphoreCdcBuffer[channel]);
+        if (semaphoreCdc[channel] == NULL)
+        {
+            DebugP_logError("Cannot create CDC semaphore\r\n");
+            return;
+        }
 
-    /* Binary semaphore to wait for flushing CDC Tx */
-    semaphoreCdc = xSemaphoreCreateBinaryStatic(&semaphoreCdcBuffer);
-    if (semaphoreCdc == NULL)
-    {
-        DebugP_logError("Cannot create CDC semaphore\r\n");
-        return;
+        const UsbFifo cdcFifo = {(void*)(uintptr_t)channel, cdcWriteAvailable, cdcWrite, cdcFlush, cdcIsConnected, cdcWaitForSpace, cdcNowUs};
+        if (!initUsbStreamWriter(&usbWriters[channel], &cdcFifo, MIN_FREE_TX_BYTES, USB_FLUSH_DELAY_US))
+        {
+            DebugP_logError("Cannot initialize the USB writer\r\n");
+        }
     }
 }
 
 void tud_cdc_tx_complete_cb(uint8_t itf)
 {
-    // This module uses the first CDC interface only
-    if (itf == 0)
+    // Only the data channels wait for Tx space
+    if (itf < USB_DATA_CHANNELS)
     {
-        xSemaphoreGive(semaphoreCdc);
+        xSemaphoreGive(semaphoreCdc[itf]);
     }
 }
 
-uint32_t writeUsb(const void* data, uint32_t numBytes, TickType_t ticksToWait)
+uint32_t writeUsb(uint32_t channel, const void* data, uint32_t numBytes, TickType_t ticksToWait)
 {
-    if (xSemaphoreTake(mutexCdc, ticksToWait) != pdTRUE)
-    {
-        return 0;
-    }
-
-    const uint8_t *bytesPtr = (const uint8_t *)data;
-    uint8_t totalBytesWritten = 0;
-
-    while (numBytes > 0)
-    {
-        if (!tud_cdc_n_connected(0))
-        {
-            // No USB connection, just discard the message
-            break;
-        }
-
-        uint32_t bytesToWrite = tud_cdc_n_write_available(0);
-        if (bytesToWrite < MIN_FREE_TX_BYTES)
-        {
-            // Wait until Tx FIFO has more space
-            if (xSemaphoreTake(semaphoreCdc, ticksToWait) != pdTRUE)
-            {
-                break;
-            }
-
-            continue;
-        }
-
-        // Write to Tx FIFO
-        if (bytesToWrite > numBytes)
-        {
-            bytesToWrite = numBytes;
-        }
-        if (tud_cdc_n_write(0, bytesPtr, bytesToWrite) != bytesToWrite)
-        {
-            DebugP_logError("tud_cdc_n_write failed\r\n");
-            break;
-        }
-        tud_cdc_n_write_flush(0);
+    const uint32_t timeoutUs = (ticksToWait == portMAX_DELAY)? USB_STREAM_WAIT_FOREVER : (uint32_t)(ticksToWait * (1000000U / configTICK_RATE_HZ));
+    return writeUsbStream(&usbWriters[channel], data, numBytes, timeoutUs);
+}
 
-        // Update data buffer
-        bytesPtr += bytesToWrite;
-        totalBytesWritten += bytesToWrite;
-        numBytes -= bytesToWrite;
-    }
+void pollUsb(uint32_t channel, uint64_t nowUs)
+{
+    pollUsbStreamWriter(&usbWriters[channel], nowUs);
+}
 
-    if (xSemaphoreGive(mutexCdc) != pdTRUE)
-    {
-        DebugP_logError("Cannot release CDC mutex\r\n");
-        return totalBytesWritten;
-    }
+void flushUsb(uint32_t channel)
+{
+    flushUsbStreamWriter(&usbWriters[channel]);
+}
 
-    return totalBytesWritten;
+void getUsbStats(uint32_t channel, UsbStats* stats)
+{
+    const UsbStreamWriter* writer = &usbWriters[channel];
+    stats->writtenBytes = writer->writtenBytes;
+    stats->discardedBytes = writer->discardedBytes;
+    stats->stalls = writer->stalls;
+    stats->stallUs = writer->stallUs;
 }
@@ -6,9 +6,31 @@
 #include <stdint.h>
 
 
+typedef struct
+{
+    uint64_t    writtenBytes;       // To the CDC Tx FIFO
+    uint32_t    discardedBytes;     // Not written: no host connected, a timeout or a write error
+    uint32_t    stalls;             // Waits for space in the CDC Tx FIFO
+    uint32_t    stallUs;            // Time spent in these waits
+} UsbStats;
+
+
 void initUsbComm();
 
-uint32_t writeUsb(const void* data, uint32_t numBytes, TickType_t ticksToWait);
+// Data channels: CDC interface k carries the stream of channel k, k < USB_DATA_CHANNELS. Each channel is written by
+// one task only (its recording task), so these functions do not lock.
+
+// Append to the CDC Tx FIFO of channel. Returns the number of bytes written, less than numBytes if the rest was
+// discarded. The FIFO is flushed when it is full; otherwise call pollUsb() and flushUsb().
+uint32_t writeUsb(uint32_t channel, const void* data, uint32_t numBytes, TickType_t ticksToWait);
+
+// Flush if the oldest byte in the FIFO of channel waited USB_FLUSH_DELAY_US
+void pollUsb(uint32_t channel, uint64_t nowUs);
+
+// Flush now, when there is nothing more to write for a while
+void flushUsb(uint32_t channel);
 
+// Counters of channel since the start, updated by writeUsb()
+void getUsbStats(uint32_t channel, UsbStats* stats);
 
 #endif  // ETH_REC_USB_COMM_H
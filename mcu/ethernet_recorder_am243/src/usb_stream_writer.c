@@ -0,0 +1,101 @@
+#include "usb_stream_writer.h"
+
+// Standard C
+#include <stddef.h>
+#include <string.h>
+
+
+static void flushPending(UsbStreamWriter* writer, uint32_t* flushCounter)
+{
+    if (writer->pendingBytes > 0U)
+    {
+        writer->fifo.flush(writer->fifo.context);
+        writer->pendingBytes = 0U;
+        ++*flushCounter;
+    }
+}
+
+
+bool initUsbStreamWriter(UsbStreamWriter* writer, const UsbFifo* fifo, uint32_t minFreeBytes, uint32_t flushDelayUs)
+{
+    if ((fifo->writeAvailable == NULL) || (fifo->write == NULL) || (fifo->flush == NULL) || (fifo->isConnected == NULL)
+        || (fifo->waitForSpace == NULL) || (fifo->nowUs == NULL) || (minFreeBytes == 0U))
+    {
+        return false;
+    }
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fifo = *fifo;
+    writer->minFreeBytes = minFreeBytes;
+    writer->flushDelayUs = flushDelayUs;
+    return true;
+}
+
+uint32_t writeUsbStream(UsbStreamWriter* writer, const void* data, uint32_t numBytes, uint32_t timeoutUs)
+{
+    const uint8_t* bytesPtr = (const uint8_t*)data;
+    uint32_t totalBytesWritten = 0U;
+
+    while (numBytes > 0U)
+    {
+        if (!writer->fifo.isConnected(writer->fifo.context))
+        {
+            // No USB connection, just discard the rest. The queued bytes are gone with the connection.
+            writer->pendingBytes = 0U;
+            break;
+        }
+
+        uint32_t bytesToWrite = writer->fifo.writeAvailable(writer->fifo.context);
+        if (bytesToWrite < writer->minFreeBytes)
+        {
+            // Full: make sure the queued bytes go out, then wait for a transfer to complete
+            flushPending(writer, &writer->fullFlushes);
+
+            const uint64_t stallStartUs = writer->fifo.nowUs(writer->fifo.context);
+            const bool hasSpace = writer->fifo.waitForSpace(writer->fifo.context, timeoutUs);
+            ++writer->stalls;
+            writer->stallUs += (uint32_t)(writer->fifo.nowUs(writer->fifo.context) - stallStartUs);
+            if (!hasSpace)
+            {
+                break;
+            }
+            continue;
+        }
+
+        if (bytesToWrite > numBytes)
+        {
+            bytesToWrite = numBytes;
+        }
+        if (writer->fifo.write(writer->fifo.context, bytesPtr, bytesToWrite) != bytesToWrite)
+        {
+            break;
+        }
+
+        if (writer->pendingBytes == 0U)
+        {
+            writer->pendingSinceUs = writer->fifo.nowUs(writer->fifo.context);
+        }
+        writer->pendingBytes += bytesToWrite;
+
+        bytesPtr += bytesToWrite;
+        totalBytesWritten += bytesToWrite;
+        numBytes -= bytesToWrite;
+    }
+
+    writer->writtenBytes += totalBytesWritten;
+    writer->discardedBytes += numBytes;
+    return totalBytesWritten;
+}
+
+void pollUsbStreamWriter(UsbStreamWriter* writer, uint64_t nowUs)
+{
+    if ((writer->pendingBytes > 0U) && (nowUs - writer->pendingSinceUs >= writer->flushDelayUs))
+    {
+        flushPending(writer, &writer->deadlineFlushes);
+    }
+}
+
+void flushUsbStreamWriter(UsbStreamWriter* writer)
+{
+    flushPending(writer, &writer->idleFlushes);
+}
@@ -0,0 +1,62 @@
+#ifndef ETH_REC_USB_STREAM_WRITER_H
+#define ETH_REC_USB_STREAM_WRITER_H
+
+// Streams records into a USB Tx FIFO (TinyUSB CDC) and decides when to flush it. Records are only appended to the
+// FIFO; a flush starts a transfer of whatever is queued, so it is only done when the FIFO is full, when its oldest
+// byte waited flushDelayUs, or when the caller has nothing more to write. In between, the USB stack sends full
+// packets on its own. Portable C without RTOS calls, so that it also builds on the host (see ../host).
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define USB_STREAM_WAIT_FOREVER (0xFFFFFFFFU)
+
+
+// The Tx FIFO, e.g. tud_cdc_n_write_available() and friends of one CDC interface. Every function gets context,
+// e.g. the interface number.
+typedef struct
+{
+    void*       context;
+    uint32_t    (*writeAvailable)(void* context);
+    uint32_t    (*write)(void* context, const void* data, uint32_t numBytes);      // Returns the number of bytes queued
+    void        (*flush)(void* context);                                            // Start a transfer of the queued bytes
+    bool        (*isConnected)(void* context);
+    bool        (*waitForSpace)(void* context, uint32_t timeoutUs);                // Until a transfer completed, false on timeout
+    uint64_t    (*nowUs)(void* context);
+} UsbFifo;
+
+
+typedef struct
+{
+    UsbFifo     fifo;
+    uint32_t    minFreeBytes;           // Less free space counts as full
+    uint32_t    flushDelayUs;
+
+    uint32_t    pendingBytes;           // Queued since the last flush
+    uint64_t    pendingSinceUs;
+
+    uint64_t    writtenBytes;
+    uint32_t    discardedBytes;         // Not written: not connected, a timeout or a FIFO error
+    uint32_t    stalls;                 // Waits for space in the FIFO
+    uint32_t    stallUs;
+    uint32_t    fullFlushes;
+    uint32_t    deadlineFlushes;
+    uint32_t    idleFlushes;
+} UsbStreamWriter;
+
+
+bool initUsbStreamWriter(UsbStreamWriter* writer, const UsbFifo* fifo, uint32_t minFreeBytes, uint32_t flushDelayUs);
+
+// Append to the FIFO, waiting for space at most timeoutUs per wait. Returns the number of bytes written, less than
+// numBytes if the rest was discarded.
+uint32_t writeUsbStream(UsbStreamWriter* writer, const void* data, uint32_t numBytes, uint32_t timeoutUs);
+
+// Flush if the oldest queued byte waited flushDelayUs
+void pollUsbStreamWriter(UsbStreamWriter* writer, uint64_t nowUs);
+
+// Flush now, e.g. when there is nothing more to write
+void flushUsbStreamWriter(UsbStreamWriter* writer);
+
+
+#endif  // ETH_REC_USB_STREAM_WRITER_H